@@ -0,0 +1,267 @@
+// source/backup.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+#include "backup.h"
+#include "usb.h"
+#include "fileio.h"
+#include "crc32.h"
+#include "telemetry.h"
+#include "perf.h"
+
+#define WRITER_STACK_SIZE (16 * 1024)
+#define WRITER_PRIORITY   70
+
+typedef struct {
+    uint8_t* data;
+    uint32_t length;            // 0 marks the end of the dump
+} BackupSlot;
+
+typedef struct {
+    FILE* image;
+    FILE* manifest;
+    BackupSlot slots[BACKUP_BUFFERS];
+
+    // free: buffers the reads may fill, full: buffers for the writer
+    sem_t free_sem;
+    sem_t full_sem;
+    lwp_t writer;
+
+    uint64_t offset;            // Image offset of the next block written
+    uint32_t checksum;          // CRC32 of everything up to offset
+    volatile int write_error;
+} BackupJob;
+
+static BackupReport backup_report;
+
+// --- Manifest ---
+
+// Blocks a previous run got onto the card. Returns the offset to resume
+// from with its CRC32, or 0 when the dump has to start over.
+static uint64_t backup_resume_point(const char* manifest_path, const char* partition,
+                                    uint64_t size, uint32_t* checksum) {
+    FILE* f = fopen(manifest_path, "r");
+    if (!f) return 0;
+
+    char line[128];
+    char name[64] = "";
+    uint64_t manifest_size = 0;
+    uint32_t block_size = 0;
+    uint64_t offset = 0;
+    uint32_t crc = 0;
+    int complete = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long block_offset, value;
+        unsigned int length, block_crc;
+        if (sscanf(line, "partition %63s", name) == 1) continue;
+        if (sscanf(line, "size %llu", &value) == 1) { manifest_size = value; continue; }
+        if (sscanf(line, "block_size %u", &length) == 1) { block_size = length; continue; }
+        if (sscanf(line, "crc32 %x", &block_crc) == 1) { complete = 1; continue; }
+        if (sscanf(line, "block %llx %u %x", &block_offset, &length, &block_crc) == 3) {
+            // Only whole blocks in order count; a torn last line does not
+            if (block_offset != offset ||
+                (length != BACKUP_BLOCK_SIZE && block_offset + length != size)) break;
+            crc = crc32_combine(crc, block_crc, length);
+            offset += length;
+        }
+    }
+    fclose(f);
+
+    // A finished backup is redone from scratch: the device may have changed
+    if (complete || strcasecmp(name, partition) != 0 || manifest_size != size ||
+        block_size != BACKUP_BLOCK_SIZE || offset >= size) {
+        return 0;
+    }
+    *checksum = crc;
+    return offset;
+}
+
+// --- Writer Thread ---
+
+static void* backup_writer(void* arg) {
+    BackupJob* job = (BackupJob*)arg;
+    uint32_t index = 0;
+
+    while (1) {
+        u64 wait_start = gettime();
+        LWP_SemWait(job->full_sem);
+        u64 write_start = gettime();
+        backup_report.writer_stall_us += ticks_to_microsecs(write_start - wait_start);
+
+        BackupSlot* slot = &job->slots[index];
+        index = (index + 1) % BACKUP_BUFFERS;
+        if (slot->length == 0) break;
+
+        if (!job->write_error) {
+            // The block must be on the card before the manifest says so
+            uint32_t crc = crc32_update(0, slot->data, slot->length);
+            if (fwrite(slot->data, 1, slot->length, job->image) != slot->length ||
+                fprintf(job->manifest, "block %llx %u %08x\n",
+                        (unsigned long long)job->offset, slot->length, crc) < 0 ||
+                fflush(job->manifest) != 0) {
+                job->write_error = -3;
+            } else {
+                job->checksum = crc32_combine(job->checksum, crc, slot->length);
+                job->offset += slot->length;
+            }
+        }
+        backup_report.write_us += ticks_to_microsecs(gettime() - write_start);
+
+        LWP_SemPost(job->free_sem);
+    }
+
+    return NULL;
+}
+
+// --- Public API ---
+
+int backup_partition(const char* partition, uint64_t size, const char* directory,
+                     FlashProgressCallback callback) {
+    memset(&backup_report, 0, sizeof(backup_report));
+    if (!partition || !directory || size == 0 || size > 0xFFFFFFFFull) return -1;
+
+    BackupReport* report = &backup_report;
+    report->size = size;
+    snprintf(report->image_path, sizeof(report->image_path), "%s/%s.img",
+             directory, partition);
+    snprintf(report->manifest_path, sizeof(report->manifest_path), "%s/%s.manifest",
+             directory, partition);
+    fileio_create_directory(directory);
+
+    BackupJob job;
+    memset(&job, 0, sizeof(job));
+    job.offset = backup_resume_point(report->manifest_path, partition, size, &job.checksum);
+
+    // Resuming keeps the blocks already written and appends to the manifest
+    if (job.offset > 0) {
+        job.image = fopen(report->image_path, "r+b");
+        if (job.image && fileio_seek(job.image, job.offset) != 0) {
+            fclose(job.image);
+            job.image = NULL;
+        }
+        if (job.image) job.manifest = fopen(report->manifest_path, "a");
+        if (!job.image || !job.manifest) {
+            if (job.image) fclose(job.image);
+            job.image = NULL;
+            job.offset = 0;
+            job.checksum = 0;
+        }
+    }
+    if (job.offset == 0) {
+        job.image = fopen(report->image_path, "wb");
+        job.manifest = fopen(report->manifest_path, "w");
+        if (!job.image || !job.manifest) {
+            if (job.image) fclose(job.image);
+            if (job.manifest) fclose(job.manifest);
+            return -1;
+        }
+        fprintf(job.manifest, "partition %s\nsize %llu\nblock_size %u\n", partition,
+                (unsigned long long)size, BACKUP_BLOCK_SIZE);
+        fflush(job.manifest);
+    }
+    report->resumed_from = job.offset;
+
+    // Whole aligned blocks go to libfat unbuffered, so they are DMAed in place
+    setvbuf(job.image, NULL, _IONBF, 0);
+
+    int result = 0;
+    for (int i = 0; i < BACKUP_BUFFERS; i++) {
+        job.slots[i].data = usb_lend_buffer(BACKUP_BLOCK_SIZE);
+        if (!job.slots[i].data) result = -1;
+    }
+
+    LWP_SemInit(&job.free_sem, BACKUP_BUFFERS, BACKUP_BUFFERS);
+    LWP_SemInit(&job.full_sem, 0, BACKUP_BUFFERS);
+    if (result == 0 && LWP_CreateThread(&job.writer, backup_writer, &job, NULL,
+                                        WRITER_STACK_SIZE, WRITER_PRIORITY) < 0) {
+        result = -1;
+    }
+
+    u64 start = gettime();
+    uint64_t offset = job.offset;
+    if (result == 0) {
+        if (usb_start_session() != 0 ||
+            samsung_send_dump_request(partition, (uint32_t)offset,
+                                      (uint32_t)(size - offset)) != 0) {
+            result = -2;
+        }
+
+        uint32_t index = 0;
+        telemetry_start(size - offset);
+        while (result == 0 && offset < size && !job.write_error &&
+               !flash_abort_requested()) {
+            u64 wait_start = gettime();
+            LWP_SemWait(job.free_sem);
+            u64 read_start = gettime();
+            report->usb_stall_us += ticks_to_microsecs(read_start - wait_start);
+
+            BackupSlot* slot = &job.slots[index];
+            uint32_t wanted = (size - offset < BACKUP_BLOCK_SIZE) ?
+                              (uint32_t)(size - offset) : BACKUP_BLOCK_SIZE;
+            uint32_t got = wanted;
+            if (usb_receive_bulk(&slot->data, &got) != 0 || got != wanted) {
+                LWP_SemPost(job.free_sem);
+                result = -2;
+                break;
+            }
+            uint64_t usb_us = ticks_to_microsecs(gettime() - read_start);
+            report->usb_us += usb_us;
+            telemetry_add(got, usb_us, ticks_to_microsecs(read_start - wait_start));
+
+            slot->length = got;
+            index = (index + 1) % BACKUP_BUFFERS;
+            LWP_SemPost(job.full_sem);
+
+            offset += got;
+            report->bytes += got;
+            if (callback && telemetry_due()) {
+                char status[64];
+                telemetry_format("Backing up", status, sizeof(status));
+                callback((float)offset / (float)size, status);
+            }
+        }
+        // Cut short by an abort: the manifest keeps what was read
+        if (result == 0 && offset < size && !job.write_error) result = -2;
+        usb_end_flash_session();
+
+        // End marker, then wait for the writer to finish the queue
+        LWP_SemWait(job.free_sem);
+        job.slots[index].length = 0;
+        LWP_SemPost(job.full_sem);
+        LWP_JoinThread(job.writer, NULL);
+    }
+    report->elapsed_us = ticks_to_microsecs(gettime() - start);
+    perf_add(PERF_USB, report->usb_us);
+    perf_add(PERF_SD_WRITE, report->write_us);
+    perf_add_bytes(report->bytes);
+
+    if (result == 0 && job.write_error) result = job.write_error;
+    if (result == 0) {
+        // Drop anything a longer, older image left behind
+        fflush(job.image);
+        if (ftruncate(fileno(job.image), (off_t)size) != 0) result = -3;
+    }
+    if (result == 0) {
+        fprintf(job.manifest, "crc32 %08x\n", job.checksum);
+        if (fflush(job.manifest) != 0) result = -3;
+    }
+    report->checksum = job.checksum;
+
+    LWP_SemDestroy(job.free_sem);
+    LWP_SemDestroy(job.full_sem);
+    for (int i = 0; i < BACKUP_BUFFERS; i++) {
+        usb_return_buffer(job.slots[i].data);
+    }
+    fclose(job.image);
+    if (fclose(job.manifest) != 0 && result == 0) result = -3;
+    return result;
+}
+
+const BackupReport* backup_get_report(void) {
+    return &backup_report;
+}
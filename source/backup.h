@@ -0,0 +1,40 @@
+// source/backup.h
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <stdint.h>
+#include "flash.h"
+
+// Partition dumps to the SD card, for EFS/modem backups before a risky
+// flash. Bulk IN reads fill a ring of aligned buffers while a writer
+// thread stores and hashes the previous ones, so the bus and the card
+// work at the same time. A manifest next to the image gets a CRC32 line
+// per block once that block is on the card: an interrupted dump resumes
+// after the last recorded block, and a finished one ends with the CRC32
+// of the whole image.
+
+#define BACKUP_DIRECTORY  "sd:/backup"
+#define BACKUP_BLOCK_SIZE (256 * 1024)  // One ring buffer, one manifest line
+#define BACKUP_BUFFERS    4
+
+typedef struct {
+    char image_path[128];
+    char manifest_path[128];
+    uint64_t size;
+    uint64_t resumed_from;      // Offset this run started at
+    uint64_t bytes;             // Bytes read this run
+    uint32_t checksum;          // CRC32 of the whole image
+    uint64_t usb_us;            // Inside bulk IN reads
+    uint64_t write_us;          // Writer inside fwrite and the manifest
+    uint64_t usb_stall_us;      // Reads waiting for the writer to free a buffer
+    uint64_t writer_stall_us;   // Writer waiting for a read
+    uint64_t elapsed_us;
+} BackupReport;
+
+// Dump size bytes of partition into directory/<partition>.img.
+// Returns 0, -1 bad arguments or files, -2 USB failure or aborted, -3 SD write failure
+int backup_partition(const char* partition, uint64_t size, const char* directory,
+                     FlashProgressCallback callback);
+const BackupReport* backup_get_report(void);
+
+#endif
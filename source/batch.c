@@ -0,0 +1,163 @@
+// source/batch.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include "batch.h"
+#include "usb.h"
+#include "fileio.h"
+#include "image.h"
+
+static BatchItem batch_items[BATCH_MAX_ITEMS];
+static uint32_t batch_item_count = 0;
+static BatchReport batch_report;
+
+// --- Queue ---
+
+int batch_add(const char* filename, const char* partition) {
+    if (!filename || !partition || !partition[0]) return -1;
+    if (batch_item_count >= BATCH_MAX_ITEMS) return -2;
+    if (!fileio_file_exists(filename)) return -1;
+
+    BatchItem* item = &batch_items[batch_item_count];
+    memset(item, 0, sizeof(*item));
+    snprintf(item->filename, sizeof(item->filename), "%s", filename);
+    snprintf(item->partition, sizeof(item->partition), "%s", partition);
+    item->file_size = fileio_get_file_size(filename);
+    item->result = BATCH_ITEM_PENDING;
+
+    batch_item_count++;
+    return 0;
+}
+
+uint32_t batch_count(void) {
+    return batch_item_count;
+}
+
+void batch_clear(void) {
+    batch_item_count = 0;
+}
+
+// --- Progress ---
+
+static FlashProgressCallback batch_cb = NULL;
+static uint64_t batch_done;     // File bytes of the items already flashed
+static uint64_t batch_item_size;
+static uint64_t batch_total;
+
+// Turn the per-item progress of the flash engine into queue progress
+static int batch_progress(float progress, const char* status) {
+    if (!batch_cb || batch_total == 0) return 1;
+    float overall = (float)(batch_done + (uint64_t)(progress * batch_item_size)) /
+                    (float)batch_total;
+    return batch_cb(overall, status);
+}
+
+// --- Run ---
+
+static int batch_flash_item(BatchItem* item, FileReader* reader) {
+    u64 start = gettime();
+
+    // The reader has been prefetching since the previous item started, so
+    // the decoders find their headers already in memory
+    FlashSource input;
+    ImageStream image;
+    flash_reader_source(reader, &input);
+    int result = (image_open(&image, &input, fileio_reader_size(reader),
+                             item->filename) == 0) ? 0 : -1;
+    if (result == 0 && (image.size == 0 || image.size > 0xFFFFFFFFull)) result = -1;
+
+    u64 flash_start = gettime();
+    item->open_us += ticks_to_microsecs(flash_start - start);
+
+    if (result == 0) {
+        item->image_size = image.size;
+        if (flash_stream_resumable(&image.source, (uint32_t)image.size, item->partition,
+                                   item->filename, batch_progress) != 0) {
+            result = -3;
+        }
+        if (item->resumes > 0) item->resumed_parts += flash_get_report()->resumed;
+    }
+    item->flash_us += ticks_to_microsecs(gettime() - flash_start);
+
+    image_close(&image);
+    return result;
+}
+
+int batch_run(FlashProgressCallback callback) {
+    memset(&batch_report, 0, sizeof(batch_report));
+    if (batch_item_count == 0) return -1;
+
+    BatchReport* report = &batch_report;
+    report->count = batch_item_count;
+    memcpy(report->items, batch_items, batch_item_count * sizeof(BatchItem));
+
+    batch_cb = callback;
+    batch_done = 0;
+    batch_total = 0;
+    for (uint32_t i = 0; i < report->count; i++) {
+        batch_total += report->items[i].file_size;
+    }
+
+    u64 start = gettime();
+    if (usb_start_session() != 0) {
+        report->session_us = ticks_to_microsecs(gettime() - start);
+        report->elapsed_us = report->session_us;
+        batch_cb = NULL;
+        return -2;
+    }
+    report->session_us = ticks_to_microsecs(gettime() - start);
+
+    int result = 0;
+    FileReader* next = fileio_reader_open(report->items[0].filename, 0);
+    for (uint32_t i = 0; i < report->count; i++) {
+        BatchItem* item = &report->items[i];
+        FileReader* reader = next;
+
+        // Start reading the next image off the card while this one flashes
+        next = (i + 1 < report->count) ?
+               fileio_reader_open(report->items[i + 1].filename, 0) : NULL;
+
+        batch_item_size = item->file_size;
+        item->result = reader ? batch_flash_item(item, reader) : -1;
+        fileio_reader_close(reader);
+
+        // A dropped link leaves a checkpoint: reconnect and carry on from it
+        while (item->result == -3 && item->resumes < BATCH_RESUME_RETRIES &&
+               !flash_abort_requested() && flash_has_checkpoint(item->partition)) {
+            u64 session_start = gettime();
+            usb_end_flash_session();
+            int session = usb_start_session();
+            report->session_us += ticks_to_microsecs(gettime() - session_start);
+            if (session != 0) break;
+
+            item->resumes++;
+            reader = fileio_reader_open(item->filename, 0);
+            item->result = reader ? batch_flash_item(item, reader) : -1;
+            fileio_reader_close(reader);
+        }
+
+        if (item->result != 0) {
+            report->failed++;
+            result = -3;
+            break;
+        }
+        report->flashed++;
+        report->bytes += item->image_size;
+        batch_done += item->file_size;
+    }
+    fileio_reader_close(next);
+
+    u64 end_start = gettime();
+    usb_end_flash_session();
+    u64 end = gettime();
+    report->session_us += ticks_to_microsecs(end - end_start);
+    report->elapsed_us = ticks_to_microsecs(end - start);
+
+    batch_cb = NULL;
+    return result;
+}
+
+const BatchReport* batch_get_report(void) {
+    return &batch_report;
+}
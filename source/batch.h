@@ -0,0 +1,56 @@
+// source/batch.h
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "flash.h"
+
+// Flash job queue. A full firmware (BL, AP, CP, CSC images) goes to the
+// device in one Odin session: the handshake is done once, every queued
+// image is streamed back to back with the file protocol, and ENDC closes
+// the session at the end. While one image is on the bus, the SD reader of
+// the next one is already filling its first window, so the gap between
+// images is not spent waiting for the card. An item cut off half way is
+// continued from its flash checkpoint over a fresh session.
+
+#define BATCH_MAX_ITEMS 16
+
+#define BATCH_ITEM_PENDING 1        // result of items the run never reached
+#define BATCH_RESUME_RETRIES 2      // Reconnects per item before giving up
+
+// Time is in microseconds
+typedef struct {
+    char filename[256];
+    char partition[32];
+    uint64_t file_size;         // Bytes on the card
+    uint64_t image_size;        // Bytes flashed (after lz4/sparse decoding)
+    int result;                 // 0, <0 failed, BATCH_ITEM_PENDING
+    uint64_t open_us;           // Opening the image, incl. waiting for the first window
+    uint64_t flash_us;
+    uint32_t resumes;           // Reconnects that continued from the checkpoint
+    uint32_t resumed_parts;     // Parts those did not have to send again
+} BatchItem;
+
+typedef struct {
+    uint32_t count;
+    uint32_t flashed;
+    uint32_t failed;
+    uint64_t bytes;             // Image bytes flashed
+    uint64_t session_us;        // Odin handshake and ENDC
+    uint64_t elapsed_us;
+    BatchItem items[BATCH_MAX_ITEMS];
+} BatchReport;
+
+// Queue filename for partition. Returns 0, -1 missing file or bad
+// arguments, -2 queue full.
+int batch_add(const char* filename, const char* partition);
+uint32_t batch_count(void);
+void batch_clear(void);
+
+// Open one session and flash every queued item in order, stopping at the
+// first failure. The queue is kept, so a failed run can be retried.
+// Returns 0, -1 empty queue, -2 session failed, -3 an item failed.
+int batch_run(FlashProgressCallback callback);
+const BatchReport* batch_get_report(void);
+
+#endif
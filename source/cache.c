@@ -0,0 +1,288 @@
+// source/cache.c
+#include <gccore.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "fileio.h"
+
+typedef struct {
+    char path[256];
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t cached;            // Bytes of the head held in pages[]
+    uint32_t page_count;        // Pages owned
+    uint16_t* pages;
+    uint32_t used;              // Recency
+    int readers;                // Open readers; such entries are not evicted
+} CacheEntry;
+
+struct CacheReader {
+    CacheEntry* entry;
+    FILE* file;                 // Opened once the read passes the cached head
+    uint64_t position;
+};
+
+static uint8_t* cache_region = NULL;
+static uint32_t region_pages = 0;   // Pages in the region
+static uint32_t budget_pages = 0;   // Pages allowed, <= region_pages once taken
+static uint32_t budget = CACHE_DEFAULT_BUDGET;
+static uint8_t* page_owned = NULL;  // 1 per page in use
+static uint32_t pages_free = 0;
+static CacheEntry entries[CACHE_MAX_ENTRIES];
+static uint32_t cache_clock = 0;
+static CacheStats stats;
+
+// --- Pages ---
+
+static int cache_reserve_region(void) {
+    if (cache_region) return 0;
+    uint32_t pages = budget / CACHE_PAGE_SIZE;
+    if (pages == 0) return -1;
+
+    page_owned = calloc(pages, 1);
+    cache_region = page_owned ? SYS_AllocArena2MemLo(pages * CACHE_PAGE_SIZE, 32) : NULL;
+    if (!cache_region) {
+        free(page_owned);
+        page_owned = NULL;
+        return -1;
+    }
+    region_pages = pages;
+    budget_pages = pages;
+    pages_free = pages;
+    return 0;
+}
+
+static uint8_t* cache_page(uint16_t page) {
+    return cache_region + (uint32_t)page * CACHE_PAGE_SIZE;
+}
+
+static void cache_release(CacheEntry* e) {
+    for (uint32_t i = 0; i < e->page_count; i++) {
+        page_owned[e->pages[i]] = 0;
+    }
+    pages_free += e->page_count;
+    free(e->pages);
+    stats.used -= e->cached;
+    stats.entries--;
+    memset(e, 0, sizeof(*e));
+}
+
+// Pages in use beyond what the budget allows now
+static uint32_t cache_pages_over(void) {
+    uint32_t used = region_pages - pages_free;
+    return (used > budget_pages) ? used - budget_pages : 0;
+}
+
+static uint32_t cache_pages_available(void) {
+    uint32_t used = region_pages - pages_free;
+    return (used < budget_pages) ? budget_pages - used : 0;
+}
+
+// Least recently used entry nobody is reading, NULL if there is none
+static CacheEntry* cache_victim(const CacheEntry* keep) {
+    CacheEntry* victim = NULL;
+    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+        CacheEntry* e = &entries[i];
+        if (!e->path[0] || e->readers > 0 || e == keep) continue;
+        if (!victim || e->used < victim->used) victim = e;
+    }
+    return victim;
+}
+
+static void cache_evict_over_budget(void) {
+    CacheEntry* victim;
+    while (cache_pages_over() > 0 && (victim = cache_victim(NULL)) != NULL) {
+        cache_release(victim);
+        stats.evictions++;
+    }
+}
+
+// Give e up to wanted pages for its head, evicting older entries for them
+static void cache_grant_pages(CacheEntry* e, uint32_t wanted) {
+    CacheEntry* victim;
+    while (cache_pages_available() < wanted && (victim = cache_victim(e)) != NULL) {
+        cache_release(victim);
+        stats.evictions++;
+    }
+    uint32_t count = cache_pages_available();
+    if (count > wanted) count = wanted;
+    if (count == 0) return;
+
+    e->pages = malloc(count * sizeof(uint16_t));
+    if (!e->pages) return;
+    for (uint32_t page = 0; page < region_pages && e->page_count < count; page++) {
+        if (page_owned[page]) continue;
+        page_owned[page] = 1;
+        e->pages[e->page_count++] = (uint16_t)page;
+    }
+    pages_free -= e->page_count;
+}
+
+// --- Entries ---
+
+static CacheEntry* cache_lookup(const char* path, const struct stat* st) {
+    CacheEntry* slot = NULL;
+    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+        CacheEntry* e = &entries[i];
+        if (!e->path[0]) {
+            if (!slot) slot = e;
+            continue;
+        }
+        if (strcmp(e->path, path) != 0) continue;
+        if (e->size == (uint64_t)st->st_size && e->mtime == (uint64_t)st->st_mtime) return e;
+        // The file changed on the card: what is held is stale
+        if (e->readers > 0) return NULL;
+        cache_release(e);
+        if (!slot) slot = e;
+    }
+    if (!slot) {
+        slot = cache_victim(NULL);
+        if (!slot) return NULL;
+        cache_release(slot);
+        stats.evictions++;
+    }
+
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    slot->size = (uint64_t)st->st_size;
+    slot->mtime = (uint64_t)st->st_mtime;
+    stats.entries++;
+    return slot;
+}
+
+// --- Public API ---
+
+void cache_set_budget(uint32_t bytes) {
+    budget = bytes;
+    if (cache_region) {
+        budget_pages = bytes / CACHE_PAGE_SIZE;
+        if (budget_pages > region_pages) budget_pages = region_pages;
+        cache_evict_over_budget();
+    }
+}
+
+uint32_t cache_get_budget(void) {
+    return cache_region ? budget_pages * CACHE_PAGE_SIZE : budget;
+}
+
+CacheReader* cache_open(const char* filename) {
+    struct stat st;
+    if (!filename || cache_get_budget() < CACHE_PAGE_SIZE || cache_reserve_region() != 0 ||
+        stat(filename, &st) != 0 || st.st_size <= 0) {
+        return NULL;
+    }
+
+    CacheReader* reader = calloc(1, sizeof(CacheReader));
+    if (!reader) return NULL;
+    CacheEntry* e = cache_lookup(filename, &st);
+    if (!e) {
+        free(reader);
+        return NULL;
+    }
+
+    if (e->cached == e->size) {
+        stats.hits++;
+    } else if (e->cached > 0) {
+        stats.partial_hits++;
+    } else {
+        stats.misses++;
+        uint32_t wanted = (uint32_t)((e->size + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE);
+        if (e->page_count == 0) cache_grant_pages(e, wanted);
+    }
+
+    e->used = ++cache_clock;
+    e->readers++;
+    reader->entry = e;
+    return reader;
+}
+
+int cache_read(CacheReader* reader, uint8_t* buffer, uint32_t length) {
+    CacheEntry* e = reader->entry;
+    if (reader->position >= e->size || length == 0) return 0;
+    if (length > e->size - reader->position) length = (uint32_t)(e->size - reader->position);
+
+    // The head comes out of RAM
+    if (reader->position < e->cached) {
+        uint32_t done = 0;
+        while (done < length && reader->position < e->cached) {
+            uint32_t page = (uint32_t)(reader->position / CACHE_PAGE_SIZE);
+            uint32_t offset = (uint32_t)(reader->position % CACHE_PAGE_SIZE);
+            uint64_t left = e->cached - reader->position;
+            uint32_t n = CACHE_PAGE_SIZE - offset;
+            if (n > length - done) n = length - done;
+            if (n > left) n = (uint32_t)left;
+            memcpy(buffer + done, cache_page(e->pages[page]) + offset, n);
+            done += n;
+            reader->position += n;
+        }
+        stats.ram_bytes += done;
+        return (int)done;
+    }
+
+    // The rest off the card, where it left the cached head
+    if (!reader->file) {
+        reader->file = fileio_open_direct(e->path);
+        if (!reader->file || fileio_seek(reader->file, reader->position) != 0) {
+            return -1;
+        }
+    }
+    int res = fileio_read_direct(reader->file, buffer, length);
+    if (res <= 0) return (res < 0) ? -1 : 0;
+
+    // A read that continues the head also extends it while pages are left.
+    // Only one reader can be at that point, the first to get there.
+    uint64_t capacity = (uint64_t)e->page_count * CACHE_PAGE_SIZE;
+    if (reader->position == e->cached && e->cached < capacity) {
+        uint32_t kept = 0;
+        while (kept < (uint32_t)res && e->cached < capacity) {
+            uint32_t page = (uint32_t)(e->cached / CACHE_PAGE_SIZE);
+            uint32_t offset = (uint32_t)(e->cached % CACHE_PAGE_SIZE);
+            uint32_t n = CACHE_PAGE_SIZE - offset;
+            if (n > (uint32_t)res - kept) n = (uint32_t)res - kept;
+            memcpy(cache_page(e->pages[page]) + offset, buffer + kept, n);
+            kept += n;
+            e->cached += n;
+        }
+        stats.used += kept;
+    }
+    reader->position += res;
+    stats.card_bytes += res;
+    return res;
+}
+
+uint64_t cache_size(const CacheReader* reader) {
+    return reader ? reader->entry->size : 0;
+}
+
+void cache_close(CacheReader* reader) {
+    if (!reader) return;
+    CacheEntry* e = reader->entry;
+    if (reader->file) fclose(reader->file);
+    free(reader);
+
+    e->readers--;
+    if (e->readers > 0) return;
+
+    // Hand back the pages a short read never filled
+    uint32_t needed = (uint32_t)((e->cached + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE);
+    for (uint32_t i = needed; i < e->page_count; i++) {
+        page_owned[e->pages[i]] = 0;
+        pages_free++;
+    }
+    if (needed < e->page_count) e->page_count = needed;
+    if (e->cached == 0) {
+        cache_release(e);
+    }
+    cache_evict_over_budget();
+}
+
+void cache_clear(void) {
+    for (int i = 0; i < CACHE_MAX_ENTRIES; i++) {
+        if (entries[i].path[0] && entries[i].readers == 0) cache_release(&entries[i]);
+    }
+}
+
+const CacheStats* cache_get_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,50 @@
+// source/cache.h
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+// Image cache for reflashing the same images to phone after phone. A
+// region of MEM2 is taken once and cut into CACHE_PAGE_SIZE pages; each
+// cached image owns the pages holding its first bytes, filled as the first
+// flash reads it off the card. Entries are keyed by path, size and mtime,
+// so a changed file is never served from RAM, and the least recently used
+// entry gives its pages up when a new image needs them. An image bigger
+// than the budget keeps only its head; the rest still comes off the card.
+
+#define CACHE_PAGE_SIZE      (256 * 1024)
+#define CACHE_DEFAULT_BUDGET (24 * 1024 * 1024)
+#define CACHE_MAX_ENTRIES    8
+
+typedef struct {
+    uint32_t hits;              // Opens that found the whole image in RAM
+    uint32_t partial_hits;      // ... found its head in RAM
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t entries;
+    uint64_t used;              // Bytes of images held
+    uint64_t ram_bytes;         // Bytes served from the cache
+    uint64_t card_bytes;        // Bytes read from the card by cache readers
+} CacheStats;
+
+typedef struct CacheReader CacheReader;
+
+// Bytes of MEM2 to use, rounded down to whole pages; 0 turns the cache off
+// and drops its entries. The region is taken on first use and never given
+// back, so a later budget can shrink it but not grow past it.
+void cache_set_budget(uint32_t bytes);
+uint32_t cache_get_budget(void);
+
+// Reader for filename through the cache. NULL if the file cannot be
+// opened or the cache is off; the caller then reads the card itself.
+CacheReader* cache_open(const char* filename);
+// Returns bytes read, 0 at end of file, <0 on error
+int cache_read(CacheReader* reader, uint8_t* buffer, uint32_t length);
+uint64_t cache_size(const CacheReader* reader);
+// What the reader filled stays cached, even when it stopped half way
+void cache_close(CacheReader* reader);
+
+void cache_clear(void);
+const CacheStats* cache_get_stats(void);
+
+#endif
@@ -1,5 +1,7 @@
 #include "config.h"
 #include <string.h>
+#include <stddef.h>
+#include "tuner.h"
 
 // Matches the struct in your main.c
 typedef struct {
@@ -13,30 +15,132 @@ typedef struct {
     int auto_reboot;
     int verify_flash;
     int safe_mode;
+    int delta_flash;
+    int cache_budget_mb;        // Image cache in MEM2 (see cache.h)
 } ConfigData;
 
 #define CONFIG_PATH "sd:/heimdall.cfg"
 
+// The settings go out as a tagged block whose header says how much of
+// ConfigData follows, so settings added later just make it longer. Files
+// from before the header start with the struct itself, up to delta_flash.
+#define CONFIG_SETTINGS_MAGIC 0x43464731 // "CFG1"
+#define CONFIG_LEGACY_SIZE offsetof(ConfigData, cache_budget_mb)
+
+typedef struct {
+    unsigned int magic;
+    unsigned int size;          // Bytes of ConfigData that follow
+} ConfigHeader;
+
+// Transfer tuner profiles follow the settings; the tag tells them apart
+// from the end of an older file
+#define CONFIG_TUNER_MAGIC 0x54554E31 // "TUN1"
+
+typedef struct {
+    unsigned int magic;
+    unsigned int count;
+    TunerProfile profiles[TUNER_DEVICES];
+} ConfigTuner;
+
+static void config_write_tuner(FILE* f) {
+    ConfigTuner tuner;
+    memset(&tuner, 0, sizeof(tuner));
+    tuner.magic = CONFIG_TUNER_MAGIC;
+    tuner.count = TUNER_DEVICES;
+    tuner_export(tuner.profiles);
+    fwrite(&tuner, sizeof(tuner), 1, f);
+}
+
+// Read the saved settings into loaded, zeroed first, and set *size to the
+// bytes of it the file has. Leaves f after them. 1 for a tagged block,
+// 0 for an older file, -1 when the block is cut short.
+static int config_read_settings(FILE* f, ConfigData* loaded, size_t* size) {
+    memset(loaded, 0, sizeof(*loaded));
+
+    ConfigHeader header;
+    if (fread(&header, 1, sizeof(header), f) == sizeof(header) &&
+        header.magic == CONFIG_SETTINGS_MAGIC) {
+        // A newer build's settings are longer; what this one has is a prefix
+        size_t wanted = (header.size < sizeof(ConfigData)) ? header.size : sizeof(ConfigData);
+        *size = fread(loaded, 1, wanted, f);
+        if (*size != wanted || fseek(f, header.size - wanted, SEEK_CUR) != 0) return -1;
+        return 1;
+    }
+
+    rewind(f);
+    *size = fread(loaded, 1, CONFIG_LEGACY_SIZE, f);
+    return 0;
+}
+
 void config_load(void* app_ptr) {
     FILE *f = fopen(CONFIG_PATH, "rb");
     if (!f) return; // Use defaults if file doesn't exist
 
+    // Files saved before a setting existed are shorter; those keep its default
     ConfigData loaded;
-    if (fread(&loaded, sizeof(ConfigData), 1, f) == 1) {
+    size_t size;
+    int tagged = config_read_settings(f, &loaded, &size);
+    ConfigData* app = (ConfigData*)app_ptr;
+    if (tagged >= 0 && size >= offsetof(ConfigData, delta_flash)) {
         // We only want to restore the settings, not the current state
-        ConfigData* app = (ConfigData*)app_ptr;
         app->auto_reboot = loaded.auto_reboot;
         app->verify_flash = loaded.verify_flash;
         app->safe_mode = loaded.safe_mode;
+        if (size >= offsetof(ConfigData, delta_flash) + sizeof(int)) {
+            app->delta_flash = loaded.delta_flash;
+        }
+    }
+    if (tagged > 0 && size >= offsetof(ConfigData, cache_budget_mb) + sizeof(int) &&
+        loaded.cache_budget_mb >= 0) {
+        app->cache_budget_mb = loaded.cache_budget_mb;
+    }
+
+    // Older files carry the profiles only after settings in full
+    ConfigTuner tuner;
+    if ((tagged > 0 || (tagged == 0 && size == CONFIG_LEGACY_SIZE)) &&
+        fread(&tuner, 1, sizeof(tuner), f) == sizeof(tuner) &&
+        tuner.magic == CONFIG_TUNER_MAGIC && tuner.count == TUNER_DEVICES) {
+        tuner_import(tuner.profiles);
     }
     fclose(f);
 }
 
+static void config_write_settings(FILE* f, const ConfigData* settings, size_t size) {
+    ConfigHeader header = { CONFIG_SETTINGS_MAGIC, (unsigned int)size };
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(settings, 1, size, f);
+}
+
 void config_save(void* app_ptr) {
     FILE *f = fopen(CONFIG_PATH, "wb");
     if (!f) return;
 
-    ConfigData* app = (ConfigData*)app_ptr;
-    fwrite(app, sizeof(ConfigData), 1, f);
+    config_write_settings(f, (const ConfigData*)app_ptr, sizeof(ConfigData));
+    config_write_tuner(f);
+    fclose(f);
+}
+
+void config_save_tuner(void) {
+    if (!tuner_is_dirty()) return;
+
+    // Settings only change through "Save": after a tagged block just the
+    // profiles are rewritten. Anything else goes out again with the
+    // settings it held, none when there was no file, so they load as before.
+    ConfigData saved;
+    size_t size = 0;
+    FILE *f = fopen(CONFIG_PATH, "r+b");
+    if (f) {
+        if (config_read_settings(f, &saved, &size) > 0 && fseek(f, 0, SEEK_CUR) == 0) {
+            config_write_tuner(f);
+            fclose(f);
+            return;
+        }
+        fclose(f);
+    }
+
+    f = fopen(CONFIG_PATH, "wb");
+    if (!f) return;
+    config_write_settings(f, &saved, size);
+    config_write_tuner(f);
     fclose(f);
 }
@@ -10,5 +10,8 @@ struct AppData;
 // We use void* to avoid needing to include main.h here
 void config_load(void* app_ptr);
 void config_save(void* app_ptr);
+// Store the tuner's profiles when they changed, leaving the saved
+// settings as they are
+void config_save_tuner(void);
 
 #endif
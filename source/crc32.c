@@ -0,0 +1,103 @@
+// source/crc32.c
+#include "crc32.h"
+
+#define CRC32_POLY 0xEDB88320u // Reflected 0x04C11DB7
+
+// crc32_table[k][b] is the CRC of byte b followed by k zero bytes, which
+// lets eight input bytes be folded in with eight independent lookups
+static uint32_t crc32_table[8][256];
+static uint32_t crc32_x2n[32];      // x^(2^n) mod p, for crc32_combine
+static int crc32_ready = 0;
+
+// a * b mod p over GF(2), bit-reflected like the CRC itself
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    while (1) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+    return p;
+}
+
+void crc32_init(void) {
+    if (crc32_ready) return;
+
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+        }
+        crc32_table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = crc32_table[0][b];
+        for (int k = 1; k < 8; k++) {
+            crc = (crc >> 8) ^ crc32_table[0][crc & 0xFF];
+            crc32_table[k][b] = crc;
+        }
+    }
+
+    uint32_t p = 1u << 30; // x^1
+    crc32_x2n[0] = p;
+    for (int n = 1; n < 32; n++) {
+        crc32_x2n[n] = p = crc32_multmodp(p, p);
+    }
+
+    crc32_ready = 1;
+}
+
+// Little-endian load regardless of host order; Broadway is big-endian
+static inline uint32_t crc32_load_le(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint32_t length) {
+    if (!crc32_ready) crc32_init();
+
+    crc = ~crc;
+
+    // Byte at a time up to a word boundary so the main loop reads aligned
+    while (length > 0 && ((uintptr_t)data & 3) != 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
+        length--;
+    }
+
+    while (length >= 8) {
+        uint32_t one = crc32_load_le(data) ^ crc;
+        uint32_t two = crc32_load_le(data + 4);
+        crc = crc32_table[7][one & 0xFF] ^
+              crc32_table[6][(one >> 8) & 0xFF] ^
+              crc32_table[5][(one >> 16) & 0xFF] ^
+              crc32_table[4][one >> 24] ^
+              crc32_table[3][two & 0xFF] ^
+              crc32_table[2][(two >> 8) & 0xFF] ^
+              crc32_table[1][(two >> 16) & 0xFF] ^
+              crc32_table[0][two >> 24];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data++) & 0xFF];
+        length--;
+    }
+
+    return ~crc;
+}
+
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b) {
+    if (!crc32_ready) crc32_init();
+
+    // Shifting crc_a past length_b zero bytes is a multiply by x^(8 * length_b)
+    uint32_t shift = 1u << 31; // x^0
+    for (uint32_t k = 3; length_b; length_b >>= 1, k++) {
+        if (length_b & 1) shift = crc32_multmodp(crc32_x2n[k & 31], shift);
+    }
+    return crc32_multmodp(shift, crc_a) ^ crc_b;
+}
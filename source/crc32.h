@@ -0,0 +1,22 @@
+// source/crc32.h
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, the zlib/PNG polynomial), slice-by-8.
+// Pass 0 to start and feed the previous result back in to continue, so a
+// stream can be checksummed chunk by chunk as it goes past:
+//     crc = crc32_update(0, a, len_a);
+//     crc = crc32_update(crc, b, len_b);
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, uint32_t length);
+
+// CRC of A followed by B from crc(A), crc(B) and B's length, in a few
+// dozen word operations: lets independently hashed blocks add up to the
+// CRC of the whole stream without hashing it twice
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint64_t length_b);
+
+// Build the tables up front; crc32_update does it on first use otherwise
+void crc32_init(void);
+
+#endif
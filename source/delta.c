@@ -0,0 +1,137 @@
+// source/delta.c
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "delta.h"
+#include "digest.h"
+#include "fileio.h"
+#include "crc32.h"
+
+static char delta_directory[128] = DELTA_DIRECTORY;
+
+void delta_set_directory(const char* directory) {
+    snprintf(delta_directory, sizeof(delta_directory), "%s",
+             directory ? directory : DELTA_DIRECTORY);
+}
+
+// PIT device names are free text; keep them to what FAT takes
+static void delta_device_directory(const char* device, char* path, uint32_t size) {
+    char name[64];
+    uint32_t i = 0;
+    for (; device && device[i] && i < sizeof(name) - 1; i++) {
+        char c = device[i];
+        name[i] = (isalnum((unsigned char)c) || c == '-' || c == '_') ? c : '_';
+    }
+    name[i] = '\0';
+    snprintf(path, size, "%s/%s", delta_directory, i ? name : "unknown");
+}
+
+static void delta_manifest_path(const char* device, const char* partition,
+                                char* path, uint32_t size) {
+    char directory[192];
+    delta_device_directory(device, directory, sizeof(directory));
+    // One file per partition whatever case the caller spells it in
+    char name[32];
+    uint32_t i = 0;
+    for (; partition[i] && i < sizeof(name) - 1; i++) {
+        name[i] = (char)toupper((unsigned char)partition[i]);
+    }
+    name[i] = '\0';
+    snprintf(path, size, "%s/%s.manifest", directory, name);
+}
+
+// --- Public API ---
+
+int delta_save_manifest(const char* device, const char* partition) {
+    if (!partition) return -1;
+
+    const ImageDigest* digest = digest_find(partition);
+    if (!digest || digest->lost || digest->block_count == 0) return -1;
+
+    char directory[192], path[256];
+    delta_device_directory(device, directory, sizeof(directory));
+    delta_manifest_path(device, partition, path, sizeof(path));
+    fileio_create_directory(directory);
+
+    FILE* f = fopen(path, "w");
+    if (!f) return -3;
+
+    fprintf(f, "partition %s\nlength %llu\nblock_size %u\n", digest->partition,
+            (unsigned long long)digest->length, DIGEST_BLOCK_SIZE);
+    for (uint32_t i = 0; i < digest->block_count; i++) {
+        fprintf(f, "block %u %08x\n", i, digest->blocks[i]);
+    }
+    fprintf(f, "crc32 %08x\n", digest_checksum(digest));
+
+    return (fclose(f) == 0) ? 0 : -3;
+}
+
+int delta_load_manifest(const char* device, const char* partition,
+                        DeltaManifest* manifest) {
+    if (!partition || !manifest) return -1;
+    memset(manifest, 0, sizeof(*manifest));
+
+    char path[256];
+    delta_manifest_path(device, partition, path, sizeof(path));
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[128];
+    unsigned long long length = 0;
+    unsigned int block_size = 0, checksum = 0;
+    uint32_t capacity = 0, crc = 0;
+    int complete = 0, ok = 1;
+
+    while (ok && !complete && fgets(line, sizeof(line), f)) {
+        unsigned int index, block_crc;
+        if (sscanf(line, "partition %31s", manifest->partition) == 1) continue;
+        if (sscanf(line, "length %llu", &length) == 1) {
+            uint64_t blocks = (length + DIGEST_BLOCK_SIZE - 1) / DIGEST_BLOCK_SIZE;
+            capacity = (blocks < 0x10000000ull) ? (uint32_t)blocks : 0;
+            manifest->blocks = capacity ? malloc(capacity * sizeof(uint32_t)) : NULL;
+            ok = (manifest->blocks != NULL);
+            continue;
+        }
+        if (sscanf(line, "block_size %u", &block_size) == 1) continue;
+        if (sscanf(line, "crc32 %x", &checksum) == 1) {
+            complete = 1;
+            continue;
+        }
+        if (sscanf(line, "block %u %x", &index, &block_crc) == 2) {
+            ok = (index == manifest->block_count && index < capacity);
+            if (!ok) break;
+            uint64_t start = (uint64_t)index * DIGEST_BLOCK_SIZE;
+            uint64_t size = length - start;
+            if (size > DIGEST_BLOCK_SIZE) size = DIGEST_BLOCK_SIZE;
+            crc = crc32_combine(crc, block_crc, size);
+            manifest->blocks[manifest->block_count++] = block_crc;
+        }
+    }
+    fclose(f);
+
+    // Written in one go, so anything short of the whole thing is damage
+    if (!ok || !complete || block_size != DIGEST_BLOCK_SIZE ||
+        manifest->block_count != capacity || crc != checksum ||
+        strcasecmp(manifest->partition, partition) != 0) {
+        delta_free_manifest(manifest);
+        return -1;
+    }
+    manifest->length = length;
+    manifest->checksum = checksum;
+    return 0;
+}
+
+void delta_free_manifest(DeltaManifest* manifest) {
+    if (!manifest) return;
+    free(manifest->blocks);
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+void delta_forget(const char* device, const char* partition) {
+    if (!partition) return;
+    char path[256];
+    delta_manifest_path(device, partition, path, sizeof(path));
+    remove(path);
+}
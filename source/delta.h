@@ -0,0 +1,36 @@
+// source/delta.h
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+
+// Block manifests of what each device holds, for delta flashing. Every
+// image flashed through heimdall.c leaves its digest blocks on the card
+// under the PIT device name; the next flash of that partition compares
+// the new image block by block against them and only sends the blocks
+// that changed. A flash that fails drops the manifest, since the device
+// then holds neither image.
+
+#define DELTA_DIRECTORY "sd:/heimdall/delta"
+
+typedef struct {
+    char partition[32];
+    uint64_t length;            // Image length
+    uint32_t block_count;
+    uint32_t* blocks;           // CRC32 per DIGEST_BLOCK_SIZE block
+    uint32_t checksum;          // CRC32 of the whole image
+} DeltaManifest;
+
+// NULL selects DELTA_DIRECTORY
+void delta_set_directory(const char* directory);
+
+// Store the digest of the last flash of partition as device's base.
+// Returns 0, -1 no complete digest for it, -3 SD write failure.
+int delta_save_manifest(const char* device, const char* partition);
+// 0 with manifest filled (free with delta_free_manifest), -1 none or damaged
+int delta_load_manifest(const char* device, const char* partition,
+                        DeltaManifest* manifest);
+void delta_free_manifest(DeltaManifest* manifest);
+void delta_forget(const char* device, const char* partition);
+
+#endif
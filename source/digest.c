@@ -0,0 +1,133 @@
+// source/digest.c
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include "digest.h"
+#include "crc32.h"
+
+static ImageDigest records[DIGEST_MAX_RECORDS];
+static uint32_t record_age[DIGEST_MAX_RECORDS];
+static uint32_t record_clock = 0;
+
+static void digest_reset(ImageDigest* d) {
+    free(d->blocks);
+    memset(d, 0, sizeof(ImageDigest));
+}
+
+ImageDigest* digest_begin(const char* partition, uint64_t length) {
+    if (!partition) return NULL;
+
+    // Same partition first, then a free slot, then the oldest record
+    int slot = -1;
+    for (int i = 0; i < DIGEST_MAX_RECORDS && slot < 0; i++) {
+        if (records[i].partition[0] && strcasecmp(records[i].partition, partition) == 0) slot = i;
+    }
+    for (int i = 0; i < DIGEST_MAX_RECORDS && slot < 0; i++) {
+        if (!records[i].partition[0]) slot = i;
+    }
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 1; i < DIGEST_MAX_RECORDS; i++) {
+            if (record_age[i] < record_age[slot]) slot = i;
+        }
+    }
+
+    ImageDigest* d = &records[slot];
+    digest_reset(d);
+    record_age[slot] = ++record_clock;
+
+    // Without the block list the running CRC still works; the record just
+    // can't be used for verification
+    uint64_t blocks = (length + DIGEST_BLOCK_SIZE - 1) / DIGEST_BLOCK_SIZE;
+    d->capacity = (blocks > 0 && blocks < 0x10000000ull) ? (uint32_t)blocks : 16;
+    d->blocks = malloc(d->capacity * sizeof(uint32_t));
+    d->lost = (d->blocks == NULL);
+    strncpy(d->partition, partition, sizeof(d->partition) - 1);
+    return d;
+}
+
+static void digest_push(ImageDigest* d) {
+    if (!d->lost && d->block_count == d->capacity) {
+        uint32_t* grown = realloc(d->blocks, d->capacity * 2 * sizeof(uint32_t));
+        if (grown) {
+            d->blocks = grown;
+            d->capacity *= 2;
+        } else {
+            d->lost = 1;
+        }
+    }
+    if (!d->lost) d->blocks[d->block_count++] = d->block_crc;
+    d->crc = crc32_combine(d->crc, d->block_crc, d->block_fill);
+    d->block_crc = 0;
+    d->block_fill = 0;
+}
+
+void digest_update(ImageDigest* d, const uint8_t* data, uint32_t length) {
+    if (!d) return;
+
+    d->length += length;
+    while (length > 0) {
+        uint32_t take = DIGEST_BLOCK_SIZE - d->block_fill;
+        if (take > length) take = length;
+        d->block_crc = crc32_update(d->block_crc, data, take);
+        d->block_fill += take;
+        data += take;
+        length -= take;
+
+        if (d->block_fill == DIGEST_BLOCK_SIZE) digest_push(d);
+    }
+}
+
+void digest_append_block(ImageDigest* d, uint32_t crc) {
+    if (!d || d->block_fill != 0) return;
+
+    d->length += DIGEST_BLOCK_SIZE;
+    d->block_crc = crc;
+    d->block_fill = DIGEST_BLOCK_SIZE;
+    digest_push(d);
+}
+
+uint32_t digest_checksum(const ImageDigest* d) {
+    if (!d) return 0;
+    if (d->block_fill == 0) return d->crc;
+    return crc32_combine(d->crc, d->block_crc, d->block_fill);
+}
+
+void digest_finish(ImageDigest* d) {
+    if (!d) return;
+    if (d->block_fill > 0) digest_push(d);
+    d->complete = !d->lost;
+}
+
+void digest_discard(ImageDigest* d) {
+    if (d) digest_reset(d);
+}
+
+const ImageDigest* digest_find(const char* partition) {
+    if (!partition) return NULL;
+    for (int i = 0; i < DIGEST_MAX_RECORDS; i++) {
+        if (records[i].complete && strcasecmp(records[i].partition, partition) == 0) {
+            return &records[i];
+        }
+    }
+    return NULL;
+}
+
+const ImageDigest* digest_get(uint32_t index) {
+    if (index >= DIGEST_MAX_RECORDS || !records[index].complete) return NULL;
+    return &records[index];
+}
+
+uint32_t digest_block_length(const ImageDigest* d, uint32_t index) {
+    if (!d || index >= d->block_count) return 0;
+    uint64_t start = (uint64_t)index * DIGEST_BLOCK_SIZE;
+    uint64_t left = d->length - start;
+    return (left < DIGEST_BLOCK_SIZE) ? (uint32_t)left : DIGEST_BLOCK_SIZE;
+}
+
+void digest_clear(void) {
+    for (int i = 0; i < DIGEST_MAX_RECORDS; i++) {
+        digest_reset(&records[i]);
+    }
+}
@@ -0,0 +1,53 @@
+// source/digest.h
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdint.h>
+
+// Per-block CRC32s of images as they are flashed. Every flash path hashes
+// each byte on its way to USB anyway; keeping one CRC per block rather
+// than a single running value lets flash_verify check a readback without
+// touching the source again and say where the first difference is.
+
+#define DIGEST_BLOCK_SIZE  (256 * 1024)
+#define DIGEST_MAX_RECORDS 16          // Partitions remembered at once
+
+typedef struct {
+    char partition[32];
+    uint64_t length;            // Bytes hashed
+    uint32_t block_count;       // Completed blocks in blocks[]
+    uint32_t* blocks;           // CRC32 of each DIGEST_BLOCK_SIZE block
+    int complete;               // The flash finished; only then is it used
+    int lost;                   // Out of memory for blocks[]; checksum still valid
+
+    // Running state
+    uint32_t crc;               // CRC32 of the completed blocks
+    uint32_t block_crc;         // CRC32 of the block being filled
+    uint32_t block_fill;
+    uint32_t capacity;
+} ImageDigest;
+
+// Start recording partition's image, replacing any earlier record of it.
+// length is a sizing hint.
+ImageDigest* digest_begin(const char* partition, uint64_t length);
+// Hash the next bytes of the image, in order
+void digest_update(ImageDigest* digest, const uint8_t* data, uint32_t length);
+// Record a whole block by its CRC32 without the data (blocks a resumed
+// flash does not send again); only between whole blocks
+void digest_append_block(ImageDigest* digest, uint32_t crc);
+// CRC32 of everything hashed so far
+uint32_t digest_checksum(const ImageDigest* digest);
+// Close the last block and keep the record for verification
+void digest_finish(ImageDigest* digest);
+// Drop a record (the flash failed)
+void digest_discard(ImageDigest* digest);
+
+// Complete record for partition, or NULL
+const ImageDigest* digest_find(const char* partition);
+// Walk the records: index < DIGEST_MAX_RECORDS, NULL for unused slots
+const ImageDigest* digest_get(uint32_t index);
+// Bytes covered by block index; the last block may be short
+uint32_t digest_block_length(const ImageDigest* digest, uint32_t index);
+void digest_clear(void);
+
+#endif
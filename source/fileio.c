@@ -1,9 +1,12 @@
 // source/fileio.c
+#include <gccore.h>
 #include "fileio.h"
+#include "mem.h"
 #include <fat.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <sys/stat.h>
 #include <sys/dir.h>
 #include <unistd.h>
@@ -40,8 +43,8 @@ uint8_t* fileio_read_file(const char* filename, uint32_t* length) {
         return NULL;
     }
     
-    // Allocate buffer
-    uint8_t* buffer = malloc(file_size);
+    // Aligned so the data can be handed to USB without a bounce copy
+    uint8_t* buffer = mem_alloc(file_size);
     if (!buffer) {
         fclose(fp);
         return NULL;
@@ -52,7 +55,7 @@ uint8_t* fileio_read_file(const char* filename, uint32_t* length) {
     fclose(fp);
     
     if (bytes_read != file_size) {
-        free(buffer);
+        mem_free(buffer);
         return NULL;
     }
     
@@ -60,6 +63,58 @@ uint8_t* fileio_read_file(const char* filename, uint32_t* length) {
     return buffer;
 }
 
+void fileio_free_file(uint8_t* data) {
+    mem_free(data);
+}
+
+// Open a file for direct reads
+FILE* fileio_open_direct(const char* filename) {
+    if (!filename) {
+        return NULL;
+    }
+    
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    
+    // No stdio buffer: fread goes straight to libfat with the caller's memory
+    setvbuf(fp, NULL, _IONBF, 0);
+    return fp;
+}
+
+// Read up to length bytes into buffer
+int fileio_read_direct(FILE* fp, uint8_t* buffer, uint32_t length) {
+    if (!fp || !buffer) {
+        return -1;
+    }
+    
+    size_t bytes_read = fread(buffer, 1, length, fp);
+    if (bytes_read == 0 && ferror(fp)) {
+        return -1;
+    }
+    
+    return (int)bytes_read;
+}
+
+int fileio_seek(FILE* fp, uint64_t offset) {
+    off_t position = (off_t)offset;
+    // An offset off_t cannot hold would wrap, not fail
+    if (!fp || position < 0 || (uint64_t)position != offset) {
+        return -1;
+    }
+    return (fseeko(fp, position, SEEK_SET) == 0) ? 0 : -1;
+}
+
+int fileio_length(FILE* fp, uint64_t* length) {
+    struct stat st;
+    if (!fp || !length || fstat(fileno(fp), &st) != 0 || st.st_size < 0) {
+        return -1;
+    }
+    *length = (uint64_t)st.st_size;
+    return 0;
+}
+
 // Write data to file
 int fileio_write_file(const char* filename, const uint8_t* data, uint32_t length) {
     if (!filename || !data || length == 0) {
@@ -179,13 +234,32 @@ void fileio_free_list(char** files, int count) {
     free(files);
 }
 
-// Create directory
+// Create directory, and any missing parents; 0 if it already exists
 int fileio_create_directory(const char* directory) {
-    if (!directory) {
+    if (!directory || !directory[0] || strlen(directory) >= 256) {
         return -1;
     }
     
-    return mkdir(directory, 0777);
+    char path[256];
+    strcpy(path, directory);
+    
+    // Skip the device ("sd:/") or the root: they always exist
+    char* p = strchr(path, ':');
+    p = p ? p + 1 : path;
+    while (*p == '/') p++;
+    
+    for (; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(path, 0777);
+        *p = '/';
+    }
+    
+    if (mkdir(path, 0777) != 0) {
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    }
+    return 0;
 }
 
 // Delete file
@@ -203,17 +277,33 @@ int fileio_copy_file(const char* src, const char* dst) {
         return -1;
     }
     
-    // Read source
-    uint32_t src_size;
-    uint8_t* src_data = fileio_read_file(src, &src_size);
-    if (!src_data) {
+    // Stream through the reader so memory use does not grow with file size
+    FileReader* reader = fileio_reader_open(src, 0);
+    if (!reader) {
         return -1;
     }
     
-    // Write destination
-    int result = fileio_write_file(dst, src_data, src_size);
+    FILE* fp = fopen(dst, "wb");
+    if (!fp) {
+        fileio_reader_close(reader);
+        return -1;
+    }
     
-    free(src_data);
+    int result = 0;
+    const uint8_t* chunk;
+    int length;
+    while ((length = fileio_reader_read_chunk(reader, &chunk, FILEIO_READER_WINDOW)) > 0) {
+        if (fwrite(chunk, 1, length, fp) != (size_t)length) {
+            result = -1;
+            break;
+        }
+    }
+    if (length < 0) {
+        result = -1;
+    }
+    
+    fclose(fp);
+    fileio_reader_close(reader);
     return result;
 }
 
@@ -252,3 +342,307 @@ int fileio_is_sd_present(void) {
     
     return 0;
 }
+
+// Streaming reader state
+struct FileReader {
+    FILE* fp;
+    uint64_t size;
+    uint64_t position;          // Caller's logical offset
+    uint64_t file_pos;          // Where the FILE* currently points
+    uint32_t window_size;
+
+    uint8_t* window[2];
+    uint64_t window_offset[2];
+    uint32_t window_fill[2];
+    int window_valid[2];
+    int current;                // Window the caller consumes
+    uint32_t consumed;          // Bytes of the current window used
+
+    // Read-ahead thread, guarded by lock
+    lwp_t thread;
+    mutex_t lock;
+    cond_t cond;
+    int request;                // Prefetch queued or running
+    int request_index;
+    uint64_t request_offset;
+    int request_result;
+    int stop;
+};
+
+#define READER_STACK_SIZE (16 * 1024)
+#define READER_PRIORITY   70
+
+// Fill one window from the file. Only ever runs on one thread at a time.
+static int fileio_fill_window(FileReader* r, int index, uint64_t offset) {
+    r->window_valid[index] = 0;
+    r->window_offset[index] = offset;
+    r->window_fill[index] = 0;
+
+    if (offset >= r->size) {
+        r->window_valid[index] = 1;
+        return 0;
+    }
+
+    if (r->file_pos != offset) {
+        if (fileio_seek(r->fp, offset) != 0) {
+            return -1;
+        }
+        r->file_pos = offset;
+    }
+
+    uint32_t wanted = r->window_size;
+    if (r->size - offset < wanted) {
+        wanted = (uint32_t)(r->size - offset);
+    }
+
+    size_t bytes_read = fread(r->window[index], 1, wanted, r->fp);
+    r->file_pos += bytes_read;
+    if (bytes_read != wanted) {
+        return -1;
+    }
+
+    r->window_fill[index] = wanted;
+    r->window_valid[index] = 1;
+    return 0;
+}
+
+// Read-ahead thread
+static void* fileio_reader_thread(void* arg) {
+    FileReader* r = (FileReader*)arg;
+
+    LWP_MutexLock(r->lock);
+    while (!r->stop) {
+        if (!r->request) {
+            LWP_CondWait(r->cond, r->lock);
+            continue;
+        }
+
+        int index = r->request_index;
+        uint64_t offset = r->request_offset;
+        LWP_MutexUnlock(r->lock);
+
+        int result = fileio_fill_window(r, index, offset);
+
+        LWP_MutexLock(r->lock);
+        r->request_result = result;
+        r->request = 0;
+        LWP_CondBroadcast(r->cond);
+    }
+    LWP_MutexUnlock(r->lock);
+
+    return NULL;
+}
+
+// Wait until the read-ahead thread is idle
+static int fileio_reader_wait(FileReader* r) {
+    LWP_MutexLock(r->lock);
+    while (r->request) {
+        LWP_CondWait(r->cond, r->lock);
+    }
+    int result = r->request_result;
+    r->request_result = 0;
+    LWP_MutexUnlock(r->lock);
+    return result;
+}
+
+// Queue the window after the current one on the read-ahead thread
+static void fileio_reader_prefetch(FileReader* r) {
+    int next = !r->current;
+    uint64_t offset = r->window_offset[r->current] + r->window_fill[r->current];
+
+    if (offset >= r->size) return;
+    if (r->window_valid[next] && r->window_offset[next] == offset) return;
+
+    LWP_MutexLock(r->lock);
+    r->request = 1;
+    r->request_index = next;
+    r->request_offset = offset;
+    LWP_CondSignal(r->cond);
+    LWP_MutexUnlock(r->lock);
+}
+
+// Switch to the window that follows the current one
+static int fileio_reader_advance(FileReader* r) {
+    if (fileio_reader_wait(r) != 0) {
+        return -1;
+    }
+
+    int next = !r->current;
+    uint64_t offset = r->window_offset[r->current] + r->window_fill[r->current];
+
+    // Read-ahead missed (first read or after a seek): fill synchronously
+    if (!r->window_valid[next] || r->window_offset[next] != offset) {
+        if (fileio_fill_window(r, next, offset) != 0) {
+            return -1;
+        }
+    }
+
+    r->current = next;
+    r->consumed = 0;
+    fileio_reader_prefetch(r);
+    return 0;
+}
+
+// Open a streaming reader
+FileReader* fileio_reader_open(const char* filename, uint32_t window_size) {
+    if (!filename) {
+        return NULL;
+    }
+    
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return NULL;
+    }
+    
+    FileReader* r = calloc(1, sizeof(FileReader));
+    if (!r) {
+        return NULL;
+    }
+    
+    r->size = (uint64_t)st.st_size;
+    r->window_size = window_size ? ((window_size + 31) & ~31u) : FILEIO_READER_WINDOW;
+    r->thread = LWP_THREAD_NULL;
+    
+    r->fp = fileio_open_direct(filename);
+    r->window[0] = mem_alloc(r->window_size);
+    r->window[1] = mem_alloc(r->window_size);
+    if (!r->fp || !r->window[0] || !r->window[1]) {
+        fileio_reader_close(r);
+        return NULL;
+    }
+    
+    LWP_MutexInit(&r->lock, false);
+    LWP_CondInit(&r->cond);
+    if (LWP_CreateThread(&r->thread, fileio_reader_thread, r, NULL,
+                         READER_STACK_SIZE, READER_PRIORITY) < 0) {
+        r->thread = LWP_THREAD_NULL;
+        fileio_reader_close(r);
+        return NULL;
+    }
+    
+    // Current window starts empty at offset 0; the first window is read in
+    // the background right away, so a reader opened ahead of time has its
+    // data waiting by the first read
+    r->window_valid[0] = 1;
+    fileio_reader_prefetch(r);
+    return r;
+}
+
+// Borrow the next chunk of the file
+int fileio_reader_read_chunk(FileReader* reader, const uint8_t** chunk, uint32_t max) {
+    if (!reader || !chunk || max == 0) {
+        return -1;
+    }
+    
+    if (reader->position >= reader->size) {
+        return 0;
+    }
+    
+    if (reader->consumed >= reader->window_fill[reader->current]) {
+        if (fileio_reader_advance(reader) != 0) {
+            return -1;
+        }
+        if (reader->window_fill[reader->current] == 0) {
+            return 0;
+        }
+    }
+    
+    uint32_t available = reader->window_fill[reader->current] - reader->consumed;
+    uint32_t length = (available < max) ? available : max;
+    
+    *chunk = reader->window[reader->current] + reader->consumed;
+    reader->consumed += length;
+    reader->position += length;
+    
+    return (int)length;
+}
+
+// Copy the next bytes of the file
+int fileio_reader_read(FileReader* reader, uint8_t* buffer, uint32_t length) {
+    if (!reader || !buffer) {
+        return -1;
+    }
+    
+    uint32_t copied = 0;
+    while (copied < length) {
+        const uint8_t* chunk;
+        int res = fileio_reader_read_chunk(reader, &chunk, length - copied);
+        if (res < 0) {
+            return res;
+        }
+        if (res == 0) {
+            break;
+        }
+        memcpy(buffer + copied, chunk, res);
+        copied += res;
+    }
+    
+    return (int)copied;
+}
+
+// Move the read position
+int fileio_reader_seek(FileReader* reader, uint64_t offset) {
+    if (!reader || offset > reader->size) {
+        return -1;
+    }
+    
+    // The thread may be filling the other window
+    if (fileio_reader_wait(reader) != 0) {
+        reader->window_valid[!reader->current] = 0;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        int index = (reader->current + i) % 2;
+        if (reader->window_valid[index] &&
+            offset >= reader->window_offset[index] &&
+            offset < reader->window_offset[index] + reader->window_fill[index]) {
+            reader->current = index;
+            reader->consumed = (uint32_t)(offset - reader->window_offset[index]);
+            reader->position = offset;
+            fileio_reader_prefetch(reader);
+            return 0;
+        }
+    }
+    
+    // Outside both windows: start an empty window at the new offset
+    reader->window_valid[!reader->current] = 0;
+    reader->window_offset[reader->current] = offset;
+    reader->window_fill[reader->current] = 0;
+    reader->consumed = 0;
+    reader->position = offset;
+    
+    return 0;
+}
+
+// Current read position
+uint64_t fileio_reader_tell(FileReader* reader) {
+    return reader ? reader->position : 0;
+}
+
+// Total file size
+uint64_t fileio_reader_size(FileReader* reader) {
+    return reader ? reader->size : 0;
+}
+
+// Close a streaming reader
+void fileio_reader_close(FileReader* reader) {
+    if (!reader) return;
+    
+    if (reader->thread != LWP_THREAD_NULL) {
+        LWP_MutexLock(reader->lock);
+        reader->stop = 1;
+        LWP_CondBroadcast(reader->cond);
+        LWP_MutexUnlock(reader->lock);
+        LWP_JoinThread(reader->thread, NULL);
+        
+        LWP_CondDestroy(reader->cond);
+        LWP_MutexDestroy(reader->lock);
+    }
+    
+    if (reader->fp) {
+        fclose(reader->fp);
+    }
+    mem_free(reader->window[0]);
+    mem_free(reader->window[1]);
+    free(reader);
+}
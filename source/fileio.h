@@ -3,11 +3,14 @@
 #define FILEIO_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 // File I/O functions
 int fileio_init(void);
 void fileio_cleanup(void);
+// The data comes from mem.c; give it back with fileio_free_file
 uint8_t* fileio_read_file(const char* filename, uint32_t* length);
+void fileio_free_file(uint8_t* data);
 int fileio_write_file(const char* filename, const uint8_t* data, uint32_t length);
 int fileio_file_exists(const char* filename);
 uint32_t fileio_get_file_size(const char* filename);
@@ -17,6 +20,35 @@ int fileio_create_directory(const char* directory);
 int fileio_delete_file(const char* filename);
 int fileio_copy_file(const char* src, const char* dst);
 
+// Unbuffered reads straight into caller memory. With a 32-byte aligned
+// buffer (see usb_lend_buffer) libfat DMAs sectors in place, so the data
+// can go to USB without passing through any intermediate copy.
+FILE* fileio_open_direct(const char* filename);
+int fileio_read_direct(FILE* fp, uint8_t* buffer, uint32_t length);
+// 64-bit offsets: long is 32 bits on the Wii, so fseek/ftell stop at 2 GB
+int fileio_seek(FILE* fp, uint64_t offset);
+int fileio_length(FILE* fp, uint64_t* length);
+
+// Streaming reader with double-buffered read-ahead: a background thread
+// fills the next window while the caller consumes the current one, so
+// memory stays at two windows however large the file is.
+typedef struct FileReader FileReader;
+
+#define FILEIO_READER_WINDOW (256 * 1024)
+
+// window_size 0 selects FILEIO_READER_WINDOW
+FileReader* fileio_reader_open(const char* filename, uint32_t window_size);
+// Zero-copy: points *chunk at up to max bytes of the 32-byte aligned window.
+// The data stays valid until the next call on the reader.
+// Returns bytes available, 0 at end of file, <0 on error.
+int fileio_reader_read_chunk(FileReader* reader, const uint8_t** chunk, uint32_t max);
+// Copying read; returns bytes read, 0 at end of file, <0 on error
+int fileio_reader_read(FileReader* reader, uint8_t* buffer, uint32_t length);
+int fileio_reader_seek(FileReader* reader, uint64_t offset);
+uint64_t fileio_reader_tell(FileReader* reader);
+uint64_t fileio_reader_size(FileReader* reader);
+void fileio_reader_close(FileReader* reader);
+
 // SD card specific
 int fileio_get_sd_free_space(uint64_t* free_bytes);
 int fileio_get_sd_total_space(uint64_t* total_bytes);
@@ -1,10 +1,22 @@
 // source/flash.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
 #include "flash.h"
 #include "usb.h"
 #include "fileio.h"
+#include "crc32.h"
+#include "digest.h"
+#include "image.h"
+#include "telemetry.h"
+#include "perf.h"
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+
+// Bytes per file part; also the read window when streaming from SD
+#define FLASH_PART_SIZE 0x40000 // 256KB
 
 // Flash state
 static int flash_busy = 0;
@@ -12,9 +24,46 @@ static float flash_progress = 0.0f;
 static char flash_status[128] = "";
 static FlashProgressCallback progress_cb = NULL;
 
+// Cancel token. Raised from any thread, read by the transfer loops between
+// chunks; only the thread doing the transfer touches USB.
+static volatile int flash_cancel = 0;
+
+// Windowed ACK state. The window opens only once the device has echoed a
+// sequence number, and collapses to 1 for good if it rejects pipelining.
+static uint32_t flash_window = FLASH_DEFAULT_WINDOW;
+static int pipelining_rejected = 0;
+static FlashReport flash_report;
+static FlashVerifyReport verify_report;
+
+static uint32_t checkpoint_interval = FLASH_DEFAULT_CHECKPOINT_INTERVAL;
+static char checkpoint_directory[128] = FLASH_CHECKPOINT_DIRECTORY;
+
+// Checkpoint of one file in flight. Part i's CRC32 is digest block i, as
+// parts and digest blocks are both 256KB.
+typedef struct {
+    char path[192];             // The checkpoint on the card
+    char filename[256];         // File being flashed, and its identity
+    uint64_t file_size;
+    uint64_t mtime;
+    FILE* log;
+
+    uint32_t first;             // Parts an earlier run got ACKed
+    uint32_t* part_crcs;        // ... and their CRC32s
+    uint32_t logged;            // Parts recorded in the log
+    uint32_t logged_crc;        // CRC32 of those parts
+    uint32_t flushed;           // Parts recorded when the log was last flushed
+} FlashCheckpoint;
+
+// Part states while a file is in flight
+#define PART_PENDING   0
+#define PART_IN_FLIGHT 1
+#define PART_ACKED     2
+#define PART_FAILED    3
+
 // Initialize flash subsystem
 int flash_init(void) {
     flash_busy = 0;
+    flash_cancel = 0;
     flash_progress = 0.0f;
     flash_status[0] = '\0';
     return 0;
@@ -27,6 +76,44 @@ void flash_cleanup(void) {
     }
 }
 
+typedef struct {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t offset;
+} FlashMemorySource;
+
+static int flash_memory_chunk(void* ctx, const uint8_t** chunk, uint32_t max) {
+    FlashMemorySource* src = (FlashMemorySource*)ctx;
+    uint32_t remaining = src->length - src->offset;
+    uint32_t length = (remaining < max) ? remaining : max;
+
+    *chunk = src->data + src->offset;
+    src->offset += length;
+    return (int)length;
+}
+
+static int flash_memory_seek(void* ctx, uint32_t offset) {
+    FlashMemorySource* src = (FlashMemorySource*)ctx;
+    if (offset > src->length) return -1;
+    src->offset = offset;
+    return 0;
+}
+
+static int flash_reader_chunk(void* ctx, const uint8_t** chunk, uint32_t max) {
+    return fileio_reader_read_chunk((FileReader*)ctx, chunk, max);
+}
+
+static int flash_reader_seek(void* ctx, uint32_t offset) {
+    return fileio_reader_seek((FileReader*)ctx, offset);
+}
+
+// FlashSource over a streaming file reader
+void flash_reader_source(FileReader* reader, FlashSource* source) {
+    source->next = flash_reader_chunk;
+    source->seek = flash_reader_seek;
+    source->ctx = reader;
+}
+
 // Flash file to partition
 int flash_file(const char* filename, const char* partition, 
                FlashProgressCallback callback) {
@@ -49,19 +136,34 @@ int flash_file(const char* filename, const char* partition,
         progress_cb(0.0f, "Opening file");
     }
     
-    // Read file
-    uint32_t file_size;
-    uint8_t* file_data = fileio_read_file(filename, &file_size);
-    if (!file_data) {
+    // Stream the file: only the reader's two windows are ever resident
+    FileReader* reader = fileio_reader_open(filename, FLASH_PART_SIZE);
+    if (!reader) {
+        flash_busy = 0;
+        return -1;
+    }
+    
+    FlashSource source;
+    flash_reader_source(reader, &source);
+    uint64_t file_size = fileio_reader_size(reader);
+    
+    // Compressed and sparse images are decoded on the way to USB
+    ImageStream image;
+    if (image_open(&image, &source, file_size, filename) != 0 ||
+        image.size == 0 || image.size > 0xFFFFFFFFull) {
+        image_close(&image);
+        fileio_reader_close(reader);
         flash_busy = 0;
         return -1;
     }
     
-    // Flash the data
-    int result = flash_data(file_data, file_size, partition, callback);
+    // Flash the data; a run cut short earlier continues where it stopped
+    int result = flash_stream_resumable(&image.source, (uint32_t)image.size, partition,
+                                        filename, callback);
     
     // Cleanup
-    free(file_data);
+    image_close(&image);
+    fileio_reader_close(reader);
     flash_busy = 0;
     
     return result;
@@ -74,6 +176,229 @@ int flash_data(const uint8_t* data, uint32_t length, const char* partition,
         return -1;
     }
     
+    FlashMemorySource src = { data, length, 0 };
+    FlashSource source = { flash_memory_chunk, flash_memory_seek, &src };
+    return flash_stream(&source, length, partition, callback);
+}
+
+// --- Checkpoints ---
+
+void flash_set_checkpoint_interval(uint32_t parts) {
+    checkpoint_interval = parts;
+}
+
+void flash_set_checkpoint_directory(const char* directory) {
+    snprintf(checkpoint_directory, sizeof(checkpoint_directory), "%s",
+             directory ? directory : FLASH_CHECKPOINT_DIRECTORY);
+}
+
+static void flash_checkpoint_path(const char* partition, char* path, uint32_t size) {
+    snprintf(path, size, "%s/%s.ckpt", checkpoint_directory, partition);
+}
+
+int flash_has_checkpoint(const char* partition) {
+    char path[192];
+    if (!partition) return 0;
+    flash_checkpoint_path(partition, path, sizeof(path));
+    return fileio_file_exists(path);
+}
+
+void flash_discard_checkpoint(const char* partition) {
+    char path[192];
+    if (!partition) return;
+    flash_checkpoint_path(partition, path, sizeof(path));
+    remove(path);
+}
+
+// Pick up the ACKed parts of an earlier run of the same file. Anything that
+// does not match exactly (other file, changed file, other length) or does
+// not add up leaves first at 0.
+static void flash_checkpoint_load(FlashCheckpoint* c, const char* partition,
+                                  uint32_t length) {
+    FILE* f = fopen(c->path, "r");
+    if (!f) return;
+
+    uint32_t part_count = (length + FLASH_PART_SIZE - 1) / FLASH_PART_SIZE;
+    c->part_crcs = malloc(part_count * sizeof(uint32_t));
+
+    char line[320];
+    char name[64] = "", file[256] = "";
+    unsigned long long file_size = 0, mtime = 0, image_size = 0;
+    unsigned int part_size = 0;
+    uint32_t crc = 0, count = 0;
+
+    while (c->part_crcs && fgets(line, sizeof(line), f)) {
+        unsigned int sequence, part_crc, running;
+        if (sscanf(line, "partition %63s", name) == 1) continue;
+        if (sscanf(line, "file_size %llu", &file_size) == 1) continue;
+        if (strncmp(line, "file ", 5) == 0 && sscanf(line + 5, "%255[^\n]", file) == 1) continue;
+        if (sscanf(line, "mtime %llu", &mtime) == 1) continue;
+        if (sscanf(line, "image_size %llu", &image_size) == 1) continue;
+        if (sscanf(line, "part_size %u", &part_size) == 1) continue;
+        if (sscanf(line, "part %u %x %x", &sequence, &part_crc, &running) == 3) {
+            // Parts are logged in order with the CRC32 of everything so far;
+            // a torn last line fails this
+            if (sequence != count || count + 1 >= part_count) break;
+            crc = crc32_combine(crc, part_crc, FLASH_PART_SIZE);
+            if (crc != running) break;
+            c->part_crcs[count++] = part_crc;
+        }
+    }
+    fclose(f);
+
+    if (count > 0 && strcasecmp(name, partition) == 0 && strcmp(file, c->filename) == 0 &&
+        file_size == c->file_size && mtime == c->mtime && image_size == length &&
+        part_size == FLASH_PART_SIZE) {
+        c->first = count;
+        c->logged = count;
+        c->logged_crc = crc;
+        c->flushed = count;
+    }
+}
+
+// Name the checkpoint of filename going to partition and take the file's
+// identity; -1 when checkpoints are off or the file is not there
+static int flash_checkpoint_identify(FlashCheckpoint* c, const char* partition,
+                                     const char* filename) {
+    struct stat st;
+    memset(c, 0, sizeof(*c));
+    if (checkpoint_interval == 0 || FLASH_PART_SIZE != DIGEST_BLOCK_SIZE ||
+        !filename || stat(filename, &st) != 0) {
+        return -1;
+    }
+
+    flash_checkpoint_path(partition, c->path, sizeof(c->path));
+    snprintf(c->filename, sizeof(c->filename), "%s", filename);
+    c->file_size = (uint64_t)st.st_size;
+    c->mtime = (uint64_t)st.st_mtime;
+    return 0;
+}
+
+// Start a new log, replacing whatever checkpoint the partition had
+static void flash_checkpoint_create(FlashCheckpoint* c, const char* partition,
+                                    uint32_t length) {
+    fileio_create_directory(checkpoint_directory);
+    c->log = fopen(c->path, "w");
+    if (c->log) {
+        fprintf(c->log, "partition %s\nfile %s\nfile_size %llu\nmtime %llu\n"
+                "image_size %u\npart_size %u\n", partition, c->filename,
+                (unsigned long long)c->file_size, (unsigned long long)c->mtime,
+                length, FLASH_PART_SIZE);
+        fflush(c->log);
+    }
+}
+
+// Set up checkpointing of filename; returns 0 with c->log open
+static int flash_checkpoint_open(FlashCheckpoint* c, const char* partition,
+                                 const char* filename, uint32_t length) {
+    if (flash_checkpoint_identify(c, partition, filename) != 0) return -1;
+    flash_checkpoint_load(c, partition, length);
+
+    // A continued run appends to the log it continues
+    if (c->first > 0) {
+        c->log = fopen(c->path, "a");
+    } else {
+        flash_checkpoint_create(c, partition, length);
+    }
+    if (!c->log) {
+        free(c->part_crcs);
+        memset(c, 0, sizeof(*c));
+        return -1;
+    }
+    return 0;
+}
+
+// Add the parts below count to the log, part i having CRC32 crcs[i]
+static void flash_checkpoint_log(FlashCheckpoint* c, const uint32_t* crcs, uint32_t count) {
+    while (c->logged < count) {
+        uint32_t crc = crcs[c->logged];
+        c->logged_crc = crc32_combine(c->logged_crc, crc, FLASH_PART_SIZE);
+        fprintf(c->log, "part %u %08x %08x\n", c->logged, crc, c->logged_crc);
+        c->logged++;
+    }
+}
+
+// Log the parts below acked (all ACKed) and write them out once interval
+// parts have gathered, or now with force
+static void flash_checkpoint_update(FlashCheckpoint* c, const ImageDigest* digest,
+                                    uint32_t acked, int force) {
+    if (!c || !c->log || !digest || digest->lost) return;
+
+    // The last part's block only closes when the file is finished
+    if (acked > digest->block_count) acked = digest->block_count;
+    flash_checkpoint_log(c, digest->blocks, acked);
+    if (c->logged > c->flushed && (force || c->logged - c->flushed >= checkpoint_interval)) {
+        fflush(c->log);
+        c->flushed = c->logged;
+    }
+}
+
+// A finished file needs no checkpoint; a failed one keeps it
+static void flash_checkpoint_close(FlashCheckpoint* c, int flashed) {
+    if (!c || !c->log) return;
+    fclose(c->log);
+    if (flashed) remove(c->path);
+    free(c->part_crcs);
+    memset(c, 0, sizeof(*c));
+}
+
+int flash_save_checkpoint(const char* partition, const char* filename, uint32_t length,
+                          const uint32_t* part_crcs, uint32_t count) {
+    FlashCheckpoint c;
+    if (!partition || !part_crcs || count == 0) return -1;
+    if (flash_checkpoint_identify(&c, partition, filename) != 0) return -1;
+
+    flash_checkpoint_create(&c, partition, length);
+    if (!c.log) return -1;
+    flash_checkpoint_log(&c, part_crcs, count);
+    flash_checkpoint_close(&c, 0);
+    return 0;
+}
+
+// --- Delta ---
+
+// Point *part at a whole part: straight at the source's buffer when one
+// chunk covers it, otherwise gathered into stage
+static int flash_stage_part(const FlashSource* source, uint8_t* stage, uint32_t length,
+                            const uint8_t** part) {
+    uint32_t staged = 0;
+    while (staged < length) {
+        const uint8_t* chunk;
+        int got = source->next(source->ctx, &chunk, length - staged);
+        if (got <= 0) return -1;
+        if (staged == 0 && (uint32_t)got == length) {
+            *part = chunk;
+            return 0;
+        }
+        u64 copy_start = gettime();
+        memcpy(stage + staged, chunk, got);
+        perf_add(PERF_MEMCPY, ticks_to_microsecs(gettime() - copy_start));
+        staged += got;
+    }
+    *part = stage;
+    return 0;
+}
+
+// The device holds this part already: same CRC32 over the same range
+static int flash_base_has(const FlashBase* base, uint32_t sequence, uint32_t length,
+                          uint32_t crc) {
+    if (sequence >= base->block_count || base->blocks[sequence] != crc) return 0;
+
+    uint64_t start = (uint64_t)sequence * FLASH_PART_SIZE;
+    uint64_t base_length = base->length - start;
+    if (base_length > FLASH_PART_SIZE) base_length = FLASH_PART_SIZE;
+    return base_length == length;
+}
+
+// Run the Samsung file protocol over a chunk source, continuing from the
+// parts a checkpoint has when it has any
+static int flash_stream_run(const FlashSource* source, uint32_t length,
+                            const char* partition, FlashCheckpoint* checkpoint,
+                            const FlashBase* base, FlashProgressCallback callback) {
+    if (!source || !source->next || !source->seek || length == 0 || !partition) {
+        return -1;
+    }
+    
     // Update status
     strcpy(flash_status, "Preparing flash");
     flash_progress = 0.0f;
@@ -106,46 +431,300 @@ int flash_data(const uint8_t* data, uint32_t length, const char* partition,
     char temp_filename[32];
     snprintf(temp_filename, sizeof(temp_filename), "%s.img", partition);
     
-    if (samsung_send_file_header(temp_filename, length, file_type) != 0) {
+    // Send file in parts, keeping up to the window in flight
+    uint32_t part_count = (length + FLASH_PART_SIZE - 1) / FLASH_PART_SIZE;
+    uint8_t* part_state = calloc(part_count, 2);
+    uint8_t* stage = base ? usb_lend_buffer(FLASH_PART_SIZE) : NULL;
+    if (!part_state || (base && !stage)) {
+        strcpy(flash_status, "Out of memory");
+        free(part_state);
+        usb_return_buffer(stage);
+        return -1;
+    }
+    
+    uint32_t first = checkpoint ? checkpoint->first : 0;
+    int header;
+    if (base) {
+        header = samsung_send_delta_header(temp_filename, length, file_type, FLASH_PART_SIZE);
+    } else if (first > 0) {
+        header = samsung_send_resume_header(temp_filename, length, file_type, first,
+                                            FLASH_PART_SIZE);
+    } else {
+        header = samsung_send_file_header(temp_filename, length, file_type);
+    }
+    if (header != 0) {
         strcpy(flash_status, "Header failed");
+        free(part_state);
+        usb_return_buffer(stage);
         return -1;
     }
+    uint8_t* part_tries = part_state + part_count;
+    
+    memset(&flash_report, 0, sizeof(flash_report));
+    flash_report.parts = part_count;
+    
+    uint32_t queue[FLASH_MAX_WINDOW]; // Sequences awaiting an ACK, oldest first
+    uint32_t queue_head = 0;
+    uint32_t queue_count = 0;
+    uint32_t window = 1;
+    uint32_t next = 0;                // Lowest sequence that may need sending
+    uint32_t source_next = 0;         // Sequence the source will produce next
+    uint32_t done = 0;                // Parts acked or failed
+    uint32_t acked = 0;
+    uint32_t checksum_parts = 0;      // Parts folded into the digest
+    int result = 0;
     
-    // Send file in chunks
-    const uint32_t CHUNK_SIZE = 0x40000; // 256KB
-    uint32_t sequence = 0;
-    uint32_t sent = 0;
+    // Block CRCs of what was sent, kept for flash_verify
+    ImageDigest* digest = digest_begin(partition, length);
     
-    while (sent < length) {
-        uint32_t chunk_size = length - sent;
-        if (chunk_size > CHUNK_SIZE) {
-            chunk_size = CHUNK_SIZE;
+    // Parts the device already has from an interrupted run; the source is
+    // sought past them when the first part goes out
+    for (uint32_t i = 0; i < first; i++) {
+        part_state[i] = PART_ACKED;
+        digest_append_block(digest, checkpoint->part_crcs[i]);
+    }
+    acked = done = next = checksum_parts = first;
+    flash_report.resumed = first;
+    uint64_t resumed_bytes = (uint64_t)first * FLASH_PART_SIZE;
+    telemetry_start(resumed_bytes < length ? length - resumed_bytes : 0);
+    uint32_t contiguous = first;      // Parts 0..contiguous-1 are all ACKed
+    
+    while (done < part_count) {
+        // Fill the window
+        while (queue_count < window) {
+            while (next < part_count && part_state[next] != PART_PENDING) {
+                next++;
+            }
+            if (next >= part_count) break;
+            
+            if (flash_cancel) {
+                strcpy(flash_status, "Aborted");
+                result = -1;
+                goto finish;
+            }
+            
+            uint32_t sequence = next++;
+            uint32_t offset = sequence * FLASH_PART_SIZE;
+            uint32_t chunk_size = length - offset;
+            if (chunk_size > FLASH_PART_SIZE) {
+                chunk_size = FLASH_PART_SIZE;
+            }
+            
+            if (part_tries[sequence] >= FLASH_PART_RETRIES) {
+                part_state[sequence] = PART_FAILED;
+                if (flash_report.failed_count < FLASH_REPORT_MAX_FAILED) {
+                    flash_report.failed[flash_report.failed_count] = sequence;
+                }
+                flash_report.failed_count++;
+                done++;
+                continue;
+            }
+            
+            // Resends go back to the part's offset in the source
+            if (sequence != source_next && source->seek(source->ctx, offset) != 0) {
+                strcpy(flash_status, "Seek failed");
+                result = -1;
+                goto finish;
+            }
+            
+            source_next = sequence + 1;
+            u64 part_start = gettime();
+            uint64_t read_us = 0, checksum_us = 0;
+            
+            // First sends go out in order, so each part is summed exactly once
+            int sum_part = (sequence == checksum_parts);
+            
+            if (base) {
+                // Delta: the whole part is read first and only goes out if
+                // the device does not already have it
+                const uint8_t* part;
+                if (flash_stage_part(source, stage, chunk_size, &part) != 0) {
+                    strcpy(flash_status, "Read failed");
+                    result = -1;
+                    goto finish;
+                }
+                u64 crc_start = gettime();
+                read_us = ticks_to_microsecs(crc_start - part_start);
+                uint32_t crc = crc32_update(0, part, chunk_size);
+                if (sum_part) {
+                    if (chunk_size == DIGEST_BLOCK_SIZE) {
+                        digest_append_block(digest, crc);
+                    } else {
+                        digest_update(digest, part, chunk_size);
+                    }
+                    checksum_parts++;
+                }
+                checksum_us = ticks_to_microsecs(gettime() - crc_start);
+                
+                if (part_tries[sequence] == 0 &&
+                    flash_base_has(base, sequence, chunk_size, crc)) {
+                    part_state[sequence] = PART_ACKED;
+                    flash_report.unchanged++;
+                    telemetry_add(chunk_size, 0, read_us);
+                    perf_add(PERF_SD_READ, read_us);
+                    perf_add(PERF_CHECKSUM, checksum_us);
+                    acked++;
+                    done++;
+                    while (contiguous < part_count && part_state[contiguous] == PART_ACKED) {
+                        contiguous++;
+                    }
+                    continue;
+                }
+                
+                if (samsung_send_part_header(chunk_size, sequence) != 0 ||
+                    usb_send_bulk(part, chunk_size) != (int)chunk_size) {
+                    strcpy(flash_status, "Chunk failed");
+                    result = -1;
+                    goto finish;
+                }
+                sum_part = 0;
+            } else if (samsung_send_part_header(chunk_size, sequence) != 0) {
+                // The part goes out as it arrives from the source: chunks end
+                // at the source's buffer boundaries, not at part boundaries
+                strcpy(flash_status, "Chunk failed");
+                result = -1;
+                goto finish;
+            }
+            
+            uint32_t part_sent = base ? chunk_size : 0;
+            while (part_sent < chunk_size) {
+                if (flash_cancel) {
+                    strcpy(flash_status, "Aborted");
+                    result = -1;
+                    goto finish;
+                }
+                const uint8_t* chunk;
+                u64 read_start = gettime();
+                int got = source->next(source->ctx, &chunk, chunk_size - part_sent);
+                read_us += ticks_to_microsecs(gettime() - read_start);
+                if (got <= 0) {
+                    strcpy(flash_status, "Read failed");
+                    result = -1;
+                    goto finish;
+                }
+                if (sum_part) {
+                    u64 crc_start = gettime();
+                    digest_update(digest, chunk, got);
+                    checksum_us += ticks_to_microsecs(gettime() - crc_start);
+                }
+                if (usb_send_bulk(chunk, got) != got) {
+                    strcpy(flash_status, "Chunk failed");
+                    result = -1;
+                    goto finish;
+                }
+                part_sent += got;
+            }
+            if (sum_part) {
+                checksum_parts++;
+            }
+            uint64_t part_us = ticks_to_microsecs(gettime() - part_start);
+            uint64_t send_us = part_us - (part_us < read_us + checksum_us ? part_us :
+                                          read_us + checksum_us);
+            telemetry_add(chunk_size, send_us, read_us);
+            perf_add(PERF_SD_READ, read_us);
+            perf_add(PERF_CHECKSUM, checksum_us);
+            perf_add(PERF_USB, send_us);
+            perf_add_bytes(chunk_size);
+            
+            if (part_tries[sequence]++ > 0) {
+                flash_report.resent++;
+            }
+            part_state[sequence] = PART_IN_FLIGHT;
+            queue[(queue_head + queue_count) % FLASH_MAX_WINDOW] = sequence;
+            queue_count++;
         }
         
-        // Update progress
-        flash_progress = (float)sent / length;
-        char status[64];
-        snprintf(status, sizeof(status), "Sending chunk %u", sequence + 1);
-        strcpy(flash_status, status);
+        if (queue_count == 0) break;
         
-        if (callback) {
-            callback(flash_progress, status);
+        // Wait for the oldest outstanding ACK
+        uint32_t ack_status, ack_sequence;
+        u64 ack_start = gettime();
+        if (samsung_read_ack(&ack_status, &ack_sequence) != 0) {
+            strcpy(flash_status, "No ACK received");
+            result = -1;
+            goto finish;
         }
+        perf_add(PERF_USB, ticks_to_microsecs(gettime() - ack_start));
         
-        // Send chunk
-        if (samsung_send_file_part(data + sent, chunk_size, sequence) != 0) {
-            strcpy(flash_status, "Chunk failed");
-            return -1;
+        if (window > 1 && ack_sequence != queue[queue_head]) {
+            uint32_t position = 0;
+            while (position < queue_count &&
+                   queue[(queue_head + position) % FLASH_MAX_WINDOW] != ack_sequence) {
+                position++;
+            }
+            
+            if (position < queue_count) {
+                // Earlier parts were never acknowledged: queue them again
+                while (queue[queue_head] != ack_sequence) {
+                    uint32_t missing = queue[queue_head];
+                    part_state[missing] = PART_PENDING;
+                    if (missing < next) next = missing;
+                    flash_report.gaps++;
+                    queue_head = (queue_head + 1) % FLASH_MAX_WINDOW;
+                    queue_count--;
+                }
+            } else {
+                // Not a sequence we sent: the device is not tracking them
+                window = 1;
+                pipelining_rejected = 1;
+            }
         }
         
-        // Wait for ACK
-        if (samsung_wait_ack() != 0) {
-            strcpy(flash_status, "No ACK received");
-            return -1;
+        uint32_t sequence = queue[queue_head];
+        queue_head = (queue_head + 1) % FLASH_MAX_WINDOW;
+        queue_count--;
+        
+        if (ack_status == 0) {
+            part_state[sequence] = PART_ACKED;
+            acked++;
+            done++;
+            
+            while (contiguous < part_count && part_state[contiguous] == PART_ACKED) {
+                contiguous++;
+            }
+            flash_checkpoint_update(checkpoint, digest, contiguous, 0);
+            
+            // An echoed sequence number means the device can take a window
+            if (window == 1 && !pipelining_rejected && sequence > 0 &&
+                ack_sequence == sequence) {
+                window = flash_window;
+            }
+        } else {
+            flash_report.rejected++;
+            part_state[sequence] = PART_PENDING;
+            if (sequence < next) next = sequence;
+            if (window > 1) {
+                window = 1;
+                pipelining_rejected = 1;
+            }
         }
         
-        sent += chunk_size;
-        sequence++;
+        // Update progress; the callback only hears about it once a frame
+        flash_progress = (float)acked / part_count;
+        snprintf(flash_status, sizeof(flash_status), "Sent part %u of %u", acked, part_count);
+        
+        if (callback && telemetry_due()) {
+            char status[64];
+            telemetry_format("Flashing", status, sizeof(status));
+            callback(flash_progress, status);
+        }
+    }
+    
+    if (flash_report.failed_count > 0) {
+        strcpy(flash_status, "Parts failed");
+        result = -1;
+    }
+    
+finish:
+    flash_report.window = window;
+    flash_report.checksum = digest_checksum(digest);
+    free(part_state);
+    usb_return_buffer(stage);
+    if (result != 0) {
+        // Whatever the device confirmed goes on the card before giving up
+        flash_checkpoint_update(checkpoint, digest, contiguous, 1);
+        digest_discard(digest);
+        return result;
     }
     
     // Send file end
@@ -153,11 +732,12 @@ int flash_data(const uint8_t* data, uint32_t length, const char* partition,
         callback(0.9f, "Finalizing");
     }
     
-    uint32_t checksum = 0; // Would calculate actual checksum
-    if (samsung_send_file_end(length, checksum) != 0) {
+    if (samsung_send_file_end(length, flash_report.checksum) != 0) {
         strcpy(flash_status, "End failed");
+        digest_discard(digest);
         return -1;
     }
+    digest_finish(digest);
     
     // Complete
     flash_progress = 1.0f;
@@ -170,29 +750,170 @@ int flash_data(const uint8_t* data, uint32_t length, const char* partition,
     return 0;
 }
 
-// Verify flash
-int flash_verify(const char* filename, const char* partition) {
-    // Not implemented in this version
-    return 0;
+int flash_stream(const FlashSource* source, uint32_t length, const char* partition,
+                 FlashProgressCallback callback) {
+    return flash_stream_run(source, length, partition, NULL, NULL, callback);
 }
 
-// Abort current flash
-int flash_abort(void) {
-    if (!flash_busy) {
-        return 0;
+int flash_stream_delta(const FlashSource* source, uint32_t length, const char* partition,
+                       const FlashBase* base, FlashProgressCallback callback) {
+    // Parts are compared against whole base blocks
+    if (base && (!base->blocks || FLASH_PART_SIZE != DIGEST_BLOCK_SIZE)) base = NULL;
+    return flash_stream_run(source, length, partition, NULL, base, callback);
+}
+
+int flash_stream_resumable(const FlashSource* source, uint32_t length,
+                           const char* partition, const char* filename,
+                           FlashProgressCallback callback) {
+    if (!partition) return -1;
+    
+    // Without a checkpoint (turned off, card full) the flash still runs
+    FlashCheckpoint checkpoint;
+    int checkpointed = (flash_checkpoint_open(&checkpoint, partition, filename, length) == 0);
+    
+    int result = flash_stream_run(source, length, partition,
+                                  checkpointed ? &checkpoint : NULL, NULL, callback);
+    if (checkpointed) flash_checkpoint_close(&checkpoint, result == 0);
+    return result;
+}
+
+// Verify flash: read the partition back and compare it block by block
+// with the digest taken while it was sent, so the source is not read again
+int flash_verify(const char* partition, FlashProgressCallback callback) {
+    memset(&verify_report, 0, sizeof(verify_report));
+    verify_report.first_bad_block = -1;
+    
+    const ImageDigest* digest = digest_find(partition);
+    if (!digest || digest->length == 0 || digest->length > 0xFFFFFFFFull) {
+        strcpy(flash_status, "Nothing to verify");
+        return -1;
+    }
+    if (flash_busy) {
+        return -1;
     }
     
-    // Send abort command to device
-    uint8_t abort_cmd[] = {0xFF, 0x00, 0x00, 0x00, 0x00, 0x00};
-    usb_send_bulk(abort_cmd, sizeof(abort_cmd));
+    // One digest block per bulk read, DMAed straight into place
+    uint8_t* buffer = usb_lend_buffer(DIGEST_BLOCK_SIZE);
+    if (!buffer) {
+        return -1;
+    }
     
-    flash_busy = 0;
+    flash_busy = 1;
     flash_progress = 0.0f;
-    strcpy(flash_status, "Aborted");
+    strcpy(flash_status, "Verifying");
+    verify_report.expected = digest_checksum(digest);
+    
+    u64 start = gettime();
+    int result = 0;
+    if (usb_start_session() != 0 ||
+        samsung_send_dump_request(partition, 0, (uint32_t)digest->length) != 0) {
+        strcpy(flash_status, "Readback failed");
+        result = -1;
+    }
+    
+    telemetry_start(digest->length);
+    for (uint32_t i = 0; result == 0 && i < digest->block_count; i++) {
+        uint32_t wanted = digest_block_length(digest, i);
+        uint32_t got = wanted;
+        if (flash_cancel) {
+            strcpy(flash_status, "Aborted");
+            result = -1;
+            break;
+        }
+        u64 read_start = gettime();
+        if (usb_receive_bulk(&buffer, &got) != 0 || got != wanted) {
+            strcpy(flash_status, "Readback failed");
+            result = -1;
+            break;
+        }
+        u64 crc_start = gettime();
+        uint64_t usb_us = ticks_to_microsecs(crc_start - read_start);
+        telemetry_add(got, usb_us, 0);
+        perf_add(PERF_USB, usb_us);
+        perf_add_bytes(got);
+        
+        uint32_t crc = crc32_update(0, buffer, got);
+        perf_add(PERF_CHECKSUM, ticks_to_microsecs(gettime() - crc_start));
+        verify_report.actual = crc32_combine(verify_report.actual, crc, got);
+        if (crc != digest->blocks[i] && verify_report.mismatched++ == 0) {
+            verify_report.first_bad_block = (int32_t)i;
+        }
+        verify_report.bytes += got;
+        verify_report.blocks++;
+        
+        flash_progress = (float)(i + 1) / digest->block_count;
+        if (callback && telemetry_due()) {
+            char status[64];
+            telemetry_format("Verifying", status, sizeof(status));
+            callback(flash_progress, status);
+        }
+    }
+    
+    usb_end_flash_session();
+    usb_return_buffer(buffer);
+    verify_report.elapsed_us = ticks_to_microsecs(gettime() - start);
+    
+    if (result == 0 && verify_report.mismatched > 0) {
+        snprintf(flash_status, sizeof(flash_status), "First mismatching block %d at 0x%llx",
+                 verify_report.first_bad_block,
+                 (unsigned long long)verify_report.first_bad_block * DIGEST_BLOCK_SIZE);
+        result = -2;
+    } else if (result == 0 && verify_report.actual != verify_report.expected) {
+        // Every block matched its own CRC32, yet the image as a whole did not
+        snprintf(flash_status, sizeof(flash_status), "Image CRC32 %08x, expected %08x",
+                 verify_report.actual, verify_report.expected);
+        result = -2;
+    } else if (result == 0) {
+        strcpy(flash_status, "Verified");
+    }
+    flash_busy = 0;
+    return result;
+}
+
+const FlashVerifyReport* flash_get_verify_report(void) {
+    return &verify_report;
+}
+
+// Set the number of parts kept in flight
+int flash_set_window(uint32_t parts) {
+    if (parts == 0) {
+        parts = 1;
+    }
+    if (parts > FLASH_MAX_WINDOW) {
+        parts = FLASH_MAX_WINDOW;
+    }
     
+    flash_window = parts;
+    pipelining_rejected = 0;
+    return 0;
+}
+
+// Get the configured window
+uint32_t flash_get_window(void) {
+    return flash_window;
+}
+
+// Get the report for the last file sent
+const FlashReport* flash_get_report(void) {
+    return &flash_report;
+}
+
+// Abort current flash. Only raises the cancel token: the thread running
+// the transfer stops at the next chunk and closes the session itself.
+int flash_abort(void) {
+    flash_cancel = 1;
     return 0;
 }
 
+int flash_abort_requested(void) {
+    return flash_cancel;
+}
+
+// Re-arm after an abort, before the next job
+void flash_clear_abort(void) {
+    flash_cancel = 0;
+}
+
 // Check if flash is busy
 int flash_is_busy(void) {
     return flash_busy;
@@ -225,13 +946,59 @@ int samsung_send_file_header(const char* filename, uint32_t file_size,
     // Filename
     strncpy((char*)(header + 16), filename, 256);
     
-    return usb_send_bulk(header, 1024);
+    return (usb_send_bulk(header, 1024) == 1024) ? 0 : -1;
 }
 
-// Send file part
-int samsung_send_file_part(const uint8_t* data, uint32_t length, 
-                           uint32_t sequence) {
-    // Create part header
+int samsung_send_resume_header(const char* filename, uint32_t file_size,
+                               uint32_t file_type, uint32_t sequence,
+                               uint32_t part_size) {
+    uint8_t header[1024];
+    memset(header, 0, sizeof(header));
+    
+    *(uint32_t*)(header + 0) = 0x00000000; // Magic
+    *(uint32_t*)(header + 4) = file_size;
+    *(uint32_t*)(header + 8) = file_type;
+    *(uint32_t*)(header + 12) = sequence;  // First part sent
+    
+    strncpy((char*)(header + 16), filename, 256);
+    *(uint32_t*)(header + 272) = part_size; // Where that part starts
+    
+    return (usb_send_bulk(header, 1024) == 1024) ? 0 : -1;
+}
+
+// File header with the delta flag at +276: parts not sent keep what the partition holds
+int samsung_send_delta_header(const char* filename, uint32_t file_size,
+                              uint32_t file_type, uint32_t part_size) {
+    uint8_t header[1024];
+    memset(header, 0, sizeof(header));
+    
+    *(uint32_t*)(header + 0) = 0x00000000; // Magic
+    *(uint32_t*)(header + 4) = file_size;
+    *(uint32_t*)(header + 8) = file_type;
+    
+    strncpy((char*)(header + 16), filename, 256);
+    *(uint32_t*)(header + 272) = part_size;
+    *(uint32_t*)(header + 276) = 0x00000001; // Keep what is not sent
+    
+    return (usb_send_bulk(header, 1024) == 1024) ? 0 : -1;
+}
+
+// Ask for a partition back; the device streams it over bulk IN
+int samsung_send_dump_request(const char* partition, uint32_t offset, uint32_t length) {
+    uint8_t header[1024];
+    memset(header, 0, sizeof(header));
+    
+    *(uint32_t*)(header + 0) = 0x00000003; // Dump magic
+    *(uint32_t*)(header + 4) = length;
+    *(uint32_t*)(header + 8) = offset;
+    
+    strncpy((char*)(header + 16), partition, 256);
+    
+    return (usb_send_bulk(header, 1024) == 1024) ? 0 : -1;
+}
+
+// Send the header that announces a part's sequence and length
+int samsung_send_part_header(uint32_t length, uint32_t sequence) {
     uint8_t header[16];
     memset(header, 0, sizeof(header));
     
@@ -240,8 +1007,13 @@ int samsung_send_file_part(const uint8_t* data, uint32_t length,
     *(uint32_t*)(header + 8) = length;
     *(uint32_t*)(header + 12) = 0x00000000; // Reserved
     
-    // Send header
-    if (usb_send_bulk(header, sizeof(header)) != sizeof(header)) {
+    return (usb_send_bulk(header, sizeof(header)) == sizeof(header)) ? 0 : -1;
+}
+
+// Send file part
+int samsung_send_file_part(const uint8_t* data, uint32_t length, 
+                           uint32_t sequence) {
+    if (samsung_send_part_header(length, sequence) != 0) {
         return -1;
     }
     
@@ -263,25 +1035,34 @@ int samsung_send_file_end(uint32_t file_size, uint32_t checksum) {
     *(uint32_t*)(end + 8) = checksum;
     *(uint32_t*)(end + 12) = 0x00000000; // Reserved
     
-    return usb_send_bulk(end, sizeof(end));
+    return (usb_send_bulk(end, sizeof(end)) == sizeof(end)) ? 0 : -1;
 }
 
-// Wait for ACK
-int samsung_wait_ack(void) {
+// Read one ACK packet: status word then the echoed part sequence
+int samsung_read_ack(uint32_t* status, uint32_t* sequence) {
     uint8_t ack_buffer[16];
     uint8_t* p_ack = ack_buffer;
     uint32_t len = 16;
 
-    if (usb_receive_bulk(&p_ack, &len) != 0) {
+    if (usb_receive_bulk(&p_ack, &len) != 0 || len < 8) {
         return -1;
-    } // This closes the IF, not the function
+    }
+
+    if (status) *status = *(uint32_t*)ack_buffer;
+    if (sequence) *sequence = *(uint32_t*)(ack_buffer + 4);
+    return 0;
+}
 
-    if (*(uint32_t*)ack_buffer != 0x00000000) {
+// Wait for ACK
+int samsung_wait_ack(void) {
+    uint32_t status;
+
+    if (samsung_read_ack(&status, NULL) != 0) {
         return -1;
     }
 
-    return 0;
-} // This closes the function
+    return (status == 0) ? 0 : -1;
+}
 
 // Send PIT file
 int samsung_send_pit(const uint8_t* pit_data, uint32_t pit_size) {
@@ -300,3 +1081,33 @@ int samsung_send_pit(const uint8_t* pit_data, uint32_t pit_size) {
     // Wait for ACK
     return samsung_wait_ack();
 }
+
+// Request the PIT: "PITD", answered with status, size and CRC32
+int samsung_request_pit(uint32_t* size, uint32_t* checksum) {
+    if (usb_send_samsung_cmd("PITD", 0) != 0) {
+        return -1;
+    }
+
+    uint8_t answer[16];
+    uint8_t* p_answer = answer;
+    uint32_t len = 16;
+    if (usb_receive_bulk(&p_answer, &len) != 0 || len < 12) {
+        return -1;
+    }
+    if (*(uint32_t*)answer != 0) {
+        return -2; // No PIT on the device
+    }
+
+    if (size) *size = *(uint32_t*)(answer + 4);
+    if (checksum) *checksum = *(uint32_t*)(answer + 8);
+    return 0;
+}
+
+// Read the table announced by samsung_request_pit
+int samsung_receive_pit(uint8_t* buffer, uint32_t size) {
+    uint32_t got = size;
+    if (!buffer || usb_receive_bulk(&buffer, &got) != 0 || got != size) {
+        return -1;
+    }
+    return 0;
+}
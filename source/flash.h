@@ -3,10 +3,66 @@
 #define FLASH_H
 
 #include <stdint.h>
+#include "fileio.h"
+
+// Send window: parts allowed in flight before their ACKs arrive
+#define FLASH_DEFAULT_WINDOW 4
+#define FLASH_MAX_WINDOW 16
+#define FLASH_PART_RETRIES 3
+#define FLASH_REPORT_MAX_FAILED 16
+
+// Checkpoints: flash_stream_resumable logs the parts the device has ACKed
+// to the card, so flashing the same file again after a dropped connection
+// continues from the last confirmed part instead of byte 0
+#define FLASH_CHECKPOINT_DIRECTORY "sd:/heimdall/checkpoint"
+#define FLASH_DEFAULT_CHECKPOINT_INTERVAL 16 // Parts (4MB) between card writes
+
+// Per-file outcome of the windowed protocol
+typedef struct {
+    uint32_t parts;             // Parts in the file
+    uint32_t window;            // Window in use when the file finished
+    uint32_t resent;            // Part sends beyond the first attempt
+    uint32_t gaps;              // Parts skipped over by a later ACK
+    uint32_t rejected;          // Parts answered with a non-zero status
+    uint32_t failed_count;      // Parts that ran out of retries
+    uint32_t failed[FLASH_REPORT_MAX_FAILED]; // Their sequence numbers
+    uint32_t checksum;          // CRC32 sent in the file end packet
+    uint32_t resumed;           // Parts a checkpoint said were already flashed
+    uint32_t unchanged;         // Delta: parts the base already had, not sent
+} FlashReport;
+
+// Readback of a partition against the digest taken while flashing it
+typedef struct {
+    uint64_t bytes;             // Bytes read back
+    uint32_t blocks;            // Digest blocks compared
+    uint32_t mismatched;        // Blocks whose CRC32 differed
+    // Index of the first of them, -1 = none; it starts at index *
+    // DIGEST_BLOCK_SIZE. The bad byte is somewhere in that block.
+    int32_t first_bad_block;
+    uint32_t expected;          // CRC32 taken while flashing
+    uint32_t actual;            // CRC32 of the readback
+    uint64_t elapsed_us;
+} FlashVerifyReport;
+
+// Image a partition holds already, for delta flashing (see delta.h)
+typedef struct {
+    const uint32_t* blocks;     // CRC32 per DIGEST_BLOCK_SIZE block
+    uint32_t block_count;
+    uint64_t length;
+} FlashBase;
 
 // Progress callback
 typedef int (*FlashProgressCallback)(float progress, const char* status);
 
+// Source of part data. next points *chunk at up to max bytes and returns
+// the count, 0 at the end, <0 on error; a part may take several chunks.
+// seek lets missing parts be resent.
+typedef struct {
+    int (*next)(void* ctx, const uint8_t** chunk, uint32_t max);
+    int (*seek)(void* ctx, uint32_t offset);
+    void* ctx;
+} FlashSource;
+
 // Flash functions
 int flash_init(void);
 void flash_cleanup(void);
@@ -14,19 +70,72 @@ int flash_file(const char* filename, const char* partition,
                FlashProgressCallback callback);
 int flash_data(const uint8_t* data, uint32_t length, const char* partition,
                FlashProgressCallback callback);
-int flash_verify(const char* filename, const char* partition);
+void flash_reader_source(FileReader* reader, FlashSource* source);
+int flash_stream(const FlashSource* source, uint32_t length, const char* partition,
+                 FlashProgressCallback callback);
+// flash_stream with checkpoints. filename identifies what the source reads
+// (with its size and mtime); a checkpoint of the same file, partition and
+// length is continued from its last ACKed part. The checkpoint is removed
+// once the file is flashed.
+int flash_stream_resumable(const FlashSource* source, uint32_t length,
+                           const char* partition, const char* filename,
+                           FlashProgressCallback callback);
+// flash_stream that only sends the parts whose CRC32 differs from base;
+// the device keeps the rest. NULL base is a plain flash_stream.
+int flash_stream_delta(const FlashSource* source, uint32_t length, const char* partition,
+                       const FlashBase* base, FlashProgressCallback callback);
+// Parts between checkpoint writes; 0 turns checkpoints off
+void flash_set_checkpoint_interval(uint32_t parts);
+// NULL selects FLASH_CHECKPOINT_DIRECTORY
+void flash_set_checkpoint_directory(const char* directory);
+int flash_has_checkpoint(const char* partition);
+void flash_discard_checkpoint(const char* partition);
+// Checkpoint of a flash that went out without the part protocol (the raw
+// stream): the device holds its first count parts, part i with CRC32
+// part_crcs[i]. Flashing the file with flash_file continues from there.
+int flash_save_checkpoint(const char* partition, const char* filename, uint32_t length,
+                          const uint32_t* part_crcs, uint32_t count);
+// 0 when the partition reads back as flashed, -1 nothing recorded for it
+// or readback failed, -2 mismatch (see flash_get_verify_report)
+int flash_verify(const char* partition, FlashProgressCallback callback);
+// Cancel whatever is transferring; safe from any thread. The transfer
+// fails with status "Aborted" at its next chunk, and every later one does
+// too until flash_clear_abort.
 int flash_abort(void);
+int flash_abort_requested(void);
+void flash_clear_abort(void);
 int flash_is_busy(void);
 float flash_get_progress(void);
 const char* flash_get_status(void);
+int flash_set_window(uint32_t parts);
+uint32_t flash_get_window(void);
+const FlashReport* flash_get_report(void);
+const FlashVerifyReport* flash_get_verify_report(void);
 
 // Samsung flash protocol
 int samsung_send_file_header(const char* filename, uint32_t file_size, 
                              uint32_t file_type);
+// File header that continues a file from sequence; the device keeps what it
+// has below sequence * part_size
+int samsung_send_resume_header(const char* filename, uint32_t file_size,
+                               uint32_t file_type, uint32_t sequence,
+                               uint32_t part_size);
+int samsung_send_part_header(uint32_t length, uint32_t sequence);
+// File header for a delta: parts not sent keep what the partition holds
+int samsung_send_delta_header(const char* filename, uint32_t file_size,
+                              uint32_t file_type, uint32_t part_size);
+// Ask for length bytes of partition from offset back over bulk IN
+int samsung_send_dump_request(const char* partition, uint32_t offset, uint32_t length);
 int samsung_send_file_part(const uint8_t* data, uint32_t length, 
                            uint32_t sequence);
 int samsung_send_file_end(uint32_t file_size, uint32_t checksum);
 int samsung_wait_ack(void);
+int samsung_read_ack(uint32_t* status, uint32_t* sequence);
 int samsung_send_pit(const uint8_t* pit_data, uint32_t pit_size);
+// Ask for the device's PIT. The answer carries the table's size and CRC32,
+// which is enough to tell whether a cached copy is the same table; the
+// table itself follows over bulk IN until the session ends.
+int samsung_request_pit(uint32_t* size, uint32_t* checksum);
+int samsung_receive_pit(uint8_t* buffer, uint32_t size);
 
 #endif
\ No newline at end of file
@@ -68,11 +68,16 @@ void gui_show_main_menu(int device_connected, int pit_loaded) {
     printf("1. Detect Device\n2. Load PIT\n3. Flash Recovery\n...");
 }
 
-void gui_show_settings(int auto_reboot, int verify, int safe_mode) {
+void gui_show_settings(int auto_reboot, int verify, int safe_mode, int cache_mb) {
     printf("\x1b[2;0H");
     printf("--- Settings ---\n");
     printf("Auto-Reboot: %s\n", auto_reboot ? "ON" : "OFF");
     printf("Verify:      %s\n", verify ? "ON" : "OFF");
+    if (cache_mb > 0) {
+        printf("Image cache: %d MB\n", cache_mb);
+    } else {
+        printf("Image cache: OFF\n");
+    }
 }
 
 void gui_render(void) {
@@ -118,7 +118,7 @@ void gui_free_menu(Menu* menu);
 void gui_add_button(Menu* menu, const char* text, void(*callback)(void));
 void gui_set_menu(Menu* menu);
 void gui_show_main_menu(int device_connected, int pit_loaded);
-void gui_show_settings(int auto_reboot, int verify_flash, int safe_mode);
+void gui_show_settings(int auto_reboot, int verify_flash, int safe_mode, int cache_mb);
 void gui_show_file_browser(void);
 
 // Button management
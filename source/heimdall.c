@@ -1,3 +1,5 @@
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,13 +7,36 @@
 #include "heimdall.h"
 #include "usb.h"
 #include "pit.h"
-
-#define FLASH_CHUNK_SIZE (16 * 1024)
+#include "fileio.h"
+#include "flash.h"
+#include "crc32.h"
+#include "odin.h"
+#include "image.h"
+#include "digest.h"
+#include "backup.h"
+#include "batch.h"
+#include "delta.h"
+#include "telemetry.h"
+#include "perf.h"
+#include "tuner.h"
+#include "multi.h"
+#include "cache.h"
+#include "mem.h"
+#include "pitcache.h"
 
 // FIX 1: Remove 'extern'. This file MUST define the variable 
 // so the linker has a physical memory address for it.
 PitInfo current_pit; 
 
+// A PIT is a few KB; anything this big is not one
+#define PIT_MAX_FILE_SIZE (1024 * 1024)
+
+// Zeroed fields fall back to the transfer engine defaults. Until a config
+// is set, a flash with a PIT loaded takes the tuner's pick for the device.
+static TransferConfig transfer_config;
+static int transfer_config_set = 0;
+static TransferStats transfer_stats;
+
 // --- Core Heimdall Logic ---
 
 int heimdall_init(void) {
@@ -20,18 +45,21 @@ int heimdall_init(void) {
 
 void heimdall_cleanup(void) {
     usb_cleanup();
+    pit_free(&current_pit);
 }
 
 int heimdall_detect_device(void) {
-    if (usb_init_device() == 0) {
-        if (usb_is_connected()) return 0;
-    }
-    return -1;
+    // The open handle is kept between operations; only a device that
+    // stopped answering is enumerated again
+    return usb_connect();
 }
 
 int heimdall_reboot(void) {
     // Samsung Download Mode usually responds to "REBT" or "REST"
-    return usb_send_samsung_cmd("REBT", 0); 
+    int result = usb_send_samsung_cmd("REBT", 0);
+    // The phone leaves the bus, so the next detect must open it afresh
+    if (result == 0) usb_close_device();
+    return result;
 }
 
 // --- Partition Management ---
@@ -39,7 +67,8 @@ int heimdall_reboot(void) {
 const char* heimdall_determine_partition(const char* filename) {
     if (!filename) return NULL;
     
-    // Simple mapping based on filename
+    // Simple mapping based on filename; compressed images (system.img.lz4)
+    // match on the same stem and are decoded while flashing
     if (strstr(filename, "recovery.img")) return "RECOVERY";
     if (strstr(filename, "system.img"))   return "SYSTEM";
     if (strstr(filename, "boot.img"))     return "BOOT";
@@ -51,24 +80,32 @@ const char* heimdall_determine_partition(const char* filename) {
 }
 
 int heimdall_load_pit(const char* filename) {
-    FILE* f = fopen(filename, "rb");
-    if (!f) return -1;
+    FileReader* reader = fileio_reader_open(filename, 0);
+    if (!reader) return -1;
 
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+    uint64_t size = fileio_reader_size(reader);
+    if (size == 0 || size > PIT_MAX_FILE_SIZE) {
+        fileio_reader_close(reader);
+        return -2;
+    }
 
-    uint8_t* buffer = malloc(size);
+    // The raw table only lives until it is parsed
+    uint32_t mark = mem_scratch_mark();
+    uint8_t* buffer = mem_scratch_alloc((uint32_t)size);
     if (!buffer) {
-        fclose(f);
+        fileio_reader_close(reader);
         return -2;
     }
 
-    fread(buffer, 1, size, f);
-    fclose(f);
+    int read_bytes = fileio_reader_read(reader, buffer, (uint32_t)size);
+    fileio_reader_close(reader);
+    if (read_bytes != (int)size) {
+        mem_scratch_release(mark);
+        return -1;
+    }
 
-    int result = pit_parse(buffer, size, &current_pit);
-    free(buffer);
+    int result = pit_parse(buffer, (uint32_t)size, &current_pit);
+    mem_scratch_release(mark);
     return result;
 }
 
@@ -76,48 +113,437 @@ PitInfo* heimdall_get_pit_info(void) {
     return &current_pit;
 }
 
+int heimdall_download_pit(void) {
+    if (!usb_is_device_open() || usb_start_session() != 0) return -1;
+
+    uint32_t size = 0, checksum = 0;
+    if (samsung_request_pit(&size, &checksum) != 0 || size < PIT_HEADER_SIZE ||
+        size > PIT_MAX_FILE_SIZE) {
+        usb_end_flash_session();
+        return -2;
+    }
+
+    // Same size and CRC32 as a table already on the card: ending the
+    // session drops the transfer before any of it is read
+    if (pit_cache_load(size, checksum, &current_pit) == 0) {
+        usb_end_flash_session();
+        return 1;
+    }
+
+    uint32_t mark = mem_scratch_mark();
+    uint8_t* buffer = mem_scratch_alloc(size);
+    int result = (buffer && samsung_receive_pit(buffer, size) == 0) ? 0 : -2;
+    usb_end_flash_session();
+
+    if (result == 0 && crc32_update(0, buffer, size) != checksum) result = -3;
+    if (result == 0 && pit_parse(buffer, size, &current_pit) != 0) result = -3;
+    if (result == 0) {
+        // A card that cannot take it only costs the next session a download
+        pit_cache_save(current_pit.device_name, buffer, size);
+    }
+    mem_scratch_release(mark);
+    return result;
+}
+
+int heimdall_print_pit(void) {
+    if (current_pit.entry_count == 0) return -1;
+    return pit_print(&current_pit);
+}
+
 // --- Flashing Logic ---
 
-int heimdall_flash_file(const char* filename, const char* partition, int (*progress_cb)(float, const char*)) {
-    FILE* f = fopen(filename, "rb");
-    if (!f) return -1;
+void heimdall_set_transfer_config(const TransferConfig* config) {
+    if (config) {
+        transfer_config = *config;
+        transfer_config_set = 1;
+    } else {
+        memset(&transfer_config, 0, sizeof(transfer_config));
+        transfer_config_set = 0;
+    }
+}
 
-    fseek(f, 0, SEEK_END);
-    long total_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+void heimdall_get_transfer_stats(TransferStats* stats) {
+    if (stats) *stats = transfer_stats;
+}
 
-    if (usb_start_flash_session(partition) != 0) {
-        fclose(f);
-        return -2;
+// Keep the device's delta base in step with what was just flashed to
+// partition; after a failure it holds neither image
+static void heimdall_record_base(const char* partition, int flashed) {
+    if (current_pit.entry_count == 0 || !partition) return;
+    if (!flashed || delta_save_manifest(current_pit.device_name, partition) != 0) {
+        delta_forget(current_pit.device_name, partition);
     }
+}
 
-    uint8_t* buffer = malloc(FLASH_CHUNK_SIZE);
-    if (!buffer) {
-        fclose(f);
-        return -3;
+static int heimdall_read_file(void* ctx, uint8_t* buffer, uint32_t length) {
+    // The ring buffers are lent by usb.c, so this lands in DMA-ready memory
+    return fileio_read_direct((FILE*)ctx, buffer, length);
+}
+
+static int heimdall_read_image(void* ctx, uint8_t* buffer, uint32_t length) {
+    return image_read((ImageStream*)ctx, buffer, length);
+}
+
+// An image on the card, ready for the transfer engine
+typedef struct {
+    FILE* file;
+    FileReader* reader;
+    CacheReader* cached;
+    ImageStream image;
+    TransferSource transfer;
+} HeimdallSource;
+
+static int heimdall_read_cached(void* ctx, uint8_t* buffer, uint32_t length) {
+    return cache_read((CacheReader*)ctx, buffer, length);
+}
+
+static int heimdall_open_source(const char* filename, HeimdallSource* source) {
+    memset(source, 0, sizeof(*source));
+    if (image_needs_decoding(filename)) {
+        // Only compressed or sparse bytes come off the SD card; the reader
+        // thread decodes them straight into the transfer ring
+        source->reader = fileio_reader_open(filename, 0);
+        if (!source->reader) return -1;
+
+        FlashSource input;
+        flash_reader_source(source->reader, &input);
+        if (image_open(&source->image, &input, fileio_reader_size(source->reader),
+                       filename) != 0 || source->image.size == 0) {
+            image_close(&source->image);
+            fileio_reader_close(source->reader);
+            return -1;
+        }
+        source->transfer.read = heimdall_read_image;
+        source->transfer.ctx = &source->image;
+        source->transfer.size = source->image.size;
+    } else if ((source->cached = cache_open(filename)) != NULL) {
+        // Repeat flashes of the same image stream from RAM (see cache.h)
+        source->transfer.read = heimdall_read_cached;
+        source->transfer.ctx = source->cached;
+        source->transfer.size = cache_size(source->cached);
+    } else {
+        source->file = fileio_open_direct(filename);
+        if (!source->file) return -1;
+        uint64_t total_size;
+        if (fileio_length(source->file, &total_size) != 0) {
+            fclose(source->file);
+            source->file = NULL;
+            return -1;
+        }
+
+        source->transfer.read = heimdall_read_file;
+        source->transfer.ctx = source->file;
+        source->transfer.size = total_size;
+    }
+    return 0;
+}
+
+static void heimdall_close_source(HeimdallSource* source) {
+    image_close(&source->image);
+    fileio_reader_close(source->reader);
+    cache_close(source->cached);
+    if (source->file) fclose(source->file);
+}
+
+// Continue a flash from its checkpoint. Only the file part protocol can
+// tell the device where to start, so this goes through flash_file.
+static int heimdall_resume_file(const char* filename, const char* partition,
+                                int (*progress_cb)(float, const char*)) {
+    if (usb_start_session() != 0) return -2;
+    int status = (flash_file(filename, partition, progress_cb) == 0) ? 0 : -4;
+    usb_end_flash_session();
+    heimdall_record_base(partition, status == 0);
+    return status;
+}
+
+// The whole parts of a dropped raw stream that reached the device, as a
+// checkpoint heimdall_resume_file can continue from
+static void heimdall_save_checkpoint(const char* filename, const char* partition,
+                                     const TransferSource* source, uint64_t confirmed) {
+    const ImageDigest* digest = source->digest;
+    if (!digest || digest->lost || source->size > 0xFFFFFFFFull) return;
+
+    uint64_t parts = confirmed / DIGEST_BLOCK_SIZE;
+    if (parts > digest->block_count) parts = digest->block_count;
+    if (parts > 0) {
+        flash_save_checkpoint(partition, filename, (uint32_t)source->size, digest->blocks,
+                              (uint32_t)parts);
     }
+}
+
+static int heimdall_flash_file_run(const char* filename, const char* partition,
+                                   int (*progress_cb)(float, const char*)) {
+    if (flash_has_checkpoint(partition)) {
+        return heimdall_resume_file(filename, partition, progress_cb);
+    }
+
+    HeimdallSource input;
+    if (heimdall_open_source(filename, &input) != 0) return -1;
+    TransferSource source = input.transfer;
+
+    // Block CRCs of what goes out, so flash_verify needn't read the file again
+    source.digest = digest_begin(partition, source.size);
 
-    long bytes_sent = 0;
     int status = 0;
-    
-    while (bytes_sent < total_size) {
-        size_t to_read = (total_size - bytes_sent > FLASH_CHUNK_SIZE) ? FLASH_CHUNK_SIZE : (total_size - bytes_sent);
-        size_t read_bytes = fread(buffer, 1, to_read, f);
-        
-        if (usb_send_data(buffer, (uint32_t)read_bytes) != 0) {
+    if (usb_start_flash_session(partition) != 0) {
+        status = -2;
+        goto done;
+    }
+
+    TransferConfig config = transfer_config;
+    int candidate = -1;
+    if (!transfer_config_set && current_pit.entry_count > 0) {
+        candidate = tuner_select(current_pit.device_name, &config);
+    }
+
+    // The reader thread keeps the SD card busy while USB writes are in flight
+    Transfer* transfer = transfer_open(&config, &source);
+    if (!transfer) {
+        usb_end_flash_session();
+        status = -3;
+        goto done;
+    }
+
+    uint8_t* buffer;
+    uint32_t length;
+    int res;
+
+    // Every chunk is counted, but the callback only runs once a frame
+    telemetry_start(source.size);
+    u64 wait_start = gettime();
+    while ((res = transfer_acquire(transfer, &buffer, &length)) > 0) {
+        u64 send_start = gettime();
+        if (flash_abort_requested() || transfer_submit(transfer, buffer, length) != 0) {
             status = -4;
             break;
         }
+        u64 send_end = gettime();
+        telemetry_add(length, ticks_to_microsecs(send_end - send_start),
+                      ticks_to_microsecs(send_start - wait_start));
+        wait_start = send_end;
 
-        bytes_sent += read_bytes;
-        if (progress_cb) {
-            float percent = (float)bytes_sent / (float)total_size;
-            progress_cb(percent, "Transferring...");
+        if (progress_cb && telemetry_due()) {
+            const TelemetryStats* stats = telemetry_get();
+            char status_text[64];
+            telemetry_format("Transferring", status_text, sizeof(status_text));
+            progress_cb((float)stats->bytes / (float)source.size, status_text);
         }
     }
+    if (res < 0) status = -4;
 
+    if (transfer_close(transfer, &transfer_stats) != 0) status = -4;
+    if (status == 0 && transfer_stats.bytes != source.size) status = -4;
+    if (status == -4 && !flash_abort_requested()) {
+        heimdall_save_checkpoint(filename, partition, &source, transfer_stats.confirmed);
+    }
+    perf_add(PERF_SD_READ, transfer_stats.read_us);
+    perf_add(PERF_CHECKSUM, transfer_stats.checksum_us);
+    perf_add(PERF_USB, telemetry_get()->busy_us);
+    perf_add_bytes(transfer_stats.bytes);
     usb_end_flash_session();
-    free(buffer);
-    fclose(f);
+
+    // A cancelled flash says nothing about the setting it ran with
+    if (candidate >= 0 && !flash_abort_requested()) {
+        tuner_record(current_pit.device_name, candidate, transfer_stats.bytes,
+                     transfer_stats.elapsed_us, status == 0);
+    }
+
+done:
+    if (status == 0) {
+        digest_finish(source.digest);
+    } else {
+        digest_discard(source.digest);
+    }
+    if (status != -1) heimdall_record_base(partition, status == 0);
+    heimdall_close_source(&input);
     return status;
 }
+
+int heimdall_flash_file(const char* filename, const char* partition, int (*progress_cb)(float, const char*)) {
+    perf_begin();
+    int result = heimdall_flash_file_run(filename, partition, progress_cb);
+    perf_end("flash", partition, result);
+    return result;
+}
+
+// --- Several Devices ---
+
+static int heimdall_flash_multi_run(UsbDevice* const* devices, uint32_t count,
+                                    const char* filename, const char* partition,
+                                    ProgressCallback callback) {
+    HeimdallSource input;
+    if (!devices || count == 0 || !partition) return -1;
+    if (heimdall_open_source(filename, &input) != 0) return -1;
+
+    // Every phone gets the same bytes, so one digest covers them all
+    input.transfer.digest = digest_begin(partition, input.transfer.size);
+    int result = multi_flash(devices, count, &input.transfer, partition,
+                             &transfer_config, callback);
+    if (result == 0) {
+        digest_finish(input.transfer.digest);
+    } else {
+        digest_discard(input.transfer.digest);
+    }
+    if (result != -1) heimdall_record_base(partition, result == 0);
+
+    heimdall_close_source(&input);
+    return result;
+}
+
+int heimdall_flash_multi(UsbDevice* const* devices, uint32_t count, const char* filename,
+                         const char* partition, ProgressCallback callback) {
+    perf_begin();
+    int result = heimdall_flash_multi_run(devices, count, filename, partition, callback);
+    perf_end("multi", partition, result);
+    return result;
+}
+
+// --- Odin Packages ---
+
+int heimdall_is_package(const char* filename) {
+    if (!filename) return 0;
+    size_t length = strlen(filename);
+    return (length > 4 && strcasecmp(filename + length - 4, ".tar") == 0) ||
+           (length > 8 && strcasecmp(filename + length - 8, ".tar.md5") == 0);
+}
+
+static int heimdall_flash_package_run(const char* filename, ProgressCallback callback) {
+    // Without a PIT, members fall back to the filename map
+    const PitInfo* pit = (current_pit.entry_count > 0) ? &current_pit : NULL;
+
+    if (usb_start_session() != 0) return -2;
+    int result = odin_flash_package(filename, pit, callback);
+    usb_end_flash_session();
+
+    // Members flashed before a failure still went through. Only this
+    // package's: the digest table may still hold earlier flashes.
+    const OdinReport* report = odin_get_report();
+    char partition[32];
+    uint32_t flashed = (report->flashed < ODIN_MAX_FLASHED) ? report->flashed : ODIN_MAX_FLASHED;
+    for (uint32_t i = 0; i < flashed; i++) {
+        heimdall_record_base(report->flashed_partitions[i], 1);
+    }
+    if (report->failed_member[0] &&
+        odin_map_partition(pit, report->failed_member, partition, sizeof(partition)) == 0) {
+        heimdall_record_base(partition, 0);
+    }
+
+    return result;
+}
+
+int heimdall_flash_package(const char* filename, ProgressCallback callback) {
+    perf_begin();
+    int result = heimdall_flash_package_run(filename, callback);
+    perf_end("package", filename, result);
+    return result;
+}
+
+// --- Batches ---
+
+int heimdall_flash_batch(ProgressCallback callback) {
+    perf_begin();
+    int result = batch_run(callback);
+    perf_end("batch", "-", result);
+
+    const BatchReport* report = batch_get_report();
+    for (uint32_t i = 0; i < report->count; i++) {
+        if (report->items[i].result != BATCH_ITEM_PENDING) {
+            heimdall_record_base(report->items[i].partition, report->items[i].result == 0);
+        }
+    }
+    return result;
+}
+
+// --- Delta Flashing ---
+
+static FlashReport delta_report;
+
+static int heimdall_flash_delta_run(const char* filename, const char* partition,
+                                    ProgressCallback callback) {
+    memset(&delta_report, 0, sizeof(delta_report));
+
+    // The base is per device and the ranges are checked against its PIT
+    PitEntry entry;
+    if (!filename || !partition || current_pit.entry_count == 0 ||
+        pit_find_partition(&current_pit, partition, &entry) != 0) {
+        return -1;
+    }
+    uint32_t block_size = entry.block_size ? entry.block_size : 512;
+    uint64_t capacity = (uint64_t)entry.block_count * block_size;
+
+    FileReader* reader = fileio_reader_open(filename, 0);
+    if (!reader) return -1;
+
+    FlashSource input;
+    ImageStream image;
+    flash_reader_source(reader, &input);
+    if (image_open(&image, &input, fileio_reader_size(reader), filename) != 0 ||
+        image.size == 0 || image.size > 0xFFFFFFFFull ||
+        (entry.block_count > 0 && image.size > capacity)) {
+        image_close(&image);
+        fileio_reader_close(reader);
+        return -1;
+    }
+
+    // Compared blocks must start and end on the partition's own blocks,
+    // or an unchanged one could share a PIT block with a changed one
+    DeltaManifest manifest;
+    int have_base = (DIGEST_BLOCK_SIZE % block_size == 0 &&
+                     delta_load_manifest(current_pit.device_name, entry.partition_name,
+                                         &manifest) == 0);
+    FlashBase base;
+    if (have_base) {
+        base.blocks = manifest.blocks;
+        base.block_count = manifest.block_count;
+        base.length = manifest.length;
+    }
+
+    int result = -2;
+    if (usb_start_session() == 0) {
+        result = flash_stream_delta(&image.source, (uint32_t)image.size,
+                                    entry.partition_name, have_base ? &base : NULL,
+                                    callback) == 0 ? 0 : -4;
+        delta_report = *flash_get_report();
+    }
+    usb_end_flash_session();
+
+    if (have_base) delta_free_manifest(&manifest);
+    image_close(&image);
+    fileio_reader_close(reader);
+
+    if (result != -2) heimdall_record_base(entry.partition_name, result == 0);
+    return result;
+}
+
+int heimdall_flash_delta(const char* filename, const char* partition,
+                         ProgressCallback callback) {
+    perf_begin();
+    int result = heimdall_flash_delta_run(filename, partition, callback);
+    perf_end("delta", partition, result);
+    return result;
+}
+
+const FlashReport* heimdall_get_delta_report(void) {
+    return &delta_report;
+}
+
+// --- Backups ---
+
+int heimdall_backup_partition(const char* partition, ProgressCallback callback) {
+    // The dump is as long as the PIT says the partition is
+    PitEntry entry;
+    if (!partition || pit_find_partition(&current_pit, partition, &entry) != 0) return -1;
+
+    uint64_t size = (uint64_t)entry.block_count * (entry.block_size ? entry.block_size : 512);
+    perf_begin();
+    int result = backup_partition(entry.partition_name, size, BACKUP_DIRECTORY, callback);
+    perf_end("backup", entry.partition_name, result);
+    return result;
+}
+
+// --- Utilities ---
+
+uint32_t heimdall_calculate_checksum(const uint8_t* data, uint32_t length) {
+    if (!data) return 0;
+    return crc32_update(0, data, length);
+}
@@ -5,6 +5,8 @@
 #include <gccore.h>
 #include <stdint.h>
 #include "pit.h"
+#include "transfer.h"
+#include "flash.h"
 
 // Callback types
 typedef int (*ProgressCallback)(float progress, const char* status);
@@ -17,12 +19,42 @@ int heimdall_detect_device(void);
 int heimdall_load_pit(const char* filename);
 PitInfo* heimdall_get_pit_info(void);
 const char* heimdall_determine_partition(const char* filename);
+// A dropped link leaves a checkpoint of what reached the device; flashing
+// the same file again continues from it (see flash.h)
 int heimdall_flash_file(const char* filename, const char* partition, 
                        ProgressCallback callback);
+// The same image to every device at once, read off the card once (see
+// multi.h). Returns 0, -1 bad image, -2 no device answered, -3 setup
+// failed, -4 a device failed (multi_get_report says which).
+int heimdall_flash_multi(UsbDevice* const* devices, uint32_t count, const char* filename,
+                         const char* partition, ProgressCallback callback);
+// Odin .tar/.tar.md5: every member goes to its PIT partition in one session
+int heimdall_flash_package(const char* filename, ProgressCallback callback);
+int heimdall_is_package(const char* filename);
+// Every queued image in one session (see batch.h)
+int heimdall_flash_batch(ProgressCallback callback);
+// Send only the blocks that differ from the image last flashed to this
+// device's partition (see delta.h); a full flash when there is no base.
+// Needs a PIT. Returns 0, -1 bad image or partition, -2 USB, -4 flash failed
+int heimdall_flash_delta(const char* filename, const char* partition,
+                         ProgressCallback callback);
+const FlashReport* heimdall_get_delta_report(void);
+// Dump a PIT partition to sd:/backup/<partition>.img (see backup.h)
+int heimdall_backup_partition(const char* partition, ProgressCallback callback);
 int heimdall_reboot(void);
+// Fetch the connected device's PIT and make it the loaded one, reusing the
+// copy on the card when the device reports the same table (see pitcache.h).
+// Returns 0 downloaded, 1 taken from the card, -1 no device or session,
+// -2 the device sent no PIT, -3 the PIT it sent is damaged.
 int heimdall_download_pit(void);
+// The loaded PIT to the console; -1 when none is loaded
 int heimdall_print_pit(void);
 
+// Transfer pipeline tuning and stats of the last flash. A config set here
+// is used as it is; NULL hands the choice back to the tuner (see tuner.h).
+void heimdall_set_transfer_config(const TransferConfig* config);
+void heimdall_get_transfer_stats(TransferStats* stats);
+
 // Callback setters
 void heimdall_set_progress_callback(ProgressCallback cb);
 void heimdall_set_log_callback(LogCallback cb);
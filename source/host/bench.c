@@ -0,0 +1,1977 @@
+// source/host/bench.c
+// Throughput benchmark for the flashing core against the simulated device.
+// Usage: heimdall-bench [-s image_mb] [-p pit_iterations]
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <utime.h>
+#include "heimdall.h"
+#include "flash.h"
+#include "usb.h"
+#include "usb_sim.h"
+#include "pit.h"
+#include "crc32.h"
+#include "md5.h"
+#include "odin.h"
+#include "lz4.h"
+#include "image.h"
+#include "digest.h"
+#include "backup.h"
+#include "batch.h"
+#include "delta.h"
+#include "worker.h"
+#include "telemetry.h"
+#include "perf.h"
+#include "tuner.h"
+#include "multi.h"
+#include "cache.h"
+#include "mem.h"
+#include "pitcache.h"
+
+typedef struct {
+    char path[64];
+    uint32_t size;              // Bytes flashed
+    uint32_t checksum;          // CRC32 of those bytes
+    uint32_t file_size;         // Bytes read from the card
+} BenchImage;
+
+static BenchImage raw_image;
+static BenchImage lz4_image;
+static BenchImage sparse_file;     // A sparse image sent as it is
+static BenchImage sparse_image;    // The same image expanded
+static char package_path[64];
+
+static double seconds_since(u64 start) {
+    return (double)ticks_to_microsecs(gettime() - start) / 1000000.0;
+}
+
+static double mb_per_sec(uint64_t bytes, double seconds) {
+    return (seconds > 0.0) ? ((double)bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+static int make_image(uint32_t size) {
+    strcpy(raw_image.path, "/tmp/heimdall-bench-XXXXXX");
+    int fd = mkstemp(raw_image.path);
+    if (fd < 0) return -1;
+
+    FILE* f = fdopen(fd, "wb");
+    uint8_t block[4096];
+    uint32_t seed = 0x12345678;
+    for (uint32_t written = 0; written < size; written += sizeof(block)) {
+        for (uint32_t i = 0; i < sizeof(block); i++) {
+            seed = seed * 1103515245 + 12345;
+            block[i] = (uint8_t)(seed >> 16);
+        }
+        uint32_t n = (size - written < sizeof(block)) ? size - written : sizeof(block);
+        fwrite(block, 1, n, f);
+        raw_image.checksum = crc32_update(raw_image.checksum, block, n);
+    }
+    fclose(f);
+
+    raw_image.size = size;
+    raw_image.file_size = size;
+    return 0;
+}
+
+// --- Sparse Test Images ---
+
+static void sparse_put_chunk(FILE* f, uint16_t type, uint32_t blocks, uint32_t total) {
+    uint8_t header[12] = { (uint8_t)type, (uint8_t)(type >> 8), 0, 0,
+                           (uint8_t)blocks, (uint8_t)(blocks >> 8),
+                           (uint8_t)(blocks >> 16), (uint8_t)(blocks >> 24),
+                           (uint8_t)total, (uint8_t)(total >> 8),
+                           (uint8_t)(total >> 16), (uint8_t)(total >> 24) };
+    fwrite(header, 1, sizeof(header), f);
+}
+
+// Mostly empty, like a freshly made cache or userdata image: every 1MB
+// has 64KB of data, 32KB of a fill pattern and 928KB nobody cares about.
+// A CRC32 chunk at the end covers the whole expanded image.
+static int make_sparse_image(uint32_t megabytes) {
+    const uint32_t block = 4096;
+    const uint32_t per_mb = (1024 * 1024) / block;
+    const uint32_t raw_blocks = 16, fill_blocks = 8;
+    const uint32_t skip_blocks = per_mb - raw_blocks - fill_blocks;
+    static const uint8_t pattern[4] = { 0xEF, 0xBE, 0xAD, 0xDE };
+
+    strcpy(sparse_file.path, "/tmp/heimdall-bench-XXXXXX.img");
+    int fd = mkstemps(sparse_file.path, 4);
+    if (fd < 0) return -1;
+    FILE* f = fdopen(fd, "wb");
+    uint8_t* data = malloc(raw_blocks * block);
+    uint8_t* expanded = calloc(1, 1024 * 1024);
+    if (!f || !data || !expanded) {
+        if (f) fclose(f);
+        free(data);
+        free(expanded);
+        return -1;
+    }
+
+    uint32_t total_blocks = megabytes * per_mb;
+    uint32_t chunks = megabytes * 3 + 1;
+    uint8_t header[28] = { 0x3A, 0xFF, 0x26, 0xED, 1, 0, 0, 0, 28, 0, 12, 0 };
+    uint32_t fields[4] = { block, total_blocks, chunks, 0 };
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 4; b++) header[12 + i * 4 + b] = (uint8_t)(fields[i] >> (8 * b));
+    }
+    fwrite(header, 1, sizeof(header), f);
+
+    uint32_t crc = 0;
+    uint32_t seed = 0x13579BDF;
+    for (uint32_t mb = 0; mb < megabytes; mb++) {
+        for (uint32_t i = 0; i < raw_blocks * block; i++) {
+            seed = seed * 1103515245 + 12345;
+            data[i] = (uint8_t)(seed >> 16);
+        }
+        sparse_put_chunk(f, SPARSE_CHUNK_RAW, raw_blocks, 12 + raw_blocks * block);
+        fwrite(data, 1, raw_blocks * block, f);
+        sparse_put_chunk(f, SPARSE_CHUNK_FILL, fill_blocks, 16);
+        fwrite(pattern, 1, 4, f);
+        sparse_put_chunk(f, SPARSE_CHUNK_DONT_CARE, skip_blocks, 12);
+
+        memcpy(expanded, data, raw_blocks * block);
+        for (uint32_t i = 0; i < fill_blocks * block; i += 4) {
+            memcpy(expanded + raw_blocks * block + i, pattern, 4);
+        }
+        crc = crc32_update(crc, expanded, 1024 * 1024);
+    }
+    sparse_put_chunk(f, SPARSE_CHUNK_CRC32, 0, 16);
+    uint8_t value[4] = { (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16),
+                         (uint8_t)(crc >> 24) };
+    fwrite(value, 1, 4, f);
+    fclose(f);
+    free(data);
+    free(expanded);
+
+    // Sent as it is, the file itself is the image
+    uint32_t length;
+    uint8_t* file = fileio_read_file(sparse_file.path, &length);
+    if (!file) return -1;
+    sparse_file.size = length;
+    sparse_file.file_size = length;
+    sparse_file.checksum = crc32_update(0, file, length);
+    fileio_free_file(file);
+
+    sparse_image = sparse_file;
+    sparse_image.size = megabytes * 1024 * 1024;
+    sparse_image.checksum = crc;
+    return 0;
+}
+
+// --- LZ4 Test Images ---
+
+static inline uint32_t bench_load32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// Frame header checksum: xxHash32 of a descriptor shorter than 16 bytes
+static uint8_t lz4_header_checksum(const uint8_t* p, uint32_t length) {
+    uint32_t acc = 374761393u + length;
+    uint32_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t word = (uint32_t)p[i] | ((uint32_t)p[i + 1] << 8) |
+                        ((uint32_t)p[i + 2] << 16) | ((uint32_t)p[i + 3] << 24);
+        acc += word * 3266489917u;
+        acc = ((acc << 17) | (acc >> 15)) * 668265263u;
+    }
+    for (; i < length; i++) {
+        acc += p[i] * 374761393u;
+        acc = ((acc << 11) | (acc >> 21)) * 2654435761u;
+    }
+    acc ^= acc >> 15;
+    acc *= 2246822519u;
+    acc ^= acc >> 13;
+    acc *= 3266489917u;
+    acc ^= acc >> 16;
+    return (uint8_t)(acc >> 8);
+}
+
+// Full xxHash32, for block checksums
+static uint32_t bench_xxh32(const uint8_t* p, uint32_t length) {
+    const uint8_t* const end = p + length;
+    uint32_t acc;
+    if (length >= 16) {
+        uint32_t v[4] = { 2654435761u + 2246822519u, 2246822519u, 0, 0u - 2654435761u };
+        for (; p + 16 <= end; p += 16) {
+            for (int i = 0; i < 4; i++) {
+                v[i] += bench_load32(p + i * 4) * 2246822519u;
+                v[i] = ((v[i] << 13) | (v[i] >> 19)) * 2654435761u;
+            }
+        }
+        acc = ((v[0] << 1) | (v[0] >> 31)) + ((v[1] << 7) | (v[1] >> 25)) +
+              ((v[2] << 12) | (v[2] >> 20)) + ((v[3] << 18) | (v[3] >> 14));
+    } else {
+        acc = 374761393u;
+    }
+    acc += length;
+    for (; p + 4 <= end; p += 4) {
+        acc += bench_load32(p) * 3266489917u;
+        acc = ((acc << 17) | (acc >> 15)) * 668265263u;
+    }
+    for (; p < end; p++) {
+        acc += *p * 374761393u;
+        acc = ((acc << 11) | (acc >> 21)) * 2654435761u;
+    }
+    acc ^= acc >> 15;
+    acc *= 2246822519u;
+    acc ^= acc >> 13;
+    acc *= 3266489917u;
+    acc ^= acc >> 16;
+    return acc;
+}
+
+static uint8_t* lz4_put_length(uint8_t* op, uint32_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Greedy single-probe LZ4 block compressor, just enough to make test images
+static uint32_t lz4_compress_block(const uint8_t* src, uint32_t length, uint8_t* dst) {
+    static uint32_t table[4096];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* const iend = src + length;
+    const uint8_t* const match_limit = (length > 12) ? iend - 12 : src;
+    uint8_t* op = dst;
+
+    while (ip < match_limit) {
+        uint32_t sequence = bench_load32(ip);
+        uint32_t hash = (sequence * 2654435761u) >> 20;
+        const uint8_t* ref = src + table[hash] - 1;
+        table[hash] = (uint32_t)(ip - src) + 1;
+
+        if (ref < src || ip - ref > 65535 || bench_load32(ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        const uint8_t* end = ip + 4;
+        const uint8_t* from = ref + 4;
+        while (end < iend - 5 && *end == *from) {
+            end++;
+            from++;
+        }
+
+        uint32_t literal = (uint32_t)(ip - anchor);
+        uint32_t match = (uint32_t)(end - ip) - 4;
+        *op++ = (uint8_t)(((literal < 15) ? literal : 15) << 4 | ((match < 15) ? match : 15));
+        if (literal >= 15) op = lz4_put_length(op, literal - 15);
+        memcpy(op, anchor, literal);
+        op += literal;
+        uint32_t offset = (uint32_t)(ip - ref);
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if (match >= 15) op = lz4_put_length(op, match - 15);
+
+        ip = end;
+        anchor = ip;
+    }
+
+    uint32_t literal = (uint32_t)(iend - anchor);
+    *op++ = (uint8_t)(((literal < 15) ? literal : 15) << 4);
+    if (literal >= 15) op = lz4_put_length(op, literal - 15);
+    memcpy(op, anchor, literal);
+    op += literal;
+
+    return (uint32_t)(op - dst);
+}
+
+// A filesystem-like image (random files, text, empty space) as an LZ4
+// frame with 1MB independent blocks and the content size recorded
+static int make_lz4_image(uint32_t size) {
+    const uint32_t block_size = 1024 * 1024;
+    strcpy(lz4_image.path, "/tmp/heimdall-bench-XXXXXX.img.lz4");
+    int fd = mkstemps(lz4_image.path, 8);
+    if (fd < 0) return -1;
+
+    FILE* f = fdopen(fd, "wb");
+    uint8_t* raw = malloc(block_size);
+    uint8_t* packed = malloc(block_size + block_size / 255 + 16);
+    if (!f || !raw || !packed) {
+        if (f) fclose(f);
+        free(raw);
+        free(packed);
+        return -1;
+    }
+
+    uint8_t header[15] = { 0x04, 0x22, 0x4D, 0x18, 0x68, 0x60 };
+    for (int i = 0; i < 8; i++) {
+        header[6 + i] = (uint8_t)((uint64_t)size >> (8 * i));
+    }
+    header[14] = lz4_header_checksum(header + 4, 10);
+    fwrite(header, 1, sizeof(header), f);
+
+    static const char text[] = "ro.build.fingerprint=samsung/bench/system:user/release-keys\n";
+    uint32_t seed = 0x2468ACE0;
+    for (uint32_t done = 0; done < size; done += block_size) {
+        uint32_t n = (size - done < block_size) ? size - done : block_size;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t region = ((done + i) >> 16) % 4;
+            if (region == 0) {
+                seed = seed * 1103515245 + 12345;
+                raw[i] = (uint8_t)(seed >> 16);
+            } else if (region == 1) {
+                raw[i] = (uint8_t)text[(done + i) % (sizeof(text) - 1)];
+            } else {
+                raw[i] = 0;
+            }
+        }
+        lz4_image.checksum = crc32_update(lz4_image.checksum, raw, n);
+
+        uint32_t packed_size = lz4_compress_block(raw, n, packed);
+        uint32_t word = packed_size;
+        const uint8_t* body = packed;
+        if (packed_size >= n) {
+            word = n | 0x80000000u; // Stored
+            body = raw;
+            packed_size = n;
+        }
+        uint8_t prefix[4] = { (uint8_t)word, (uint8_t)(word >> 8),
+                              (uint8_t)(word >> 16), (uint8_t)(word >> 24) };
+        fwrite(prefix, 1, 4, f);
+        fwrite(body, 1, packed_size, f);
+    }
+    uint8_t end_mark[4] = { 0, 0, 0, 0 };
+    fwrite(end_mark, 1, 4, f);
+
+    lz4_image.size = size;
+    lz4_image.file_size = (uint32_t)ftell(f);
+    fclose(f);
+    free(raw);
+    free(packed);
+    return 0;
+}
+
+static void tar_write_header(FILE* f, Md5Context* md5, const char* name, uint32_t size) {
+    uint8_t header[512];
+    memset(header, 0, sizeof(header));
+    snprintf((char*)header, 100, "%s", name);
+    snprintf((char*)header + 100, 8, "%07o", 0644);
+    snprintf((char*)header + 124, 12, "%011o", size);
+    snprintf((char*)header + 136, 12, "%011o", 0);
+    header[156] = '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+
+    uint32_t sum = 0;
+    memset(header + 148, ' ', 8);
+    for (int i = 0; i < 512; i++) sum += header[i];
+    snprintf((char*)header + 148, 8, "%06o", sum);
+    header[155] = ' ';
+
+    fwrite(header, 1, sizeof(header), f);
+    md5_update(md5, header, sizeof(header));
+}
+
+static void tar_write_data(FILE* f, Md5Context* md5, const uint8_t* data, uint32_t size) {
+    fwrite(data, 1, size, f);
+    md5_update(md5, data, size);
+}
+
+// Odin-style AP package: a small boot image, the bench image as system,
+// something unflashable, end blocks, then the appended MD5 line
+static int make_package(void) {
+    strcpy(package_path, "/tmp/heimdall-bench-XXXXXX.tar.md5");
+    int fd = mkstemps(package_path, 8);
+    if (fd < 0) return -1;
+
+    FILE* f = fdopen(fd, "wb");
+    FILE* image = fopen(raw_image.path, "rb");
+    uint8_t* block = malloc(0x10000);
+    if (!f || !image || !block) {
+        if (f) fclose(f);
+        if (image) fclose(image);
+        free(block);
+        return -1;
+    }
+
+    Md5Context md5;
+    md5_init(&md5);
+    uint8_t zero[512];
+    memset(zero, 0, sizeof(zero));
+
+    uint32_t boot_size = 1024 * 1024 + 700;
+    tar_write_header(f, &md5, "boot.img", boot_size);
+    for (uint32_t done = 0; done < boot_size; ) {
+        uint32_t n = (boot_size - done < 0x10000) ? boot_size - done : 0x10000;
+        memset(block, 0xB0, n);
+        tar_write_data(f, &md5, block, n);
+        done += n;
+    }
+    tar_write_data(f, &md5, zero, 512 - boot_size % 512);
+
+    tar_write_header(f, &md5, "meta-data/fota.zip", 1000);
+    memset(block, 0x11, 1000);
+    tar_write_data(f, &md5, block, 1000);
+    tar_write_data(f, &md5, zero, 24);
+
+    tar_write_header(f, &md5, "system.img.ext4", raw_image.size);
+    size_t n;
+    while ((n = fread(block, 1, 0x10000, image)) > 0) {
+        tar_write_data(f, &md5, block, (uint32_t)n);
+    }
+    if (raw_image.size % 512) tar_write_data(f, &md5, zero, 512 - raw_image.size % 512);
+
+    tar_write_data(f, &md5, zero, 512);
+    tar_write_data(f, &md5, zero, 512);
+
+    uint8_t digest[16];
+    char hex[33];
+    md5_final(&md5, digest);
+    md5_to_hex(digest, hex);
+    fprintf(f, "%s  AP_BENCH.tar\n", hex);
+
+    fclose(image);
+    fclose(f);
+    free(block);
+    return 0;
+}
+
+// Point usb.c at a fresh simulated device
+static UsbSim* attach_sim(const UsbSimConfig* config) {
+    UsbSim* sim = usb_sim_create(config);
+    if (!sim) return NULL;
+    usb_set_transport(usb_sim_transport(sim));
+    if (usb_init_device() != 0 || usb_open_device(0) != 0) {
+        usb_sim_destroy(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+static void detach_sim(UsbSim* sim) {
+    usb_set_transport(NULL);
+    usb_sim_destroy(sim);
+}
+
+// --- Several Devices ---
+
+static UsbSim* unplug_sim;
+
+// Pull one phone's cable half way through
+static int unplug_progress(float progress, const char* status) {
+    if (unplug_sim && progress >= 0.5f) {
+        usb_sim_unplug(unplug_sim);
+        unplug_sim = NULL;
+    }
+    return 1;
+}
+
+// One read of the image feeds every device; with one unplugged half way
+// the others still finish
+static int bench_multi(const char* label, const UsbSimConfig* config, uint32_t count,
+                       int unplug_one) {
+    UsbSim* sims[MULTI_MAX_DEVICES];
+    UsbDevice* devices[MULTI_MAX_DEVICES];
+    uint32_t made = 0;
+    for (; made < count; made++) {
+        sims[made] = usb_sim_create(config);
+        devices[made] = sims[made] ? usb_device_create(usb_sim_transport(sims[made])) : NULL;
+        if (!devices[made]) {
+            usb_sim_destroy(sims[made]);
+            break;
+        }
+    }
+
+    int result = -1;
+    double elapsed = 0;
+    if (made == count) {
+        unplug_sim = unplug_one ? sims[count - 1] : NULL;
+        u64 start = gettime();
+        result = heimdall_flash_multi(devices, count, raw_image.path, "SYSTEM",
+                                      unplug_one ? unplug_progress : NULL);
+        elapsed = seconds_since(start);
+        unplug_sim = NULL;
+    }
+
+    const MultiReport* report = multi_get_report();
+    uint32_t complete = 0;
+    for (uint32_t i = 0; i < made; i++) {
+        UsbSimStats stats;
+        usb_sim_get_stats(sims[i], &stats);
+        if (stats.payload_bytes == raw_image.size && report->targets[i].result == 0) complete++;
+        usb_device_destroy(devices[i]);
+        usb_sim_destroy(sims[i]);
+    }
+
+    uint32_t expected = unplug_one ? count - 1 : count;
+    if (made != count || complete != expected || report->flashed != expected ||
+        report->read_bytes != raw_image.size || result != (unplug_one ? -4 : 0)) {
+        printf("  %-28s FAILED (%d, %u of %u devices complete, %llu bytes read)\n", label,
+               result, complete, count, (unsigned long long)report->read_bytes);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u devices, %.1f MB/s to the bus, image read once, %u failed\n",
+           label, mb_per_sec(raw_image.size, elapsed), count,
+           mb_per_sec((uint64_t)raw_image.size * complete, elapsed), report->failed);
+    return 0;
+}
+
+// --- Image Cache ---
+
+// One flash through the cache; ram and card are what it served from each
+static int cache_flash(const UsbSimConfig* config, uint64_t* ram, uint64_t* card,
+                       double* elapsed) {
+    CacheStats before = *cache_get_stats();
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+    u64 start = gettime();
+    int result = heimdall_flash_file(raw_image.path, "SYSTEM", NULL);
+    *elapsed = seconds_since(start);
+
+    TransferStats stats;
+    UsbSimStats sim_stats;
+    heimdall_get_transfer_stats(&stats);
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    *ram = cache_get_stats()->ram_bytes - before.ram_bytes;
+    *card = cache_get_stats()->card_bytes - before.card_bytes;
+    if (result != 0 || sim_stats.payload_bytes != raw_image.size ||
+        stats.checksum != raw_image.checksum) {
+        return -1;
+    }
+    return 0;
+}
+
+// Repeat flashes come from RAM; with half the budget only the head does,
+// and a touched file is read from the card again
+static int bench_cache(const char* label, const UsbSimConfig* config) {
+    uint32_t full = (raw_image.size + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+    uint32_t half = full / 2 / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+    uint64_t ram[5], card[5];
+    double elapsed[5];
+    int result = 0;
+
+    cache_set_budget(full);
+    result |= cache_flash(config, &ram[0], &card[0], &elapsed[0]);   // Fills
+    result |= cache_flash(config, &ram[1], &card[1], &elapsed[1]);   // Hit
+    cache_set_budget(half);                                          // Evicts it
+    result |= cache_flash(config, &ram[2], &card[2], &elapsed[2]);   // Fills the head
+    result |= cache_flash(config, &ram[3], &card[3], &elapsed[3]);   // Head hit
+    struct utimbuf times = { time(NULL) + 10, time(NULL) + 10 };
+    utime(raw_image.path, &times);
+    result |= cache_flash(config, &ram[4], &card[4], &elapsed[4]);   // Stale
+    const CacheStats* stats = cache_get_stats();
+    uint32_t hits = stats->hits, partial = stats->partial_hits;
+    cache_set_budget(0);
+
+    if (result != 0 || ram[0] != 0 || card[1] != 0 || ram[1] != raw_image.size ||
+        ram[3] != half || card[3] != raw_image.size - half || ram[4] != 0 ||
+        hits != 1 || partial != 1 || stats->entries != 0) {
+        printf("  %-28s FAILED (%d, ram %llu/%llu/%llu, card %llu/%llu, %u hits)\n", label,
+               result, (unsigned long long)ram[1], (unsigned long long)ram[3],
+               (unsigned long long)ram[4], (unsigned long long)card[1],
+               (unsigned long long)card[3], hits);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  from RAM, %.1f MB/s first run, %.1f MB/s with %u MB head, "
+           "%u evictions\n",
+           label, mb_per_sec(raw_image.size, elapsed[1]), mb_per_sec(raw_image.size, elapsed[0]),
+           mb_per_sec(raw_image.size, elapsed[3]), half >> 20, stats->evictions);
+    return 0;
+}
+
+// --- Buffer Pools ---
+
+static int mem_flash(const UsbSimConfig* config, const BenchImage* image) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+    int result = heimdall_flash_file(image->path, "SYSTEM", NULL);
+    TransferStats stats;
+    heimdall_get_transfer_stats(&stats);
+    detach_sim(sim);
+    return (result != 0 || stats.checksum != image->checksum) ? -1 : 0;
+}
+
+// Once every path has run, repeat flashes take their buffers from the
+// pools already carved and give all of them back
+static int bench_mem(const char* label, const UsbSimConfig* config) {
+    const BenchImage* images[] = { &raw_image, &lz4_image, &sparse_file };
+    const int count = sizeof(images) / sizeof(images[0]);
+    int result = 0;
+
+    for (int i = 0; i < count; i++) result |= mem_flash(config, images[i]);
+    mem_reset_high_water();
+    MemStats before = *mem_get_stats();
+
+    u64 start = gettime();
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < count; i++) result |= mem_flash(config, images[i]);
+    }
+    double elapsed = seconds_since(start);
+    const MemStats* after = mem_get_stats();
+
+    int leaked = 0;
+    for (int i = 0; i < MEM_POOLS; i++) leaked |= after->pools[i].in_use != before.pools[i].in_use;
+    if (result != 0 || leaked || after->heap_in_use != before.heap_in_use ||
+        after->arena_used != before.arena_used) {
+        printf("  %-28s FAILED (%d, in use %u/%u, heap %u/%u)\n", label, result,
+               after->pools[0].in_use + after->pools[1].in_use,
+               before.pools[0].in_use + before.pools[1].in_use,
+               after->heap_in_use, before.heap_in_use);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f ms/flash, peak %u/%u small, %u/%u large, %u heap allocs\n", label,
+           elapsed * 1000 / (3 * count), after->pools[0].high_water, after->pools[0].count,
+           after->pools[1].high_water, after->pools[1].count,
+           after->heap_allocs - before.heap_allocs);
+    return 0;
+}
+
+// --- Device Session ---
+
+// Detect -> flash -> detect -> reboot: the bus is set up once and the open
+// handle is reused until the phone leaves it
+static int bench_session(const char* label, const UsbSimConfig* config) {
+    UsbSim* sim = usb_sim_create(config);
+    if (!sim) return -1;
+    usb_set_transport(usb_sim_transport(sim));
+    UsbSessionStats before = *usb_get_session_stats();
+
+    u64 start = gettime();
+    int result = heimdall_detect_device();
+    double first = seconds_since(start);
+
+    start = gettime();
+    for (int i = 0; i < 10 && result == 0; i++) result = heimdall_detect_device();
+    double reused = seconds_since(start) / 10;
+
+    const UsbDeviceInfo* info = usb_get_device_info();
+    if (result == 0) result = heimdall_flash_file(raw_image.path, "SYSTEM", NULL);
+    if (result == 0) result = heimdall_detect_device();
+    if (result == 0) result = heimdall_reboot();
+    // Back in download mode after the reboot, then a cable pull
+    if (result == 0) result = heimdall_detect_device();
+    usb_sim_unplug(sim);
+    if (result == 0) result = heimdall_detect_device();
+
+    UsbSimStats stats;
+    usb_sim_get_stats(sim, &stats);
+    const UsbSessionStats* session = usb_get_session_stats();
+    uint32_t reuses = session->reuses - before.reuses;
+    detach_sim(sim);
+
+    if (result != 0 || !info || info->endpoint_in != 0x81 || stats.inits != 1 ||
+        stats.opens != 3 || reuses != 11 || stats.reboots != 1) {
+        printf("  %-28s FAILED (%d, %u inits, %u opens, %u reuses)\n", label, result,
+               stats.inits, stats.opens, reuses);
+        return -1;
+    }
+
+    printf("  %-28s first detect %.1f us, reused %.2f us, %u opens for 13 detects, "
+           "endpoints %02x/%02x\n",
+           label, first * 1000000.0, reused * 1000000.0, stats.opens,
+           info->endpoint_out, info->endpoint_in);
+    return 0;
+}
+
+// --- Flash Pipeline ---
+
+static int bench_raw_stream(const char* label, const UsbSimConfig* config,
+                            const BenchImage* image) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+
+    u64 start = gettime();
+    int result = heimdall_flash_file(image->path, "SYSTEM", NULL);
+    double elapsed = seconds_since(start);
+
+    TransferStats stats;
+    UsbSimStats sim_stats;
+    heimdall_get_transfer_stats(&stats);
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    if (result != 0 || sim_stats.payload_bytes != image->size ||
+        stats.checksum != image->checksum) {
+        printf("  %-28s FAILED (%d, %llu of %u bytes, crc %08x)\n", label, result,
+               (unsigned long long)sim_stats.payload_bytes, image->size, stats.checksum);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  read %llu ms, crc %llu ms, stalls: reader %llu ms, writer %llu ms, usb %llu ms\n",
+           label, mb_per_sec(image->size, elapsed),
+           (unsigned long long)stats.read_us / 1000,
+           (unsigned long long)stats.checksum_us / 1000,
+           (unsigned long long)stats.reader_stall_us / 1000,
+           (unsigned long long)stats.writer_stall_us / 1000,
+           (unsigned long long)stats.usb_stall_us / 1000);
+    return 0;
+}
+
+static int bench_file_parts(const char* label, const UsbSimConfig* config, uint32_t window,
+                            const BenchImage* image) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+
+    flash_set_window(window);
+    u64 start = gettime();
+    int result = flash_file(image->path, "SYSTEM", NULL);
+    double elapsed = seconds_since(start);
+
+    const FlashReport* report = flash_get_report();
+    UsbSimStats sim_stats;
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    // Resent parts cross the bus twice
+    uint64_t expected = sim_stats.payload_bytes;
+    if (report->resent == 0) expected = image->size;
+    if (result != 0 || sim_stats.payload_bytes != expected ||
+        sim_stats.payload_bytes < image->size || sim_stats.files != 1 ||
+        sim_stats.checksum_mismatches != 0 || report->checksum != image->checksum) {
+        printf("  %-28s FAILED (%d, %llu of %u bytes)\n", label, result,
+               (unsigned long long)sim_stats.payload_bytes, image->size);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u parts, window %u, resent %u, %.0f ms\n",
+           label, mb_per_sec(image->size, elapsed),
+           report->parts, report->window, report->resent, elapsed * 1000.0);
+    return 0;
+}
+
+// Flash, then read the partition back against the digest taken on the way
+static int bench_verify(const char* label, const UsbSimConfig* config, int file_parts,
+                        const BenchImage* image) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+
+    u64 start = gettime();
+    int result = file_parts ? flash_file(image->path, "SYSTEM", NULL)
+                            : heimdall_flash_file(image->path, "SYSTEM", NULL);
+    double write_time = seconds_since(start);
+
+    int verified = (result == 0) ? flash_verify("SYSTEM", NULL) : -1;
+    const FlashVerifyReport* report = flash_get_verify_report();
+    double verify_time = report->elapsed_us / 1000000.0;
+    detach_sim(sim);
+
+    // A corrupted byte has to be found in the block that holds it
+    int64_t corrupt = config->corrupt_offset;
+    int32_t expected_block = (corrupt >= 0) ? (int32_t)(corrupt / DIGEST_BLOCK_SIZE) : -1;
+    int expected_result = (corrupt >= 0) ? -2 : 0;
+    if (result != 0 || verified != expected_result || report->bytes != image->size ||
+        report->first_bad_block != expected_block || report->expected != image->checksum) {
+        printf("  %-28s FAILED (flash %d, verify %d, first bad block %d)\n", label,
+               result, verified, report->first_bad_block);
+        return -1;
+    }
+
+    if (corrupt >= 0) {
+        printf("  %-28s mismatch in block %d (byte 0x%llx), %u of %u blocks bad\n",
+               label, report->first_bad_block,
+               (unsigned long long)corrupt, report->mismatched, report->blocks);
+    } else {
+        printf("  %-28s %8.1f MB/s  write %.1f MB/s, verify/write time %.2f\n",
+               label, mb_per_sec(report->bytes, verify_time),
+               mb_per_sec(image->size, write_time), verify_time / write_time);
+    }
+    return 0;
+}
+
+// CRC32 of a file on the card, to check a backup independently
+static uint32_t file_checksum(const char* path, uint32_t* size) {
+    uint8_t* data = fileio_read_file(path, size);
+    uint32_t crc = data ? crc32_update(0, data, *size) : 0;
+    fileio_free_file(data);
+    return crc;
+}
+
+// Keep the header and the first blocks of a manifest, as if the dump had
+// been cut off there, and leave junk past them in the image
+static int cut_backup(const BackupReport* report, uint32_t blocks) {
+    FILE* f = fopen(report->manifest_path, "r");
+    if (!f) return -1;
+    // The header lines and the blocks that are kept
+    uint32_t max_lines = blocks + 16;
+    char (*lines)[128] = malloc(max_lines * sizeof(*lines));
+    if (!lines) {
+        fclose(f);
+        return -1;
+    }
+    uint32_t count = 0, kept_blocks = 0;
+    while (count < max_lines && fgets(lines[count], sizeof(lines[count]), f)) {
+        if (strncmp(lines[count], "crc32", 5) == 0) break;
+        if (strncmp(lines[count], "block ", 6) == 0 && kept_blocks++ == blocks) break;
+        count++;
+    }
+    fclose(f);
+
+    f = fopen(report->manifest_path, "w");
+    for (uint32_t i = 0; f && i < count; i++) fputs(lines[i], f);
+    if (f) fputs("block 1", f); // Torn line
+    if (f) fclose(f);
+    free(lines);
+
+    f = fopen(report->image_path, "r+b");
+    if (!f) return -1;
+    fseek(f, (long)blocks * BACKUP_BLOCK_SIZE + 100, SEEK_SET);
+    fputs("junk", f);
+    fseek(f, 0, SEEK_END);
+    fputs("a longer image from before", f);
+    fclose(f);
+    return 0;
+}
+
+static int bench_backup(const char* label, const UsbSimConfig* config, const char* directory,
+                        uint32_t resume_blocks) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+
+    int result = resume_blocks ? 0 : flash_file(raw_image.path, "EFS", NULL);
+    if (result == 0 && resume_blocks) {
+        // Put the device back in the state the first run left it in
+        result = flash_file(raw_image.path, "EFS", NULL);
+        if (result == 0) result = cut_backup(backup_get_report(), resume_blocks);
+    }
+
+    u64 start = gettime();
+    if (result == 0) result = backup_partition("EFS", raw_image.size, directory, NULL);
+    double elapsed = seconds_since(start);
+    const BackupReport* report = backup_get_report();
+    detach_sim(sim);
+
+    uint32_t size = 0;
+    uint32_t crc = (result == 0) ? file_checksum(report->image_path, &size) : 0;
+    uint64_t resumed = (uint64_t)resume_blocks * BACKUP_BLOCK_SIZE;
+    if (result != 0 || report->checksum != raw_image.checksum || crc != raw_image.checksum ||
+        size != raw_image.size || report->resumed_from != resumed ||
+        report->bytes != raw_image.size - resumed) {
+        printf("  %-28s FAILED (%d, crc %08x, file %08x, resumed at %llu)\n", label, result,
+               report->checksum, crc, (unsigned long long)report->resumed_from);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %llu MB read, usb %llu ms, sd %llu ms, stalls: usb %llu ms, writer %llu ms\n",
+           label, mb_per_sec(report->bytes, elapsed),
+           (unsigned long long)report->bytes >> 20,
+           (unsigned long long)report->usb_us / 1000,
+           (unsigned long long)report->write_us / 1000,
+           (unsigned long long)report->usb_stall_us / 1000,
+           (unsigned long long)report->writer_stall_us / 1000);
+    return 0;
+}
+
+static int bench_package(const char* label, const UsbSimConfig* config) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+
+    u64 start = gettime();
+    int result = heimdall_flash_package(package_path, NULL);
+    double elapsed = seconds_since(start);
+
+    const OdinReport* report = odin_get_report();
+    UsbSimStats sim_stats;
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    if (result != 0 || report->flashed != 2 || report->skipped != 1 || !report->md5_ok ||
+        !report->flashed_partitions[0][0] || !report->flashed_partitions[1][0] ||
+        sim_stats.files != 2 || sim_stats.checksum_mismatches != 0 ||
+        sim_stats.payload_bytes != report->bytes_flashed) {
+        printf("  %-28s FAILED (%d, %u flashed, md5 %s)\n", label, result,
+               report->flashed, report->md5_ok ? "ok" : "bad");
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u images, md5 verified\n",
+           label, mb_per_sec(report->bytes_flashed, elapsed), report->flashed);
+    return 0;
+}
+
+// Raw, lz4 and sparse images queued for one session, against the same
+// images flashed one session each
+static int bench_batch(const char* label, const UsbSimConfig* config) {
+    const BenchImage* images[] = { &raw_image, &lz4_image, &sparse_file };
+    const char* partitions[] = { "SYSTEM", "BOOT", "CACHE" };
+    uint32_t count = sparse_file.path[0] ? 3 : 2;
+    uint64_t bytes = 0;
+
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+    u64 start = gettime();
+    int result = 0;
+    for (uint32_t i = 0; i < count && result == 0; i++) {
+        result = usb_start_session();
+        if (result == 0) result = flash_file(images[i]->path, partitions[i], NULL);
+        usb_end_flash_session();
+        bytes += images[i]->size;
+    }
+    double separate = seconds_since(start);
+    detach_sim(sim);
+
+    sim = attach_sim(config);
+    if (!sim) return -1;
+    batch_clear();
+    for (uint32_t i = 0; i < count; i++) {
+        if (result == 0) result = batch_add(images[i]->path, partitions[i]);
+    }
+    start = gettime();
+    if (result == 0) result = batch_run(NULL);
+    double elapsed = seconds_since(start);
+    batch_clear();
+
+    const BatchReport* report = batch_get_report();
+    UsbSimStats sim_stats;
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    uint64_t open_us = 0;
+    for (uint32_t i = 0; i < report->count; i++) {
+        if (report->items[i].image_size != images[i]->size) result = -1;
+        open_us += report->items[i].open_us;
+    }
+    if (result != 0 || report->flashed != count || report->bytes != bytes ||
+        sim_stats.sessions != 1 || sim_stats.files != count ||
+        sim_stats.checksum_mismatches != 0) {
+        printf("  %-28s FAILED (%d, %u of %u flashed, %u sessions)\n", label, result,
+               report->flashed, count, sim_stats.sessions);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u images, %.0f ms vs %.0f ms one session each, "
+           "session %llu ms, opening %llu ms\n",
+           label, mb_per_sec(bytes, elapsed), count, elapsed * 1000.0, separate * 1000.0,
+           (unsigned long long)report->session_us / 1000,
+           (unsigned long long)open_us / 1000);
+    return 0;
+}
+
+// The link drops half way through; the flash continues from its checkpoint
+// over a new session, directly or through the queue's reconnect
+// Resumed through flash_file, the batch queue or heimdall_flash_file
+#define RESUME_FLASH_FILE 0
+#define RESUME_BATCH      1
+#define RESUME_HEIMDALL   2
+
+static int bench_resume(const char* label, const UsbSimConfig* config, int path) {
+    UsbSimConfig failing = *config;
+    failing.fail_after = raw_image.size / 2;
+
+    UsbSim* sim = attach_sim(&failing);
+    if (!sim) return -1;
+
+    u64 start = gettime();
+    int result, first = 0, checkpointed = 0;
+    uint32_t resumed = 0;
+    if (path == RESUME_BATCH) {
+        batch_clear();
+        result = batch_add(raw_image.path, "SYSTEM");
+        if (result == 0) result = batch_run(NULL);
+        batch_clear();
+        const BatchItem* item = &batch_get_report()->items[0];
+        resumed = item->resumed_parts;
+        checkpointed = (item->resumes == 1);
+    } else if (path == RESUME_HEIMDALL) {
+        // The raw stream drops; the second run continues over the part protocol
+        first = heimdall_flash_file(raw_image.path, "SYSTEM", NULL);
+        checkpointed = flash_has_checkpoint("SYSTEM");
+        result = heimdall_flash_file(raw_image.path, "SYSTEM", NULL);
+        resumed = flash_get_report()->resumed;
+    } else {
+        first = flash_file(raw_image.path, "SYSTEM", NULL);
+        checkpointed = flash_has_checkpoint("SYSTEM");
+        result = usb_start_session();
+        if (result == 0) result = flash_file(raw_image.path, "SYSTEM", NULL);
+        resumed = flash_get_report()->resumed;
+        usb_end_flash_session();
+    }
+    double elapsed = seconds_since(start);
+
+    // The readback only matches if the skipped parts landed the first time
+    int verified = flash_verify("SYSTEM", NULL);
+    UsbSimStats sim_stats;
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    uint64_t skipped = (uint64_t)resumed * 0x40000;
+    if (result != 0 || (first == 0 && path != RESUME_BATCH) || !checkpointed || resumed == 0 ||
+        flash_has_checkpoint("SYSTEM") || verified != 0 || sim_stats.files != 1 ||
+        sim_stats.checksum_mismatches != 0 || skipped > (uint64_t)failing.fail_after) {
+        printf("  %-28s FAILED (%d, %u parts resumed, verify %d, %u mismatches)\n", label,
+               result, resumed, verified, sim_stats.checksum_mismatches);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  link lost at %u MB, %llu MB not sent again, "
+           "%llu MB sent in all\n",
+           label, mb_per_sec(raw_image.size, elapsed), (uint32_t)(failing.fail_after >> 20),
+           (unsigned long long)skipped >> 20,
+           (unsigned long long)sim_stats.payload_bytes >> 20);
+    return 0;
+}
+
+// A one-partition PIT, so heimdall.c knows the device and SYSTEM's blocks
+static int load_bench_pit(void) {
+    uint8_t pit[PIT_HEADER_SIZE + PIT_ENTRY_SIZE];
+    memset(pit, 0, sizeof(pit));
+    *(uint32_t*)pit = PIT_MAGIC;
+    *(uint32_t*)(pit + 4) = 1;
+    strcpy((char*)(pit + 28), "BENCH");
+    PitEntry* e = (PitEntry*)(pit + PIT_HEADER_SIZE);
+    e->block_size = 512;
+    e->block_count = raw_image.size / 512 * 2;
+    strcpy(e->partition_name, "SYSTEM");
+    strcpy(e->flash_filename, "system.img");
+
+    char path[] = "/tmp/heimdall-bench-XXXXXX.pit";
+    int fd = mkstemps(path, 4);
+    if (fd < 0) return -1;
+    int ok = (write(fd, pit, sizeof(pit)) == (ssize_t)sizeof(pit));
+    close(fd);
+    int result = ok ? heimdall_load_pit(path) : -1;
+    unlink(path);
+    return result;
+}
+
+// The image with blocks of it changed, as the next build of it would be
+static int make_changed_image(const char* path, uint32_t changed) {
+    uint32_t size;
+    uint8_t* data = fileio_read_file(raw_image.path, &size);
+    if (!data) return -1;
+    for (uint32_t i = 0; i < changed; i++) {
+        uint32_t offset = (uint32_t)(((uint64_t)size * (2 * i + 1)) / (2 * changed));
+        data[offset] ^= 0x5A;
+    }
+    int result = fileio_write_file(path, data, size);
+    fileio_free_file(data);
+    return result;
+}
+
+// Full flash of the base, then the changed image as a delta against it
+static int bench_delta(const char* label, const UsbSimConfig* config, const char* directory,
+                       uint32_t changed) {
+    char changed_path[] = "/tmp/heimdall-bench-XXXXXX.img";
+    int fd = mkstemps(changed_path, 4);
+    if (fd < 0) return -1;
+    close(fd);
+    if (make_changed_image(changed_path, changed) != 0 || load_bench_pit() != 0) {
+        unlink(changed_path);
+        return -1;
+    }
+    delta_set_directory(directory);
+
+    UsbSim* sim = attach_sim(config);
+    if (!sim) {
+        unlink(changed_path);
+        return -1;
+    }
+
+    u64 start = gettime();
+    int result = heimdall_flash_delta(raw_image.path, "SYSTEM", NULL);
+    double full = seconds_since(start);
+    uint32_t full_unchanged = heimdall_get_delta_report()->unchanged;
+    UsbSimStats before;
+    usb_sim_get_stats(sim, &before);
+
+    start = gettime();
+    if (result == 0) result = heimdall_flash_delta(changed_path, "SYSTEM", NULL);
+    double elapsed = seconds_since(start);
+    FlashReport report = *heimdall_get_delta_report();
+
+    // The readback is the whole new image, sent and unsent parts alike
+    int verified = flash_verify("SYSTEM", NULL);
+    UsbSimStats sim_stats;
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    pit_free(heimdall_get_pit_info());
+    delta_forget("BENCH", "SYSTEM");
+    delta_set_directory(NULL);
+    unlink(changed_path);
+
+    uint64_t sent = sim_stats.payload_bytes - before.payload_bytes;
+    if (result != 0 || full_unchanged != 0 || verified != 0 ||
+        report.unchanged + changed != report.parts || sim_stats.checksum_mismatches != 0 ||
+        sent != (uint64_t)changed * 0x40000) {
+        printf("  %-28s FAILED (%d, %u of %u unchanged, verify %d, %u mismatches)\n", label,
+               result, report.unchanged, report.parts, verified,
+               sim_stats.checksum_mismatches);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u of %u blocks sent, %.0f ms vs %.0f ms full\n",
+           label, mb_per_sec(raw_image.size, elapsed), report.parts - report.unchanged,
+           report.parts, elapsed * 1000.0, full * 1000.0);
+    return 0;
+}
+
+// --- Telemetry ---
+
+static uint32_t progress_calls;
+
+static int count_progress(float progress, const char* status) {
+    progress_calls++;
+    return 1;
+}
+
+// The engine records every chunk but publishes at most once per frame
+static int bench_telemetry(const char* label, const UsbSimConfig* config) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+
+    progress_calls = 0;
+    u64 start = gettime();
+    int result = heimdall_flash_file(raw_image.path, "SYSTEM", count_progress);
+    double elapsed = seconds_since(start);
+    detach_sim(sim);
+
+    const TelemetryStats* stats = telemetry_get();
+    uint32_t frames = (uint32_t)(elapsed * 1000000.0 / TELEMETRY_DEFAULT_PUBLISH_US) + 2;
+    if (result != 0 || stats->bytes != raw_image.size || stats->eta_us != 0 ||
+        progress_calls == 0 || progress_calls > frames || progress_calls >= stats->chunks) {
+        printf("  %-28s FAILED (%d, %u callbacks for %u chunks in %u frames)\n", label,
+               result, progress_calls, stats->chunks, frames);
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u chunks, %u callbacks, window %.1f MB/s, "
+           "chunk %u-%u us, stalls %llu ms\n",
+           label, mb_per_sec(raw_image.size, elapsed), stats->chunks, progress_calls,
+           stats->average / (1024.0 * 1024.0), stats->chunk_min_us, stats->chunk_max_us,
+           (unsigned long long)stats->stall_us / 1000);
+    return 0;
+}
+
+// --- Performance Report ---
+
+// A flash leaves a report with the USB latency histograms and stage times
+static int bench_perf_report(const char* label, const UsbSimConfig* config) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+    int result = heimdall_flash_file(raw_image.path, "SYSTEM", NULL);
+    detach_sim(sim);
+
+    const UsbHistogram* async = &usb_get_perf()->latency[USB_LATENCY_WRITE_ASYNC];
+    FILE* f = fopen(perf_get_report_path(), "r");
+    char line[512];
+    int stages = 0, histograms = 0, bytes = 0;
+    while (f && fgets(line, sizeof(line), f)) {
+        unsigned long long value;
+        if (strncmp(line, "stage ", 6) == 0) stages++;
+        if (strncmp(line, "latency ", 8) == 0) histograms++;
+        if (sscanf(line, "bytes %llu", &value) == 1) bytes = (value == raw_image.size);
+    }
+    if (f) fclose(f);
+
+    if (result != 0 || !f || stages != PERF_STAGES || histograms < 2 || !bytes ||
+        async->count == 0) {
+        printf("  %-28s FAILED (%d, %d stages, %d histograms in %s)\n", label, result,
+               stages, histograms, perf_get_report_path());
+        return -1;
+    }
+
+    const UsbHistogram* write = &usb_get_perf()->latency[USB_LATENCY_WRITE];
+    printf("  %-28s %u async writes p50 %u us p99 %u us max %u us, "
+           "%u sync writes p99 %u us\n",
+           label, async->count, usb_histogram_percentile(async, 50),
+           usb_histogram_percentile(async, 99), async->max_us,
+           write->count, usb_histogram_percentile(write, 99));
+    return 0;
+}
+
+// --- Transfer Tuner ---
+
+// Each flash to a new model tries the next candidate; once all ran, the
+// fastest is kept, and the profiles survive a trip through the config
+static int bench_tuner(const char* label, const UsbSimConfig* config) {
+    if (load_bench_pit() != 0) return -1;
+    const char* device = heimdall_get_pit_info()->device_name;
+    tuner_forget(device);
+
+    int result = 0;
+    u64 start = gettime();
+    for (int i = 0; i <= TUNER_CANDIDATES && result == 0; i++) {
+        UsbSim* sim = attach_sim(config);
+        if (!sim) return -1;
+        result = heimdall_flash_file(raw_image.path, "SYSTEM", NULL);
+        detach_sim(sim);
+    }
+    double elapsed = seconds_since(start);
+
+    const TunerProfile* profile = tuner_find(device);
+    TransferStats stats;
+    heimdall_get_transfer_stats(&stats);
+    TransferConfig chosen;
+    int best = profile ? profile->best : -1;
+    tuner_candidate(best < 0 ? 0 : (uint32_t)best, &chosen);
+
+    TunerProfile saved[TUNER_DEVICES];
+    tuner_export(saved);
+    tuner_forget(device);
+    tuner_import(saved);
+    const TunerProfile* restored = tuner_find(device);
+
+    if (result != 0 || best < 0 || tuner_is_dirty() || !restored || restored->best != best) {
+        printf("  %-28s FAILED (%d, best %d, %s after import)\n", label, result, best,
+               restored ? "kept" : "lost");
+        tuner_forget(device);
+        return -1;
+    }
+    for (int i = 0; i < TUNER_CANDIDATES; i++) {
+        if (profile->kbps[i] > profile->kbps[best]) {
+            printf("  %-28s FAILED (candidate %d beat the choice)\n", label, i);
+            tuner_forget(device);
+            return -1;
+        }
+    }
+
+    printf("  %-28s %8.1f MB/s  %d flashes, picked %u KB x %u in flight at %.1f MB/s\n",
+           label, mb_per_sec((uint64_t)raw_image.size * (TUNER_CANDIDATES + 1), elapsed),
+           TUNER_CANDIDATES + 1, chosen.buffer_size >> 10, chosen.queue_depth,
+           profile->kbps[best] / 1024.0);
+    tuner_forget(device);
+    return 0;
+}
+
+static void remove_directory_files(const char* directory) {
+    DIR* dir = opendir(directory);
+    struct dirent* entry;
+    char path[512];
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        unlink(path);
+    }
+    if (dir) closedir(dir);
+    rmdir(directory);
+}
+
+// --- Flash Worker ---
+
+static int bench_worker_progress(float progress, const char* status) {
+    worker_publish_progress(progress, status);
+    return 1;
+}
+
+static int bench_worker_job(void* arg) {
+    worker_post(WORKER_MSG_LOG, 0, "flashing");
+    return flash_file(((BenchImage*)arg)->path, "SYSTEM", bench_worker_progress);
+}
+
+// The flash runs on the worker while this thread plays the UI: it polls
+// every millisecond like a frame would, and optionally cancels part way
+static int bench_worker(const char* label, const UsbSimConfig* config, float cancel_at) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+    if (worker_init() != 0) {
+        detach_sim(sim);
+        return -1;
+    }
+
+    u64 start = gettime();
+    u64 cancelled = 0, finished = 0, last_poll = start;
+    uint64_t longest_poll_us = 0;
+    uint32_t frames = 0, logs = 0, shown = 0, updates = 0;
+    float last_progress = 0.0f;
+    int result = worker_start(bench_worker_job, &raw_image);
+    int started = (result == 0), busy = worker_start(bench_worker_job, &raw_image);
+
+    while (started && !finished) {
+        WorkerProgress progress;
+        worker_get_progress(&progress);
+        if (progress.updates != shown) {
+            shown = progress.updates;
+            updates++;
+            last_progress = progress.progress;
+        }
+        if (cancel_at > 0.0f && !cancelled && progress.progress >= cancel_at) {
+            worker_cancel();
+            cancelled = gettime();
+        }
+
+        WorkerMessage message;
+        while (worker_poll(&message)) {
+            if (message.type == WORKER_MSG_LOG) logs++;
+            if (message.type == WORKER_MSG_DONE) {
+                result = message.result;
+                finished = gettime();
+            }
+        }
+
+        u64 now = gettime();
+        uint64_t gap = ticks_to_microsecs(now - last_poll);
+        if (gap > longest_poll_us) longest_poll_us = gap;
+        last_poll = now;
+        frames++;
+        if (!finished) usleep(1000);
+    }
+    double elapsed = seconds_since(start);
+    worker_shutdown();
+
+    UsbSimStats sim_stats;
+    usb_sim_get_stats(sim, &sim_stats);
+    detach_sim(sim);
+
+    int ok = started && busy != 0 && logs == 1 && updates > 0;
+    if (cancel_at > 0.0f) {
+        // Stopped between chunks, with the ACKed parts kept for a resume
+        ok = ok && cancelled && result != 0 && strcmp(flash_get_status(), "Aborted") == 0 &&
+             sim_stats.payload_bytes < raw_image.size && flash_has_checkpoint("SYSTEM");
+        flash_discard_checkpoint("SYSTEM");
+        flash_clear_abort();
+    } else {
+        ok = ok && result == 0 && last_progress == 1.0f &&
+             sim_stats.payload_bytes == raw_image.size;
+    }
+    if (!ok) {
+        printf("  %-28s FAILED (%d, %u updates, %llu of %u bytes)\n", label, result,
+               updates, (unsigned long long)sim_stats.payload_bytes, raw_image.size);
+        return -1;
+    }
+
+    if (cancel_at > 0.0f) {
+        printf("  %-28s stopped %.1f ms after cancel at %.0f%%, %llu MB sent, "
+               "longest frame %.1f ms\n",
+               label, ticks_to_microsecs(finished - cancelled) / 1000.0, cancel_at * 100.0,
+               (unsigned long long)sim_stats.payload_bytes >> 20, longest_poll_us / 1000.0);
+    } else {
+        printf("  %-28s %8.1f MB/s  %u frames, %u progress updates seen, "
+               "longest frame %.1f ms\n",
+               label, mb_per_sec(raw_image.size, elapsed), frames, updates,
+               longest_poll_us / 1000.0);
+    }
+    return 0;
+}
+
+// --- LZ4 ---
+
+static int bench_lz4_decode(void) {
+    FileReader* reader = fileio_reader_open(lz4_image.path, 0);
+    if (!reader) return -1;
+
+    FlashSource input;
+    flash_reader_source(reader, &input);
+    Lz4Stream* lz4 = lz4_open(&input);
+
+    u64 start = gettime();
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    const uint8_t* chunk;
+    int got = -1;
+    while (lz4 && (got = lz4_next(lz4, &chunk, 0x8000)) > 0) {
+        crc = crc32_update(crc, chunk, got);
+        total += got;
+    }
+    double elapsed = seconds_since(start);
+
+    lz4_close(lz4);
+    fileio_reader_close(reader);
+
+    if (got != 0 || total != lz4_image.size || crc != lz4_image.checksum) {
+        printf("  lz4 decode                   FAILED\n");
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u MB read from SD for %u MB of image (%.0f%%)\n",
+           "decode + crc32", mb_per_sec(total, elapsed),
+           lz4_image.file_size >> 20, lz4_image.size >> 20,
+           100.0 * lz4_image.file_size / lz4_image.size);
+    return 0;
+}
+
+// The bench image twice over, as two frames that each record their own
+// content size; lz4_size must add them up from the headers
+static int bench_lz4_frames(void) {
+    char path[] = "/tmp/heimdall-bench-XXXXXX.img.lz4";
+    int fd = mkstemps(path, 8);
+    if (fd < 0) return -1;
+    close(fd);
+    uint32_t length;
+    uint8_t* frame = fileio_read_file(lz4_image.path, &length);
+    FILE* f = fopen(path, "wb");
+    int written = frame && f && fwrite(frame, 1, length, f) == length &&
+                  fwrite(frame, 1, length, f) == length;
+    if (f) fclose(f);
+    fileio_free_file(frame);
+
+    FileReader* reader = written ? fileio_reader_open(path, 0) : NULL;
+    FlashSource input;
+    if (reader) flash_reader_source(reader, &input);
+    Lz4Stream* lz4 = reader ? lz4_open(&input) : NULL;
+
+    u64 start = gettime();
+    uint64_t size = lz4_size(lz4);
+    double sizing = seconds_since(start);
+
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    const uint8_t* chunk;
+    int got = -1;
+    while (lz4 && (got = lz4_next(lz4, &chunk, 0x8000)) > 0) {
+        crc = crc32_update(crc, chunk, got);
+        total += got;
+    }
+    lz4_close(lz4);
+    fileio_reader_close(reader);
+    unlink(path);
+
+    uint64_t expected = 2ull * lz4_image.size;
+    if (got != 0 || size != expected || total != expected ||
+        crc != crc32_combine(lz4_image.checksum, lz4_image.checksum, lz4_image.size)) {
+        printf("  %-28s FAILED (size %llu, decoded %llu)\n", "two sized frames",
+               (unsigned long long)size, (unsigned long long)total);
+        return -1;
+    }
+
+    printf("  %-28s %8.2f ms  to size %u MB from the frame headers\n", "two sized frames",
+           sizing * 1000, (uint32_t)(expected >> 20));
+    return 0;
+}
+
+// A frame with block checksums and 64KB blocks laid out against the
+// reader's windows: at every other window boundary a stored block is sized
+// so its checksum is split across it, and in between compressed blocks run
+// over the boundary. Each block has to survive its checksum being read.
+static int bench_lz4_block_sums(void) {
+    const uint32_t size = 2 * 1024 * 1024 + 777;
+    const uint32_t block_max = 64 * 1024;
+    char path[] = "/tmp/heimdall-bench-XXXXXX.img.lz4";
+    int fd = mkstemps(path, 8);
+    if (fd < 0) return -1;
+
+    FILE* f = fdopen(fd, "wb");
+    uint8_t* raw = malloc(size);
+    uint8_t* packed = malloc(block_max + block_max / 255 + 16);
+    if (!f || !raw || !packed) {
+        if (f) fclose(f);
+        free(raw);
+        free(packed);
+        unlink(path);
+        return -1;
+    }
+
+    static const char text[] = "ro.product.model=SM-BENCH\n";
+    uint32_t seed = 0x13579BDF;
+    for (uint32_t i = 0; i < size; i++) {
+        if ((i >> 13) % 3 == 0) {
+            seed = seed * 1103515245 + 12345;
+            raw[i] = (uint8_t)(seed >> 16);
+        } else {
+            raw[i] = (uint8_t)text[i % (sizeof(text) - 1)];
+        }
+    }
+
+    // Independent 64KB blocks with checksums, no content size
+    uint8_t header[7] = { 0x04, 0x22, 0x4D, 0x18, 0x70, 0x40 };
+    header[6] = lz4_header_checksum(header + 4, 2);
+    fwrite(header, 1, sizeof(header), f);
+
+    uint32_t position = sizeof(header);
+    uint32_t split = 0;
+    for (uint32_t done = 0; done < size; ) {
+        uint32_t boundary = (position / FILEIO_READER_WINDOW + 1) * FILEIO_READER_WINDOW;
+        uint32_t n = (size - done < block_max) ? size - done : block_max;
+        uint32_t word;
+        const uint8_t* body;
+        uint32_t length;
+        uint32_t to_split = boundary - 2 - (position + 4);
+        if ((boundary / FILEIO_READER_WINDOW) % 2 == 1 && boundary - position < block_max &&
+            to_split > 0 && to_split <= n) {
+            n = to_split;
+            word = n | 0x80000000u;
+            body = raw + done;
+            length = n;
+            split++;
+        } else {
+            length = lz4_compress_block(raw + done, n, packed);
+            word = length;
+            body = packed;
+            if (length >= n) {
+                word = n | 0x80000000u;
+                body = raw + done;
+                length = n;
+            }
+        }
+        uint32_t sum = bench_xxh32(body, length);
+        uint8_t prefix[4] = { (uint8_t)word, (uint8_t)(word >> 8),
+                              (uint8_t)(word >> 16), (uint8_t)(word >> 24) };
+        uint8_t suffix[4] = { (uint8_t)sum, (uint8_t)(sum >> 8),
+                              (uint8_t)(sum >> 16), (uint8_t)(sum >> 24) };
+        fwrite(prefix, 1, 4, f);
+        fwrite(body, 1, length, f);
+        fwrite(suffix, 1, 4, f);
+        position += 8 + length;
+        done += n;
+    }
+    uint8_t end_mark[4] = { 0, 0, 0, 0 };
+    fwrite(end_mark, 1, 4, f);
+    fclose(f);
+    free(packed);
+    uint32_t checksum = crc32_update(0, raw, size);
+    free(raw);
+
+    FileReader* reader = fileio_reader_open(path, 0);
+    FlashSource input;
+    if (reader) flash_reader_source(reader, &input);
+    Lz4Stream* lz4 = reader ? lz4_open(&input) : NULL;
+
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    const uint8_t* chunk;
+    int got = -1;
+    while (lz4 && (got = lz4_next(lz4, &chunk, 0x8000)) > 0) {
+        crc = crc32_update(crc, chunk, got);
+        total += got;
+    }
+    lz4_close(lz4);
+    fileio_reader_close(reader);
+    unlink(path);
+
+    if (got != 0 || total != size || crc != checksum || split == 0) {
+        printf("  %-28s FAILED (decoded %llu of %u)\n", "block checksums",
+               (unsigned long long)total, size);
+        return -1;
+    }
+
+    printf("  %-28s ok  %u checksums split over a window boundary\n", "block checksums", split);
+    return 0;
+}
+
+// --- Checksum ---
+
+static int bench_sparse_expand(void) {
+    FileReader* reader = fileio_reader_open(sparse_file.path, 0);
+    if (!reader) return -1;
+
+    FlashSource input;
+    flash_reader_source(reader, &input);
+    ImageStream image;
+    int opened = image_open(&image, &input, fileio_reader_size(reader), sparse_file.path);
+
+    u64 start = gettime();
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    const uint8_t* chunk;
+    int got = -1;
+    while (opened == 0 && (got = image.source.next(image.source.ctx, &chunk, 0x20000)) > 0) {
+        crc = crc32_update(crc, chunk, got);
+        total += got;
+    }
+    double elapsed = seconds_since(start);
+
+    SparseStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (opened == 0 && image.expanded) sparse_get_stats(image.sparse_stream, &stats);
+    image_close(&image);
+    fileio_reader_close(reader);
+
+    if (got != 0 || total != sparse_image.size || crc != sparse_image.checksum ||
+        stats.crc_checked != 1) {
+        printf("  sparse expand                FAILED\n");
+        return -1;
+    }
+
+    printf("  %-28s %8.1f MB/s  %u chunks, %llu KB raw, %llu KB fill, %llu KB don't care\n",
+           "expand + crc32", mb_per_sec(total, elapsed), stats.total_chunks,
+           (unsigned long long)stats.raw_bytes >> 10,
+           (unsigned long long)stats.fill_bytes >> 10,
+           (unsigned long long)stats.dont_care_bytes >> 10);
+    return 0;
+}
+
+static int bench_checksum(uint32_t megabytes) {
+    // Standard check value for the IEEE polynomial
+    if (heimdall_calculate_checksum((const uint8_t*)"123456789", 9) != 0xCBF43926) {
+        printf("  crc32                        FAILED (check value)\n");
+        return -1;
+    }
+
+    // One transfer buffer's worth at a time, as the flash paths feed it
+    uint32_t chunk = 0x8000;
+    uint8_t* buffer = malloc(chunk + 1);
+    if (!buffer) return -1;
+    for (uint32_t i = 0; i < chunk + 1; i++) {
+        buffer[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    uint32_t rounds = megabytes * 1024 * 1024 / chunk;
+    uint32_t crc = 0;
+    u64 start = gettime();
+    for (uint32_t i = 0; i < rounds; i++) {
+        crc = crc32_update(crc, buffer, chunk);
+    }
+    double aligned = seconds_since(start);
+
+    start = gettime();
+    for (uint32_t i = 0; i < rounds; i++) {
+        crc = crc32_update(crc, buffer + 1, chunk);
+    }
+    double unaligned = seconds_since(start);
+    free(buffer);
+
+    uint64_t bytes = (uint64_t)rounds * chunk;
+    printf("  %-28s %8.1f MB/s  (crc %08x)\n", "crc32, aligned",
+           mb_per_sec(bytes, aligned), crc);
+    printf("  %-28s %8.1f MB/s\n", "crc32, unaligned",
+           mb_per_sec(bytes, unaligned));
+    return 0;
+}
+
+// --- PIT Parsing ---
+
+// A PIT of entries partitions PART<n>, flashed from part<n>.img
+static uint8_t* make_pit(const char* device, uint32_t entries, uint32_t* size) {
+    *size = PIT_HEADER_SIZE + entries * PIT_ENTRY_SIZE;
+    uint8_t* pit = calloc(1, *size);
+    if (!pit) return NULL;
+
+    *(uint32_t*)pit = PIT_MAGIC;
+    *(uint32_t*)(pit + 4) = entries;
+    strcpy((char*)(pit + 28), device);
+    for (uint32_t i = 0; i < entries; i++) {
+        PitEntry* e = (PitEntry*)(pit + PIT_HEADER_SIZE + i * PIT_ENTRY_SIZE);
+        e->identifier = i;
+        e->block_size = 512;
+        e->block_count = 1024 * (i + 1);
+        snprintf(e->partition_name, sizeof(e->partition_name), "PART%u", i);
+        snprintf(e->flash_filename, sizeof(e->flash_filename), "part%u.img", i);
+    }
+    return pit;
+}
+
+static int bench_pit_parse(uint32_t iterations) {
+    // More than the 64 a PitInfo used to hold, as on recent phones
+    uint32_t entries = 160;
+    uint32_t size;
+    uint8_t* pit = make_pit("BENCH", entries, &size);
+    if (!pit) return -1;
+
+    PitInfo* info = calloc(1, sizeof(PitInfo));
+    if (!info) {
+        free(pit);
+        return -1;
+    }
+
+    u64 start = gettime();
+    int result = 0;
+    for (uint32_t i = 0; i < iterations && result == 0; i++) {
+        result = pit_parse(pit, size, info);
+    }
+    double elapsed = seconds_since(start);
+
+    start = gettime();
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "part%u.img", i % entries);
+        if (pit_find_partition(info, name, NULL) == 0) found++;
+    }
+    double lookup_elapsed = seconds_since(start);
+
+    // The view checks the table once and reads the entries where they lie
+    start = gettime();
+    PitView view;
+    uint64_t blocks = 0;
+    for (uint32_t i = 0; i < iterations && result == 0; i++) {
+        result = pit_view_open(pit, size, &view);
+        for (uint32_t j = 0; j < view.entry_count && result == 0; j++) {
+            blocks += pit_view_entry(&view, j)->block_count;
+        }
+    }
+    double view_elapsed = seconds_since(start);
+    const PitEntry* last = (result == 0) ? pit_view_find(&view, "PART159") : NULL;
+    int ok = (result == 0 && found == iterations && last && last->identifier == entries - 1 &&
+              blocks != 0 && pit_view_open(pit, size - 1, &view) == -3);
+
+    pit_free(info);
+    free(info);
+    free(pit);
+
+    if (!ok) {
+        printf("  pit_parse                    FAILED\n");
+        return -1;
+    }
+
+    printf("  %-28s %8.2f M entries/s\n", "pit_parse",
+           (elapsed > 0.0) ? (double)iterations * entries / elapsed / 1e6 : 0.0);
+    printf("  %-28s %8.2f M entries/s\n", "pit_view_open",
+           (view_elapsed > 0.0) ? (double)iterations * entries / view_elapsed / 1e6 : 0.0);
+    printf("  %-28s %8.2f M lookups/s  (%u entries)\n", "pit_find_partition",
+           (lookup_elapsed > 0.0) ? (double)iterations / lookup_elapsed / 1e6 : 0.0, entries);
+    return 0;
+}
+
+// --- PIT Download ---
+
+static int pit_download(const UsbSimConfig* config, const uint8_t* pit, uint32_t size,
+                        uint64_t* bytes_in, double* elapsed) {
+    UsbSim* sim = attach_sim(config);
+    if (!sim) return -1;
+    usb_sim_set_pit(sim, pit, size);
+    u64 start = gettime();
+    int result = heimdall_download_pit();
+    *elapsed = seconds_since(start);
+    UsbSimStats stats;
+    usb_sim_get_stats(sim, &stats);
+    detach_sim(sim);
+    *bytes_in = stats.bytes_in;
+    return result;
+}
+
+// The first session downloads the PIT and stores it; the next only asks
+// for its size and CRC32. A changed table or a damaged copy is fetched again.
+static int bench_pit_download(const char* label, const UsbSimConfig* config,
+                              const char* directory) {
+    uint32_t size, changed_size;
+    uint8_t* pit = make_pit("BENCH-PIT", 120, &size);
+    uint8_t* changed = make_pit("BENCH-PIT", 121, &changed_size);
+    if (!pit || !changed) {
+        free(pit);
+        free(changed);
+        return -1;
+    }
+    pit_cache_set_directory(directory);
+    PitCacheStats before = *pit_cache_get_stats();
+
+    int result[5];
+    uint64_t bytes[5];
+    double elapsed[5];
+    result[0] = pit_download(config, pit, size, &bytes[0], &elapsed[0]);     // Downloads
+    result[1] = pit_download(config, pit, size, &bytes[1], &elapsed[1]);     // From the card
+    PitEntry entry;
+    int found = pit_find_partition(heimdall_get_pit_info(), "part119.img", &entry);
+    result[2] = pit_download(config, changed, changed_size, &bytes[2], &elapsed[2]);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/BENCH-PIT.pit", directory);
+    FILE* f = fopen(path, "r+b");
+    if (f) {
+        fseek(f, PIT_HEADER_SIZE + 4, SEEK_SET);
+        fputc(0x5A, f);
+        fclose(f);
+    }
+    result[3] = pit_download(config, changed, changed_size, &bytes[3], &elapsed[3]);
+    result[4] = pit_download(config, changed, changed_size, &bytes[4], &elapsed[4]);
+    uint32_t entries = heimdall_get_pit_info()->entry_count;
+    const PitCacheStats* stats = pit_cache_get_stats();
+
+    pit_free(heimdall_get_pit_info());
+    pit_cache_forget("BENCH-PIT");
+    pit_cache_set_directory(NULL);
+    snprintf(path, sizeof(path), "%s/index", directory);
+    unlink(path);
+    free(pit);
+    free(changed);
+
+    if (result[0] != 0 || result[1] != 1 || result[2] != 0 || result[3] != 0 ||
+        result[4] != 1 || found != 0 || entry.identifier != 119 || entries != 121 ||
+        bytes[1] >= size || stats->hits - before.hits != 2 ||
+        stats->damaged - before.damaged != 1 || stats->saves - before.saves != 3) {
+        printf("  %-28s FAILED (%d %d %d %d %d, %u hits, %u damaged)\n", label, result[0],
+               result[1], result[2], result[3], result[4], stats->hits - before.hits,
+               stats->damaged - before.damaged);
+        return -1;
+    }
+
+    printf("  %-28s %8.2f ms download (%llu bytes in), %.2f ms from the card (%llu bytes in), "
+           "changed and damaged tables fetched again\n", label, elapsed[0] * 1000,
+           (unsigned long long)bytes[0], elapsed[1] * 1000, (unsigned long long)bytes[1]);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    uint32_t image_mb = 64;
+    uint32_t pit_iterations = 100000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:")) != -1) {
+        switch (opt) {
+            case 's': image_mb = (uint32_t)atoi(optarg); break;
+            case 'p': pit_iterations = (uint32_t)atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-s image_mb] [-p pit_iterations]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (make_image(image_mb * 1024 * 1024 + 12345) != 0) {
+        fprintf(stderr, "cannot create bench image\n");
+        return 1;
+    }
+
+    if (make_package() != 0 || make_lz4_image(image_mb * 1024 * 1024 + 4321) != 0) {
+        fprintf(stderr, "cannot create bench package\n");
+        unlink(raw_image.path);
+        unlink(package_path);
+        return 1;
+    }
+
+    UsbSimConfig unlimited;
+    usb_sim_default_config(&unlimited);
+    unlimited.latency_us = 0;
+    unlimited.bandwidth = 0;
+
+    UsbSimConfig usb2;
+    usb_sim_default_config(&usb2);
+
+    // Every file part flash checkpoints, as it would on the card
+    char checkpoint_dir[] = "/tmp/heimdall-bench-checkpoint-XXXXXX";
+    if (!mkdtemp(checkpoint_dir)) {
+        fprintf(stderr, "cannot create checkpoint directory\n");
+        return 1;
+    }
+    flash_set_checkpoint_directory(checkpoint_dir);
+
+    // Every heimdall.c job writes a performance report
+    char perf_dir[] = "/tmp/heimdall-bench-perf-XXXXXX";
+    if (!mkdtemp(perf_dir)) {
+        fprintf(stderr, "cannot create perf directory\n");
+        rmdir(checkpoint_dir);
+        return 1;
+    }
+    perf_set_directory(perf_dir);
+
+    // Only the cache bench flashes from RAM
+    cache_set_budget(0);
+
+    int failures = 0;
+
+    printf("Device session (usb_connect)\n");
+    failures += bench_session("unlimited bus", &unlimited) != 0;
+
+    printf("Flash pipeline, %u MB image (heimdall_flash_file)\n", image_mb);
+    failures += bench_raw_stream("raw, unlimited bus", &unlimited, &raw_image) != 0;
+    failures += bench_raw_stream("raw, USB 2.0 model", &usb2, &raw_image) != 0;
+
+    printf("File parts (flash_file)\n");
+    failures += bench_file_parts("window 1, unlimited bus", &unlimited, 1, &raw_image) != 0;
+    failures += bench_file_parts("window 4, unlimited bus", &unlimited, 4, &raw_image) != 0;
+    failures += bench_file_parts("window 1, USB 2.0 model", &usb2, 1, &raw_image) != 0;
+    failures += bench_file_parts("window 4, USB 2.0 model", &usb2, 4, &raw_image) != 0;
+
+    printf("LZ4 image (.img.lz4)\n");
+    failures += bench_lz4_decode() != 0;
+    failures += bench_lz4_frames() != 0;
+    failures += bench_lz4_block_sums() != 0;
+    failures += bench_raw_stream("raw stream, unlimited bus", &unlimited, &lz4_image) != 0;
+    failures += bench_file_parts("parts, unlimited bus", &unlimited, 4, &lz4_image) != 0;
+    failures += bench_file_parts("parts, USB 2.0 model", &usb2, 4, &lz4_image) != 0;
+
+    if (make_sparse_image(image_mb) == 0) {
+        UsbSimConfig dropped = unlimited;
+        dropped.drop_ack = 5;
+
+        printf("Sparse image, %u MB expanded, %u KB on the card\n",
+               image_mb, sparse_file.file_size >> 10);
+        failures += bench_file_parts("forwarded, USB 2.0 model", &usb2, 4, &sparse_file) != 0;
+        image_set_sparse_mode(IMAGE_SPARSE_EXPAND);
+        failures += bench_sparse_expand() != 0;
+        failures += bench_file_parts("expanded, USB 2.0 model", &usb2, 4, &sparse_image) != 0;
+        failures += bench_file_parts("expanded, ACK dropped", &dropped, 4, &sparse_image) != 0;
+        failures += bench_raw_stream("expanded stream, USB 2.0", &usb2, &sparse_image) != 0;
+        image_set_sparse_mode(IMAGE_SPARSE_FORWARD);
+    } else {
+        printf("Sparse image                   FAILED (cannot create)\n");
+        failures++;
+    }
+
+    printf("Readback verify (flash_verify)\n");
+    UsbSimConfig corrupted = usb2;
+    corrupted.corrupt_offset = raw_image.size / 2 + 12345;
+    failures += bench_verify("raw stream, unlimited bus", &unlimited, 0, &raw_image) != 0;
+    failures += bench_verify("raw stream, USB 2.0 model", &usb2, 0, &raw_image) != 0;
+    failures += bench_verify("file parts, USB 2.0 model", &usb2, 1, &raw_image) != 0;
+    failures += bench_verify("corrupted byte", &corrupted, 1, &raw_image) != 0;
+
+    char backup_dir[] = "/tmp/heimdall-bench-backup-XXXXXX";
+    if (mkdtemp(backup_dir)) {
+        printf("Partition backup (backup_partition)\n");
+        failures += bench_backup("unlimited bus", &unlimited, backup_dir, 0) != 0;
+        failures += bench_backup("USB 2.0 model", &usb2, backup_dir, 0) != 0;
+        failures += bench_backup("resumed, USB 2.0 model", &usb2, backup_dir,
+                                 raw_image.size / BACKUP_BLOCK_SIZE / 2) != 0;
+        unlink(backup_get_report()->image_path);
+        unlink(backup_get_report()->manifest_path);
+        rmdir(backup_dir);
+    }
+
+    printf("Batch queue (batch_run)\n");
+    failures += bench_batch("unlimited bus", &unlimited) != 0;
+    failures += bench_batch("USB 2.0 model", &usb2) != 0;
+
+    printf("Resume after a dropped link (checkpoints)\n");
+    failures += bench_resume("flash_file, USB 2.0 model", &usb2, RESUME_FLASH_FILE) != 0;
+    failures += bench_resume("batch reconnect, USB 2.0", &usb2, RESUME_BATCH) != 0;
+    failures += bench_resume("heimdall_flash_file, USB 2.0", &usb2, RESUME_HEIMDALL) != 0;
+
+    char delta_dir[] = "/tmp/heimdall-bench-delta-XXXXXX";
+    if (mkdtemp(delta_dir)) {
+        printf("Delta flash (heimdall_flash_delta)\n");
+        failures += bench_delta("3 blocks changed, USB 2.0", &usb2, delta_dir, 3) != 0;
+        char device_dir[64];
+        snprintf(device_dir, sizeof(device_dir), "%s/BENCH", delta_dir);
+        rmdir(device_dir);
+        rmdir(delta_dir);
+    }
+
+    printf("Several devices (heimdall_flash_multi)\n");
+    failures += bench_multi("2 devices, USB 2.0 model", &usb2, 2, 0) != 0;
+    failures += bench_multi("3 devices, USB 2.0 model", &usb2, 3, 0) != 0;
+    failures += bench_multi("1 of 3 unplugged, USB 2.0", &usb2, 3, 1) != 0;
+
+    char pit_dir[] = "/tmp/heimdall-bench-pit-XXXXXX";
+    if (mkdtemp(pit_dir)) {
+        printf("PIT download (heimdall_download_pit)\n");
+        failures += bench_pit_download("USB 2.0 model", &usb2, pit_dir) != 0;
+        rmdir(pit_dir);
+    }
+
+    printf("Image cache (cache.c)\n");
+    failures += bench_cache("unlimited bus", &unlimited) != 0;
+
+    printf("Buffer pools (mem.c)\n");
+    failures += bench_mem("raw, lz4, sparse", &unlimited) != 0;
+
+    printf("Transfer tuner (tuner.c)\n");
+    failures += bench_tuner("USB 2.0 model", &usb2) != 0;
+
+    printf("Performance report (perf.c)\n");
+    failures += bench_perf_report("USB 2.0 model", &usb2) != 0;
+
+    printf("Telemetry (progress once per frame)\n");
+    failures += bench_telemetry("unlimited bus", &unlimited) != 0;
+    failures += bench_telemetry("USB 2.0 model", &usb2) != 0;
+
+    printf("Flash worker (worker.c)\n");
+    failures += bench_worker("USB 2.0 model", &usb2, 0.0f) != 0;
+    failures += bench_worker("cancelled, USB 2.0 model", &usb2, 0.25f) != 0;
+
+    printf("Odin package (heimdall_flash_package, .tar.md5)\n");
+    failures += bench_package("unlimited bus", &unlimited) != 0;
+    failures += bench_package("USB 2.0 model", &usb2) != 0;
+
+    printf("Checksum, %u MB\n", image_mb * 4);
+    failures += bench_checksum(image_mb * 4) != 0;
+
+    printf("PIT, %u iterations\n", pit_iterations);
+    failures += bench_pit_parse(pit_iterations) != 0;
+
+    heimdall_cleanup();
+    unlink(raw_image.path);
+    unlink(lz4_image.path);
+    unlink(sparse_file.path);
+    unlink(package_path);
+    rmdir(checkpoint_dir);
+    remove_directory_files(perf_dir);
+
+    return failures ? 1 : 0;
+}
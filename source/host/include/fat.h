@@ -0,0 +1,10 @@
+// source/host/include/fat.h
+// Host shim for libfat: "sd:/" paths are plain host paths
+#ifndef FAT_H
+#define FAT_H
+
+#include <stdbool.h>
+
+bool fatInitDefault(void);
+
+#endif
@@ -0,0 +1,61 @@
+// source/host/include/gccore.h
+// Host shim for the parts of libogc the flashing core uses: LWP threads,
+// mutexes, condition variables, semaphores, message queues, cache
+// maintenance and MEM2 arena allocation. Backed by pthreads in ogc_shim.c.
+#ifndef GCCORE_H
+#define GCCORE_H
+
+#include "gctypes.h"
+
+typedef u32 lwp_t;
+typedef u32 mutex_t;
+typedef u32 cond_t;
+typedef u32 sem_t;
+typedef u32 mqbox_t;
+typedef void* mqmsg_t;
+
+#define LWP_THREAD_NULL 0xffffffff
+#define LWP_MUTEX_NULL  0xffffffff
+#define LWP_COND_NULL   0xffffffff
+#define LWP_SEM_NULL    0xffffffff
+#define MQ_BOX_NULL     0xffffffff
+#define MQ_MSG_BLOCK    0
+#define MQ_MSG_NOBLOCK  1
+
+// Threads
+s32 LWP_CreateThread(lwp_t* thethread, void* (*entry)(void*), void* arg,
+                     void* stackbase, u32 stack_size, u8 prio);
+s32 LWP_JoinThread(lwp_t thethread, void** value_ptr);
+void LWP_YieldThread(void);
+
+// Mutexes and condition variables
+s32 LWP_MutexInit(mutex_t* mutex, bool use_recursive);
+s32 LWP_MutexDestroy(mutex_t mutex);
+s32 LWP_MutexLock(mutex_t mutex);
+s32 LWP_MutexUnlock(mutex_t mutex);
+s32 LWP_CondInit(cond_t* cond);
+s32 LWP_CondDestroy(cond_t cond);
+s32 LWP_CondWait(cond_t cond, mutex_t mutex);
+s32 LWP_CondSignal(cond_t cond);
+s32 LWP_CondBroadcast(cond_t cond);
+
+// Counting semaphores
+s32 LWP_SemInit(sem_t* sem, u32 start, u32 max);
+s32 LWP_SemDestroy(sem_t sem);
+s32 LWP_SemWait(sem_t sem);
+s32 LWP_SemPost(sem_t sem);
+
+// Message queues
+s32 MQ_Init(mqbox_t* mqbox, u32 count);
+void MQ_Close(mqbox_t mqbox);
+BOOL MQ_Send(mqbox_t mqbox, mqmsg_t msg, u32 flags);
+BOOL MQ_Receive(mqbox_t mqbox, mqmsg_t* msg, u32 flags);
+
+// Cache maintenance is a no-op on the host
+void DCFlushRange(void* startaddress, u32 len);
+void DCInvalidateRange(void* startaddress, u32 len);
+
+// MEM2 arena; the host hands out ordinary heap memory
+void* SYS_AllocArena2MemLo(u32 size, u32 align);
+
+#endif
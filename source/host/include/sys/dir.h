@@ -0,0 +1,3 @@
+// source/host/include/sys/dir.h
+// newlib's <sys/dir.h>; glibc only ships <dirent.h>
+#include <dirent.h>
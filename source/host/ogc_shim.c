@@ -0,0 +1,289 @@
+// source/host/ogc_shim.c
+// pthread-backed implementation of the libogc calls in include/gccore.h
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <sched.h>
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <fat.h>
+
+// libogc hands out small integer handles; map them to heap objects
+#define MAX_HANDLES 4096
+
+typedef struct {
+    pthread_t thread;
+} ShimThread;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    u32 count;
+    u32 max;
+} ShimSem;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    mqmsg_t* msgs;
+    u32 size;
+    u32 head;
+    u32 count;
+} ShimQueue;
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static void* handles[MAX_HANDLES];
+
+static u32 handle_add(void* object) {
+    pthread_mutex_lock(&table_lock);
+    for (u32 i = 1; i < MAX_HANDLES; i++) {
+        if (!handles[i]) {
+            handles[i] = object;
+            pthread_mutex_unlock(&table_lock);
+            return i;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    abort();
+}
+
+static void* handle_get(u32 handle) {
+    if (handle == 0 || handle >= MAX_HANDLES) abort();
+    void* object = handles[handle];
+    if (!object) abort();
+    return object;
+}
+
+static void* handle_take(u32 handle) {
+    pthread_mutex_lock(&table_lock);
+    void* object = (handle < MAX_HANDLES) ? handles[handle] : NULL;
+    if (handle < MAX_HANDLES) handles[handle] = NULL;
+    pthread_mutex_unlock(&table_lock);
+    return object;
+}
+
+// --- Threads ---
+
+s32 LWP_CreateThread(lwp_t* thethread, void* (*entry)(void*), void* arg,
+                     void* stackbase, u32 stack_size, u8 prio) {
+    ShimThread* t = calloc(1, sizeof(ShimThread));
+    if (!t) return -1;
+    if (pthread_create(&t->thread, NULL, entry, arg) != 0) {
+        free(t);
+        return -1;
+    }
+    *thethread = handle_add(t);
+    return 0;
+}
+
+s32 LWP_JoinThread(lwp_t thethread, void** value_ptr) {
+    ShimThread* t = handle_take(thethread);
+    if (!t) return -1;
+    pthread_join(t->thread, value_ptr);
+    free(t);
+    return 0;
+}
+
+void LWP_YieldThread(void) {
+    sched_yield();
+}
+
+// --- Mutexes and Condition Variables ---
+
+s32 LWP_MutexInit(mutex_t* mutex, bool use_recursive) {
+    pthread_mutex_t* m = malloc(sizeof(pthread_mutex_t));
+    if (!m) return -1;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (use_recursive) pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(m, &attr);
+    pthread_mutexattr_destroy(&attr);
+    *mutex = handle_add(m);
+    return 0;
+}
+
+s32 LWP_MutexDestroy(mutex_t mutex) {
+    pthread_mutex_t* m = handle_take(mutex);
+    if (!m) return -1;
+    pthread_mutex_destroy(m);
+    free(m);
+    return 0;
+}
+
+s32 LWP_MutexLock(mutex_t mutex) {
+    return pthread_mutex_lock(handle_get(mutex));
+}
+
+s32 LWP_MutexUnlock(mutex_t mutex) {
+    return pthread_mutex_unlock(handle_get(mutex));
+}
+
+s32 LWP_CondInit(cond_t* cond) {
+    pthread_cond_t* c = malloc(sizeof(pthread_cond_t));
+    if (!c) return -1;
+    pthread_cond_init(c, NULL);
+    *cond = handle_add(c);
+    return 0;
+}
+
+s32 LWP_CondDestroy(cond_t cond) {
+    pthread_cond_t* c = handle_take(cond);
+    if (!c) return -1;
+    pthread_cond_destroy(c);
+    free(c);
+    return 0;
+}
+
+s32 LWP_CondWait(cond_t cond, mutex_t mutex) {
+    return pthread_cond_wait(handle_get(cond), handle_get(mutex));
+}
+
+s32 LWP_CondSignal(cond_t cond) {
+    return pthread_cond_signal(handle_get(cond));
+}
+
+s32 LWP_CondBroadcast(cond_t cond) {
+    return pthread_cond_broadcast(handle_get(cond));
+}
+
+// --- Semaphores ---
+
+s32 LWP_SemInit(sem_t* sem, u32 start, u32 max) {
+    ShimSem* s = calloc(1, sizeof(ShimSem));
+    if (!s) return -1;
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->count = start;
+    s->max = max;
+    *sem = handle_add(s);
+    return 0;
+}
+
+s32 LWP_SemDestroy(sem_t sem) {
+    ShimSem* s = handle_take(sem);
+    if (!s) return -1;
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+    return 0;
+}
+
+s32 LWP_SemWait(sem_t sem) {
+    ShimSem* s = handle_get(sem);
+    pthread_mutex_lock(&s->mutex);
+    while (s->count == 0) {
+        pthread_cond_wait(&s->cond, &s->mutex);
+    }
+    s->count--;
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
+
+s32 LWP_SemPost(sem_t sem) {
+    ShimSem* s = handle_get(sem);
+    pthread_mutex_lock(&s->mutex);
+    if (s->count < s->max) s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
+
+// --- Message Queues ---
+
+s32 MQ_Init(mqbox_t* mqbox, u32 count) {
+    ShimQueue* q = calloc(1, sizeof(ShimQueue));
+    if (!q) return -1;
+    q->msgs = calloc(count ? count : 1, sizeof(mqmsg_t));
+    if (!q->msgs) {
+        free(q);
+        return -1;
+    }
+    q->size = count ? count : 1;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    *mqbox = handle_add(q);
+    return 0;
+}
+
+void MQ_Close(mqbox_t mqbox) {
+    ShimQueue* q = handle_take(mqbox);
+    if (!q) return;
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->mutex);
+    free(q->msgs);
+    free(q);
+}
+
+BOOL MQ_Send(mqbox_t mqbox, mqmsg_t msg, u32 flags) {
+    ShimQueue* q = handle_get(mqbox);
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == q->size) {
+        if (flags == MQ_MSG_NOBLOCK) {
+            pthread_mutex_unlock(&q->mutex);
+            return FALSE;
+        }
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    q->msgs[(q->head + q->count) % q->size] = msg;
+    q->count++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return TRUE;
+}
+
+BOOL MQ_Receive(mqbox_t mqbox, mqmsg_t* msg, u32 flags) {
+    ShimQueue* q = handle_get(mqbox);
+    pthread_mutex_lock(&q->mutex);
+    while (q->count == 0) {
+        if (flags == MQ_MSG_NOBLOCK) {
+            pthread_mutex_unlock(&q->mutex);
+            return FALSE;
+        }
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    *msg = q->msgs[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return TRUE;
+}
+
+// --- Cache, Memory and Time ---
+
+void DCFlushRange(void* startaddress, u32 len) {
+}
+
+void DCInvalidateRange(void* startaddress, u32 len) {
+}
+
+void* SYS_AllocArena2MemLo(u32 size, u32 align) {
+    return memalign(align ? align : 32, size);
+}
+
+u64 gettime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    u64 us = (u64)ts.tv_sec * 1000000ull + (u64)ts.tv_nsec / 1000;
+    // TB_TIMER_CLOCK ticks per millisecond
+    return us * TB_TIMER_CLOCK / 1000ull;
+}
+
+u32 diff_sec(u64 start, u64 end) {
+    return (u32)ticks_to_secs(end - start);
+}
+
+u32 diff_msec(u64 start, u64 end) {
+    return (u32)ticks_to_millisecs(end - start);
+}
+
+u32 diff_usec(u64 start, u64 end) {
+    return (u32)ticks_to_microsecs(end - start);
+}
+
+bool fatInitDefault(void) {
+    return true;
+}
@@ -0,0 +1,98 @@
+// source/image.c
+#include <stdio.h>
+#include <string.h>
+#include "image.h"
+
+static int sparse_mode = IMAGE_SPARSE_FORWARD;
+
+// First bytes of the source, which is then rewound
+static int image_peek(const FlashSource* source, uint8_t* buffer, uint32_t length) {
+    uint32_t filled = 0;
+    while (filled < length) {
+        const uint8_t* chunk;
+        int got = source->next(source->ctx, &chunk, length - filled);
+        if (got < 0) return -1;
+        if (got == 0) break;
+        memcpy(buffer + filled, chunk, got);
+        filled += got;
+    }
+    if (source->seek(source->ctx, 0) != 0) return -1;
+    return (int)filled;
+}
+
+int image_open(ImageStream* image, const FlashSource* input, uint64_t input_size,
+               const char* name) {
+    if (!image || !input) return -1;
+    memset(image, 0, sizeof(ImageStream));
+    image->source = *input;
+    image->size = input_size;
+
+    if (lz4_is_lz4_name(name)) {
+        image->lz4 = lz4_open(input);
+        if (!image->lz4) return -1;
+        image->size = lz4_size(image->lz4);
+        lz4_source(image->lz4, &image->source);
+    }
+
+    uint8_t magic[4];
+    int got = image_peek(&image->source, magic, sizeof(magic));
+    if (got < 0) {
+        image_close(image);
+        return -1;
+    }
+    image->sparse = sparse_is_sparse(magic, (uint32_t)got);
+
+    if (image->sparse && sparse_mode == IMAGE_SPARSE_EXPAND) {
+        image->sparse_stream = sparse_open(&image->source);
+        if (!image->sparse_stream) {
+            image_close(image);
+            return -1;
+        }
+        image->size = sparse_size(image->sparse_stream);
+        sparse_source(image->sparse_stream, &image->source);
+        image->expanded = 1;
+    }
+    return 0;
+}
+
+int image_read(ImageStream* image, uint8_t* buffer, uint32_t length) {
+    uint32_t copied = 0;
+    while (copied < length) {
+        const uint8_t* chunk = NULL;
+        int res = image->source.next(image->source.ctx, &chunk, length - copied);
+        if (res < 0) return res;
+        if (res == 0) break;
+        memcpy(buffer + copied, chunk, res);
+        copied += res;
+    }
+    return (int)copied;
+}
+
+void image_close(ImageStream* image) {
+    if (!image) return;
+    sparse_close(image->sparse_stream);
+    lz4_close(image->lz4);
+    image->sparse_stream = NULL;
+    image->lz4 = NULL;
+}
+
+int image_needs_decoding(const char* filename) {
+    if (lz4_is_lz4_name(filename)) return 1;
+    if (sparse_mode != IMAGE_SPARSE_EXPAND) return 0;
+
+    FILE* f = fopen(filename, "rb");
+    if (!f) return 0;
+    uint8_t magic[4];
+    int sparse = (fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                  sparse_is_sparse(magic, sizeof(magic)));
+    fclose(f);
+    return sparse;
+}
+
+void image_set_sparse_mode(int mode) {
+    sparse_mode = (mode == IMAGE_SPARSE_EXPAND) ? IMAGE_SPARSE_EXPAND : IMAGE_SPARSE_FORWARD;
+}
+
+int image_get_sparse_mode(void) {
+    return sparse_mode;
+}
@@ -0,0 +1,42 @@
+// source/image.h
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include "flash.h"
+#include "lz4.h"
+#include "sparse.h"
+
+// The decoding stack between a file (or an Odin package member) and the
+// flash engine: *.lz4 frames are decompressed, then Android sparse images
+// are either sent as they are or expanded, depending on the sparse mode.
+// Every stage pulls from the one below, so only block-sized windows are
+// ever resident.
+
+#define IMAGE_SPARSE_FORWARD 0  // Device expands sparse images itself (default)
+#define IMAGE_SPARSE_EXPAND  1  // Send the raw image; DONT_CARE goes out as zeros
+
+typedef struct {
+    FlashSource source;         // Bytes to flash
+    uint64_t size;
+    int sparse;                 // The image is an Android sparse image
+    int expanded;               // ... and source expands it
+    Lz4Stream* lz4;
+    SparseStream* sparse_stream;
+} ImageStream;
+
+// Stack decoders over input according to name and content.
+// Returns 0, or -1 when a stage does not accept the data.
+int image_open(ImageStream* image, const FlashSource* input, uint64_t input_size,
+               const char* name);
+// Copying read for the transfer ring
+int image_read(ImageStream* image, uint8_t* buffer, uint32_t length);
+void image_close(ImageStream* image);
+
+// Non-zero when the file cannot be sent byte for byte
+int image_needs_decoding(const char* filename);
+
+void image_set_sparse_mode(int mode);
+int image_get_sparse_mode(void);
+
+#endif
@@ -0,0 +1,602 @@
+// source/lz4.c
+#include <gccore.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <malloc.h>
+#include "lz4.h"
+#include "mem.h"
+
+#define LZ4_HISTORY         (64 * 1024)    // Furthest a match can reach back
+#define LZ4_SKIPPABLE_MASK  0xFFFFFFF0
+#define LZ4_SKIPPABLE_MAGIC 0x184D2A50
+
+// Frame descriptor flags
+#define LZ4_FLG_VERSION     0xC0
+#define LZ4_FLG_INDEPENDENT 0x20
+#define LZ4_FLG_BLOCK_SUM   0x10
+#define LZ4_FLG_SIZE        0x08
+#define LZ4_FLG_CONTENT_SUM 0x04
+#define LZ4_FLG_DICT_ID     0x01
+
+// --- xxHash32 ---
+
+// The frame format's checksum. Small streaming implementation so header,
+// block and content checksums can all be checked as data goes past.
+#define XXH_PRIME1 2654435761u
+#define XXH_PRIME2 2246822519u
+#define XXH_PRIME3 3266489917u
+#define XXH_PRIME4  668265263u
+#define XXH_PRIME5  374761393u
+
+typedef struct {
+    uint32_t v[4];
+    uint64_t length;
+    uint8_t buffer[16];
+    uint32_t buffered;
+} Xxh32;
+
+static inline uint32_t xxh_rotl(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t xxh_load(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t xxh_round(uint32_t acc, uint32_t input) {
+    acc += input * XXH_PRIME2;
+    return xxh_rotl(acc, 13) * XXH_PRIME1;
+}
+
+static void xxh32_init(Xxh32* h) {
+    h->v[0] = XXH_PRIME1 + XXH_PRIME2;
+    h->v[1] = XXH_PRIME2;
+    h->v[2] = 0;
+    h->v[3] = 0u - XXH_PRIME1;
+    h->length = 0;
+    h->buffered = 0;
+}
+
+static void xxh32_update(Xxh32* h, const uint8_t* data, uint32_t length) {
+    h->length += length;
+
+    if (h->buffered + length < 16) {
+        memcpy(h->buffer + h->buffered, data, length);
+        h->buffered += length;
+        return;
+    }
+    if (h->buffered) {
+        uint32_t take = 16 - h->buffered;
+        memcpy(h->buffer + h->buffered, data, take);
+        for (int i = 0; i < 4; i++) {
+            h->v[i] = xxh_round(h->v[i], xxh_load(h->buffer + i * 4));
+        }
+        data += take;
+        length -= take;
+        h->buffered = 0;
+    }
+    while (length >= 16) {
+        for (int i = 0; i < 4; i++) {
+            h->v[i] = xxh_round(h->v[i], xxh_load(data + i * 4));
+        }
+        data += 16;
+        length -= 16;
+    }
+    if (length) {
+        memcpy(h->buffer, data, length);
+        h->buffered = length;
+    }
+}
+
+static uint32_t xxh32_digest(const Xxh32* h) {
+    uint32_t acc;
+    if (h->length >= 16) {
+        acc = xxh_rotl(h->v[0], 1) + xxh_rotl(h->v[1], 7) +
+              xxh_rotl(h->v[2], 12) + xxh_rotl(h->v[3], 18);
+    } else {
+        acc = h->v[2] + XXH_PRIME5;
+    }
+    acc += (uint32_t)h->length;
+
+    const uint8_t* p = h->buffer;
+    uint32_t left = h->buffered;
+    while (left >= 4) {
+        acc += xxh_load(p) * XXH_PRIME3;
+        acc = xxh_rotl(acc, 17) * XXH_PRIME4;
+        p += 4;
+        left -= 4;
+    }
+    while (left--) {
+        acc += (*p++) * XXH_PRIME5;
+        acc = xxh_rotl(acc, 11) * XXH_PRIME1;
+    }
+
+    acc ^= acc >> 15;
+    acc *= XXH_PRIME2;
+    acc ^= acc >> 13;
+    acc *= XXH_PRIME3;
+    acc ^= acc >> 16;
+    return acc;
+}
+
+static uint32_t xxh32(const uint8_t* data, uint32_t length) {
+    Xxh32 h;
+    xxh32_init(&h);
+    xxh32_update(&h, data, length);
+    return xxh32_digest(&h);
+}
+
+// --- Stream State ---
+
+struct Lz4Stream {
+    FlashSource input;
+
+    // Frame
+    uint8_t flags;
+    uint32_t block_max;
+    uint64_t content_size;      // Found by lz4_size, over all frames
+    int size_known;
+    uint64_t frame_size;        // The current frame's, when it records one
+    int frame_sized;
+    uint64_t frame_start;       // Stream offset of the current frame's output
+    int in_frame;               // Between a frame header and its end mark
+    int input_done;
+    uint64_t input_pos;         // Compressed bytes consumed
+
+    // Compressed block staging, used when a block spans input chunks
+    uint8_t* in;
+
+    // Decoded output: LZ4_HISTORY bytes of history, then the current block
+    uint8_t* out;
+    uint32_t out_fill;          // Decoded bytes of the current block
+    uint32_t out_consumed;
+    uint64_t block_start;       // Stream offset of the current block
+    uint32_t history;           // Valid history bytes before the block
+
+    Xxh32 content_hash;
+    int error;
+};
+
+// Get length contiguous input bytes, without a copy when the input
+// already has them in one piece; otherwise they are gathered in staging.
+// Either way they stay valid only until the next read.
+static int lz4_input_staged(Lz4Stream* s, const uint8_t** data, uint32_t length,
+                            uint8_t* staging) {
+    const uint8_t* chunk;
+    int got = s->input.next(s->input.ctx, &chunk, length);
+    if (got == (int)length) {
+        *data = chunk;
+        s->input_pos += length;
+        return 0;
+    }
+    if (got <= 0) return (got == 0) ? 1 : -1;
+
+    uint32_t filled = 0;
+    while (1) {
+        memcpy(staging + filled, chunk, got);
+        filled += got;
+        if (filled == length) break;
+        got = s->input.next(s->input.ctx, &chunk, length - filled);
+        if (got <= 0) return -1; // Truncated
+    }
+    *data = staging;
+    s->input_pos += length;
+    return 0;
+}
+
+static int lz4_input(Lz4Stream* s, const uint8_t** data, uint32_t length) {
+    return lz4_input_staged(s, data, length, s->in);
+}
+
+// Step over length input bytes without reading them
+static int lz4_skip(Lz4Stream* s, uint32_t length) {
+    uint64_t target = s->input_pos + length;
+    if (target > 0xFFFFFFFFull || s->input.seek(s->input.ctx, (uint32_t)target) != 0) return -1;
+    s->input_pos = target;
+    return 0;
+}
+
+// Read a frame header. Returns 1 for a frame, 0 at the end of the input.
+static int lz4_read_frame_header(Lz4Stream* s, int first) {
+    while (1) {
+        const uint8_t* p;
+        int res = lz4_input(s, &p, 4);
+        if (res != 0) return (res > 0) ? 0 : -1;
+
+        uint32_t magic = xxh_load(p);
+        if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC) {
+            // Skippable frame: a length and that many bytes of anything
+            if (lz4_input(s, &p, 4) != 0) return -1;
+            uint32_t skip = xxh_load(p);
+            while (skip > 0) {
+                const uint8_t* chunk;
+                int got = s->input.next(s->input.ctx, &chunk, skip);
+                if (got <= 0) return -1;
+                skip -= got;
+                s->input_pos += got;
+            }
+            continue;
+        }
+        if (magic != LZ4_FRAME_MAGIC) return -1;
+        break;
+    }
+
+    uint8_t descriptor[15];
+    const uint8_t* p;
+    if (lz4_input(s, &p, 2) != 0) return -1;
+    memcpy(descriptor, p, 2);
+
+    uint8_t flags = descriptor[0];
+    if ((flags & LZ4_FLG_VERSION) != 0x40) return -1;
+    if (flags & LZ4_FLG_DICT_ID) return -1; // No preset dictionaries here
+
+    uint32_t block_id = (descriptor[1] >> 4) & 7;
+    if (block_id < 4) return -1;
+    uint32_t block_max = 1u << (2 * block_id + 8); // 64KB, 256KB, 1MB, 4MB
+
+    uint32_t length = 2 + ((flags & LZ4_FLG_SIZE) ? 8 : 0);
+    if (length > 2) {
+        if (lz4_input(s, &p, length - 2) != 0) return -1;
+        memcpy(descriptor + 2, p, length - 2);
+    }
+    if (lz4_input(s, &p, 1) != 0) return -1;
+    if (p[0] != ((xxh32(descriptor, length) >> 8) & 0xFF)) return -1;
+
+    // A later frame with bigger blocks needs bigger buffers; nothing
+    // carries over between frames so they can simply be replaced
+    if (!first && block_max > s->block_max) {
+        free(s->in);
+        mem_free(s->out);
+        s->in = malloc(block_max + 4);
+        s->out = mem_alloc(LZ4_HISTORY + block_max);
+        if (!s->in || !s->out) return -1;
+        s->block_max = block_max;
+    }
+
+    if (first) s->block_max = block_max;
+
+    // Each frame's size covers that frame only; concatenated frames add up
+    s->frame_sized = (flags & LZ4_FLG_SIZE) != 0;
+    s->frame_size = s->frame_sized ? ((uint64_t)xxh_load(descriptor + 2) |
+                                      ((uint64_t)xxh_load(descriptor + 6) << 32)) : 0;
+    s->frame_start = s->block_start;
+    s->flags = flags;
+    s->in_frame = 1;
+    s->history = 0; // Frames never reach into each other
+    xxh32_init(&s->content_hash);
+    return 1;
+}
+
+// --- Block Decoding ---
+
+// Decode one LZ4 block into dst, which has history bytes before it that
+// matches may reach into. Returns the decoded length or -1.
+static int lz4_decode_block(const uint8_t* src, uint32_t src_length,
+                            uint8_t* dst, uint32_t dst_capacity, uint32_t history) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + src_length;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dst_capacity;
+    const uint8_t* const lowest = dst - history;
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+
+        // Literals
+        uint32_t literal = token >> 4;
+        if (literal == 15) {
+            uint32_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                literal += b;
+            } while (b == 255);
+        }
+        if ((uint32_t)(iend - ip) < literal || (uint32_t)(oend - op) < literal) return -1;
+        memcpy(op, ip, literal);
+        ip += literal;
+        op += literal;
+
+        // The last sequence is literals only
+        if (ip >= iend) break;
+
+        // Match
+        if (iend - ip < 2) return -1;
+        uint32_t offset = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - lowest)) return -1;
+
+        uint32_t match = token & 15;
+        if (match == 15) {
+            uint32_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += 4;
+        if ((uint32_t)(oend - op) < match) return -1;
+
+        const uint8_t* from = op - offset;
+        if (offset >= match) {
+            memcpy(op, from, match);
+            op += match;
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            while (match--) *op++ = *from++;
+        }
+    }
+
+    return (int)(op - dst);
+}
+
+// Decode the next block into the output window. Returns 1 with a block,
+// 0 at the end of the stream, <0 on error.
+static int lz4_next_block(Lz4Stream* s) {
+    uint32_t previous = s->out_fill;
+    s->block_start += previous;
+    s->out_fill = 0;
+    s->out_consumed = 0;
+
+    while (1) {
+        if (!s->in_frame) {
+            if (s->input_done) return 0;
+            previous = 0;
+            int res = lz4_read_frame_header(s, 0);
+            if (res <= 0) {
+                s->input_done = 1;
+                if (res < 0) return -1;
+                if (s->size_known && s->block_start != s->content_size) return -1;
+                return 0;
+            }
+        }
+
+        const uint8_t* p;
+        if (lz4_input(s, &p, 4) != 0) return -1;
+        uint32_t word = xxh_load(p);
+
+        if (word == 0) {
+            // End mark, then the content checksum
+            if (s->frame_sized && s->block_start - s->frame_start != s->frame_size) return -1;
+            if (s->flags & LZ4_FLG_CONTENT_SUM) {
+                if (lz4_input(s, &p, 4) != 0) return -1;
+                if (xxh_load(p) != xxh32_digest(&s->content_hash)) return -1;
+            }
+            s->in_frame = 0;
+            continue;
+        }
+
+        uint32_t length = word & 0x7FFFFFFF;
+        int stored = (word & 0x80000000) != 0;
+        if (length > s->block_max) return -1;
+
+        // The block is used up before its checksum is read: that read may
+        // move the input window under it, or stage over it in s->in
+        const uint8_t* block;
+        if (lz4_input(s, &block, length) != 0) return -1;
+        uint32_t sum = 0;
+        if (s->flags & LZ4_FLG_BLOCK_SUM) sum = xxh32(block, length);
+
+        // Linked blocks keep the last 64KB of output as history
+        uint32_t keep = 0;
+        if (!(s->flags & LZ4_FLG_INDEPENDENT)) {
+            uint32_t total = s->history + previous;
+            keep = (total < LZ4_HISTORY) ? total : LZ4_HISTORY;
+            memmove(s->out + LZ4_HISTORY - keep,
+                    s->out + LZ4_HISTORY + previous - keep, keep);
+        }
+        s->history = keep;
+
+        uint8_t* dst = s->out + LZ4_HISTORY;
+        int decoded;
+        if (stored) {
+            memcpy(dst, block, length);
+            decoded = (int)length;
+        } else {
+            decoded = lz4_decode_block(block, length, dst, s->block_max, keep);
+        }
+        if (decoded < 0) return -1;
+
+        if (s->flags & LZ4_FLG_BLOCK_SUM) {
+            uint8_t staging[4];
+            if (lz4_input_staged(s, &p, 4, staging) != 0 || xxh_load(p) != sum) return -1;
+        }
+
+        s->out_fill = (uint32_t)decoded;
+        previous = s->out_fill;
+        if (s->frame_sized && s->block_start + s->out_fill - s->frame_start > s->frame_size) {
+            return -1;
+        }
+        if (s->size_known && s->block_start + s->out_fill > s->content_size) return -1;
+        if (s->flags & LZ4_FLG_CONTENT_SUM) {
+            xxh32_update(&s->content_hash, dst, s->out_fill);
+        }
+        if (s->out_fill > 0) return 1;
+    }
+}
+
+// Back to the first frame
+static int lz4_restart(Lz4Stream* s) {
+    if (s->input.seek(s->input.ctx, 0) != 0) return -1;
+
+    s->in_frame = 0;
+    s->input_done = 0;
+    s->out_fill = 0;
+    s->out_consumed = 0;
+    s->block_start = 0;
+    s->history = 0;
+    s->error = 0;
+    s->input_pos = 0;
+    return (lz4_read_frame_header(s, 0) == 1) ? 0 : -1;
+}
+
+// Add up the frames' recorded sizes from their headers alone, seeking over
+// the blocks. Starts at the first frame. 1 with the total, 0 when a frame
+// records no size, -1 on a damaged stream.
+static int lz4_measure(Lz4Stream* s, uint64_t* total) {
+    *total = 0;
+    while (1) {
+        if (!s->frame_sized) return 0;
+        *total += s->frame_size;
+
+        const uint8_t* p;
+        while (1) {
+            if (lz4_input(s, &p, 4) != 0) return -1;
+            uint32_t word = xxh_load(p);
+            if (word == 0) break;
+            uint32_t length = word & 0x7FFFFFFF;
+            if (length > s->block_max) return -1;
+            if (s->flags & LZ4_FLG_BLOCK_SUM) length += 4;
+            if (lz4_skip(s, length) != 0) return -1;
+        }
+        if ((s->flags & LZ4_FLG_CONTENT_SUM) && lz4_skip(s, 4) != 0) return -1;
+
+        s->in_frame = 0;
+        int res = lz4_read_frame_header(s, 0);
+        if (res <= 0) return (res == 0) ? 1 : -1;
+    }
+}
+
+// --- Public API ---
+
+Lz4Stream* lz4_open(const FlashSource* input) {
+    if (!input || !input->next || !input->seek) return NULL;
+
+    Lz4Stream* s = calloc(1, sizeof(Lz4Stream));
+    if (!s) return NULL;
+    s->input = *input;
+
+    // The header comes in small pieces; stage it in a scratch buffer
+    uint8_t header[32];
+    s->in = header;
+    int res = lz4_read_frame_header(s, 1);
+    s->in = NULL;
+    if (res != 1) {
+        free(s);
+        return NULL;
+    }
+
+    s->in = malloc(s->block_max + 4);
+    s->out = mem_alloc(LZ4_HISTORY + s->block_max);
+    if (!s->in || !s->out) {
+        lz4_close(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+uint64_t lz4_size(Lz4Stream* s) {
+    if (!s) return 0;
+    if (s->size_known) return s->content_size;
+
+    // The headers give it when every frame records its size; otherwise
+    // decode once to count. Either way start over afterwards.
+    uint64_t total = 0;
+    int res = (lz4_restart(s) == 0) ? lz4_measure(s, &total) : -1;
+    if (res == 0) {
+        total = 0;
+        res = (lz4_restart(s) == 0) ? 1 : -1;
+        while (res > 0 && (res = lz4_next_block(s)) > 0) {
+            total += s->out_fill;
+        }
+    }
+    if (res < 0 || lz4_restart(s) != 0) {
+        s->error = -1;
+        return 0;
+    }
+
+    s->content_size = total;
+    s->size_known = 1;
+    return total;
+}
+
+int lz4_next(Lz4Stream* s, const uint8_t** chunk, uint32_t max) {
+    if (!s || !chunk || max == 0) return -1;
+    if (s->error) return s->error;
+
+    if (s->out_consumed >= s->out_fill) {
+        int res = lz4_next_block(s);
+        if (res <= 0) {
+            if (res < 0) s->error = res;
+            return res;
+        }
+    }
+
+    uint32_t available = s->out_fill - s->out_consumed;
+    uint32_t length = (available < max) ? available : max;
+    *chunk = s->out + LZ4_HISTORY + s->out_consumed;
+    s->out_consumed += length;
+    return (int)length;
+}
+
+int lz4_read(Lz4Stream* s, uint8_t* buffer, uint32_t length) {
+    uint32_t copied = 0;
+    while (copied < length) {
+        const uint8_t* chunk = NULL;
+        int res = lz4_next(s, &chunk, length - copied);
+        if (res < 0) return res;
+        if (res == 0) break;
+        memcpy(buffer + copied, chunk, res);
+        copied += res;
+    }
+    return (int)copied;
+}
+
+int lz4_seek(Lz4Stream* s, uint64_t offset) {
+    if (!s) return -1;
+
+    // Inside the block already decoded
+    if (offset >= s->block_start && offset <= s->block_start + s->out_fill) {
+        s->out_consumed = (uint32_t)(offset - s->block_start);
+        return 0;
+    }
+
+    // Blocks chain through their history, so going back means decoding
+    // from the start again; resends are rare enough for that to be fine
+    if (offset < s->block_start && lz4_restart(s) != 0) {
+        s->error = -1;
+        return -1;
+    }
+
+    while (offset > s->block_start + s->out_fill) {
+        int res = lz4_next_block(s);
+        if (res <= 0) {
+            s->error = -1;
+            return -1;
+        }
+    }
+    s->out_consumed = (uint32_t)(offset - s->block_start);
+    return 0;
+}
+
+static int lz4_source_next(void* ctx, const uint8_t** chunk, uint32_t max) {
+    return lz4_next((Lz4Stream*)ctx, chunk, max);
+}
+
+static int lz4_source_seek(void* ctx, uint32_t offset) {
+    return lz4_seek((Lz4Stream*)ctx, offset);
+}
+
+void lz4_source(Lz4Stream* s, FlashSource* source) {
+    source->next = lz4_source_next;
+    source->seek = lz4_source_seek;
+    source->ctx = s;
+}
+
+void lz4_close(Lz4Stream* s) {
+    if (!s) return;
+    free(s->in);
+    mem_free(s->out);
+    free(s);
+}
+
+int lz4_is_lz4_name(const char* filename) {
+    if (!filename) return 0;
+    size_t length = strlen(filename);
+    return length > 4 && strcasecmp(filename + length - 4, ".lz4") == 0;
+}
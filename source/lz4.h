@@ -0,0 +1,48 @@
+// source/lz4.h
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+#include "flash.h"
+
+// Streaming LZ4 frame decoder for Samsung *.img.lz4 images. Compressed
+// bytes are pulled from any FlashSource (a FileReader, a member of an
+// Odin package) and decoded one block at a time into a 32-byte aligned
+// window, so memory is bounded by the frame's block size (64KB to 4MB)
+// plus 64KB of match history however large the image is. Header, block
+// and content checksums are checked when the frame carries them.
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+
+typedef struct Lz4Stream Lz4Stream;
+
+// Reads the first frame header. NULL if the input is not an LZ4 frame.
+Lz4Stream* lz4_open(const FlashSource* input);
+
+// Decompressed size over all concatenated frames. When every frame records
+// its content size the headers are read and the blocks seeked over;
+// otherwise the stream is decoded once up front to count.
+uint64_t lz4_size(Lz4Stream* stream);
+
+// Zero-copy: points *chunk at up to max decoded bytes. The data stays
+// valid until the next call. Returns the count, 0 at the end, <0 on a
+// corrupt stream, a checksum mismatch or a size that disagrees with the
+// frame header.
+int lz4_next(Lz4Stream* stream, const uint8_t** chunk, uint32_t max);
+
+// Copying read into a caller buffer (the transfer ring)
+int lz4_read(Lz4Stream* stream, uint8_t* buffer, uint32_t length);
+
+// Position in the decoded stream. Inside the current block this is free;
+// anywhere else decoding restarts from the nearest point it can.
+int lz4_seek(Lz4Stream* stream, uint64_t offset);
+
+// FlashSource over the decoded data, for flash_stream
+void lz4_source(Lz4Stream* stream, FlashSource* source);
+
+void lz4_close(Lz4Stream* stream);
+
+// Name ends in .lz4
+int lz4_is_lz4_name(const char* filename);
+
+#endif
@@ -6,7 +6,15 @@
 #include <stdlib.h>
 #include "gui.h"
 #include "heimdall.h"
+#include "usb.h"
 #include "config.h"
+#include "odin.h"
+#include "digest.h"
+#include "backup.h"
+#include "batch.h"
+#include "worker.h"
+#include "telemetry.h"
+#include "cache.h"
 
 // --- State Machine Definitions ---
 typedef enum {
@@ -15,7 +23,10 @@ typedef enum {
     STATE_PIT_LOAD,
     STATE_FLASHING,
     STATE_REBOOT,
-    STATE_SETTINGS
+    STATE_SETTINGS,
+    STATE_BACKUP,
+    STATE_BATCH,
+    STATE_WORKING
 } AppState;
 
 // Note: Ensure this struct matches what you have in config.h
@@ -30,20 +41,76 @@ typedef struct {
     int auto_reboot;
     int verify_flash;
     int safe_mode;
+    int delta_flash;
+    int cache_budget_mb;
 } AppData;
 
 static AppData app;
 static int running = 1;
+static int quit_after_job = 0;
+static uint32_t progress_shown = 0;
 
 // --- Callback for Flashing Progress ---
+// Runs on the worker thread; the UI picks the snapshot up once a frame
 int on_flash_progress(float progress, const char* status) {
-    app.flash_progress = progress;
-    if (status) {
-        strncpy(app.status_text, status, sizeof(app.status_text)-1);
+    worker_publish_progress(progress, status);
+    return 1; 
+}
+
+// --- Worker Jobs ---
+// Flashing, backups and verifies run on the worker so WPAD and the screen
+// stay live. Jobs must not touch the GUI: their lines go through the
+// worker's message queue, and each returns the state to go to next.
+
+static void job_log(const char* text, int type) {
+    worker_post(WORKER_MSG_LOG, type, text);
+}
+
+static void job_message(const char* text, int type) {
+    worker_post(WORKER_MSG_NOTICE, type, text);
+}
+
+static void start_job(WorkerJob job) {
+    if (worker_start(job, NULL) != 0) {
+        gui_show_message("Busy, try again", MSG_ERROR);
+        app.state = STATE_MAIN_MENU;
+        return;
+    }
+    app.prev_state = app.state;
+    app.state = STATE_WORKING;
+}
+
+void handle_working(u32 pressed) {
+    if ((pressed & (WPAD_BUTTON_B | WPAD_BUTTON_HOME)) && !worker_cancelled()) {
+        worker_cancel();
+        gui_log("Cancelling...", MSG_WARNING);
     }
+    if (pressed & WPAD_BUTTON_HOME) quit_after_job = 1;
     
-    gui_set_progress(progress, status);
-    return 1; 
+    WorkerProgress progress;
+    worker_get_progress(&progress);
+    if (progress.updates != progress_shown) {
+        progress_shown = progress.updates;
+        app.flash_progress = progress.progress;
+        strncpy(app.status_text, progress.status, sizeof(app.status_text)-1);
+        gui_set_progress(progress.progress, progress.status);
+    }
+    
+    WorkerMessage message;
+    while (worker_poll(&message)) {
+        switch (message.type) {
+            case WORKER_MSG_LOG:    gui_log(message.text, message.level); break;
+            case WORKER_MSG_NOTICE: gui_show_message(message.text, message.level); break;
+            case WORKER_MSG_DONE:
+                if (worker_cancelled()) gui_show_message("Cancelled", MSG_WARNING);
+                app.flash_progress = 0;
+                // What the tuner learnt about this phone outlives the session
+                config_save_tuner();
+                app.state = (AppState)message.result;
+                if (quit_after_job) running = 0;
+                break;
+        }
+    }
 }
 
 // --- State Machine Handlers ---
@@ -61,6 +128,9 @@ void handle_main_menu(u32 pressed) {
             case 7: app.state = STATE_REBOOT; break;
             case 8: app.state = STATE_SETTINGS; break;
             case 9: running = 0; break;
+            case 10: strcpy(app.current_file, "sd:/firmware.tar.md5"); app.state = STATE_FLASHING; break;
+            case 11: app.state = STATE_BACKUP; break;
+            case 12: app.state = STATE_BATCH; break;
         }
     }
 }
@@ -80,11 +150,19 @@ void handle_device_detect(void) {
 }
 
 void handle_pit_load(void) {
-    gui_show_message("Loading PIT file...", MSG_INFO);
+    // A connected phone gives its own PIT; sd:/pit.pit is the fallback
+    int downloaded = -1;
+    if (app.device_connected) {
+        gui_show_message("Reading PIT from device...", MSG_INFO);
+        downloaded = heimdall_download_pit();
+        if (downloaded == 1) gui_log("Device PIT matches the copy on SD", MSG_INFO);
+    }
+    if (downloaded < 0) gui_show_message("Loading PIT file...", MSG_INFO);
     
-    if (heimdall_load_pit("sd:/pit.pit") == 0) {
+    if (downloaded >= 0 || heimdall_load_pit("sd:/pit.pit") == 0) {
         app.pit_loaded = 1;
-        gui_show_message("PIT file loaded successfully", MSG_SUCCESS);
+        gui_show_message(downloaded >= 0 ? "PIT read from device" : "PIT file loaded successfully",
+                         MSG_SUCCESS);
         PitInfo* pit = heimdall_get_pit_info();
         if (pit) {
             char info[256];
@@ -93,40 +171,271 @@ void handle_pit_load(void) {
         }
     } else {
         gui_show_message("Failed to load PIT file", MSG_ERROR);
-        gui_log("Place pit.pit on SD card root", MSG_ERROR);
+        gui_log(app.device_connected ? "Device sent no PIT and there is no sd:/pit.pit"
+                                     : "Detect the device or place pit.pit on SD card root",
+                MSG_ERROR);
     }
     app.state = STATE_MAIN_MENU;
 }
 
-void handle_flashing(void) {
+// Partitions that can't be rebuilt from firmware: IMEI/calibration and baseband
+static const char* backup_partitions[] = { "EFS", "MODEM", "RADIO" };
+
+// Returns the number of backups that failed
+int backup_device(void) {
+    char msg[256];
+    int failed = 0;
+    PitInfo* pit = heimdall_get_pit_info();
+    
+    for (size_t i = 0; i < sizeof(backup_partitions) / sizeof(backup_partitions[0]); i++) {
+        if (pit_find_partition(pit, backup_partitions[i], NULL) != 0) continue;
+        
+        int result = heimdall_backup_partition(backup_partitions[i], on_flash_progress);
+        const BackupReport* report = backup_get_report();
+        if (result == 0) {
+            snprintf(msg, sizeof(msg), "%s -> %s (crc32 %08x%s)", backup_partitions[i],
+                     report->image_path, (unsigned int)report->checksum,
+                     report->resumed_from ? ", resumed" : "");
+            job_log(msg, MSG_SUCCESS);
+        } else {
+            snprintf(msg, sizeof(msg), "Backup of %s failed (%d)", backup_partitions[i], result);
+            job_log(msg, MSG_ERROR);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int backup_job(void* arg) {
+    if (backup_device() == 0) {
+        job_message("Backup complete", MSG_SUCCESS);
+    } else {
+        job_message("Backup failed!", MSG_ERROR);
+    }
+    return STATE_MAIN_MENU;
+}
+
+void handle_backup(void) {
+    if (!app.pit_loaded) {
+        gui_show_message("Load a PIT first", MSG_ERROR);
+        app.state = STATE_MAIN_MENU;
+        return;
+    }
+    start_job(backup_job);
+}
+
+// Read a partition back and compare it with what was sent
+int verify_partition(const char* partition) {
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Verifying %s...", partition);
+    job_log(msg, MSG_INFO);
+    
+    int result = flash_verify(partition, on_flash_progress);
+    const FlashVerifyReport* report = flash_get_verify_report();
+    if (result == 0) {
+        snprintf(msg, sizeof(msg), "%s verified (%llu MB)", partition,
+                 (unsigned long long)(report->bytes >> 20));
+        job_log(msg, MSG_SUCCESS);
+    } else if (result == -2 && report->mismatched > 0) {
+        snprintf(msg, sizeof(msg), "%s: first mismatching block %d at 0x%llx (%u bad)",
+                 partition, report->first_bad_block,
+                 (unsigned long long)report->first_bad_block * DIGEST_BLOCK_SIZE,
+                 report->mismatched);
+        job_log(msg, MSG_ERROR);
+    } else if (result == -2) {
+        snprintf(msg, sizeof(msg), "%s: image CRC32 %08x, expected %08x", partition,
+                 report->actual, report->expected);
+        job_log(msg, MSG_ERROR);
+    } else {
+        snprintf(msg, sizeof(msg), "%s could not be read back", partition);
+        job_log(msg, MSG_ERROR);
+    }
+    return result;
+}
+
+// Odin packages stream every image straight out of the archive
+int flash_package(void) {
+    const char* filename = app.current_file;
+    char msg[512];
+    snprintf(msg, sizeof(msg), "Flashing package %s...", filename);
+    job_message(msg, MSG_INFO);
+    if (!app.pit_loaded) {
+        job_log("No PIT loaded: mapping images by file name", MSG_WARNING);
+    }
+    
+    digest_clear(); // So only this package's images get verified
+    int result = heimdall_flash_package(filename, on_flash_progress);
+    const OdinReport* report = odin_get_report();
+    
+    for (uint32_t i = 0; result == 0 && app.verify_flash && i < DIGEST_MAX_RECORDS; i++) {
+        const ImageDigest* digest = digest_get(i);
+        if (digest && verify_partition(digest->partition) != 0) result = -5;
+    }
+    
+    snprintf(msg, sizeof(msg), "%u of %u images flashed, %u skipped",
+             report->flashed, report->members, report->skipped);
+    job_log(msg, MSG_INFO);
+    
+    if (result == 0) {
+        if (report->md5_present) job_log("Package MD5 verified", MSG_SUCCESS);
+        job_message("Flash completed successfully!", MSG_SUCCESS);
+        return app.auto_reboot ? STATE_REBOOT : STATE_MAIN_MENU;
+    } else {
+        if (result == -4) {
+            snprintf(msg, sizeof(msg), "MD5 mismatch: expected %s, got %s",
+                     report->expected_md5, report->actual_md5);
+            job_log(msg, MSG_ERROR);
+        } else if (report->failed_member[0]) {
+            snprintf(msg, sizeof(msg), "Failed on %s", report->failed_member);
+            job_log(msg, MSG_ERROR);
+        }
+        job_message(result == -5 ? "Verify failed!" : "Flash failed!", MSG_ERROR);
+        return STATE_MAIN_MENU;
+    }
+}
+
+// Safe mode keeps a copy of EFS/modem before the first flash of a session.
+// Returns 0 when flashing may go ahead.
+int safe_mode_backup(void) {
+    static int backed_up = 0;
+    if (!app.safe_mode || !app.pit_loaded || backed_up) return 0;
+    
+    job_log("Safe mode: backing up EFS/modem first", MSG_INFO);
+    if (backup_device() != 0) {
+        job_message("Backup failed, not flashing", MSG_ERROR);
+        return -1;
+    }
+    backed_up = 1;
+    return 0;
+}
+
+// Images picked up from the SD card root by "Flash all"
+static const char* batch_files[] = {
+    "sd:/boot.img", "sd:/recovery.img", "sd:/system.img", "sd:/system.img.lz4",
+    "sd:/cache.img", "sd:/modem.bin"
+};
+
+// Every image on the card goes out in one Odin session
+int batch_job(void* arg) {
+    char msg[512];
+    if (safe_mode_backup() != 0) return STATE_MAIN_MENU;
+    
+    const PitInfo* pit = app.pit_loaded ? heimdall_get_pit_info() : NULL;
+    batch_clear();
+    for (size_t i = 0; i < sizeof(batch_files) / sizeof(batch_files[0]); i++) {
+        char partition[32];
+        if (odin_map_partition(pit, batch_files[i] + 4, partition, sizeof(partition)) == 0) {
+            batch_add(batch_files[i], partition);
+        }
+    }
+    if (batch_count() == 0) {
+        job_message("No images found on the SD card", MSG_ERROR);
+        return STATE_MAIN_MENU;
+    }
+    
+    snprintf(msg, sizeof(msg), "Flashing %u images...", batch_count());
+    job_message(msg, MSG_INFO);
+    
+    digest_clear();
+    int result = heimdall_flash_batch(on_flash_progress);
+    const BatchReport* report = batch_get_report();
+    
+    for (uint32_t i = 0; i < report->count; i++) {
+        const BatchItem* item = &report->items[i];
+        if (item->result == BATCH_ITEM_PENDING) {
+            snprintf(msg, sizeof(msg), "%s: not flashed", item->partition);
+            job_log(msg, MSG_WARNING);
+            continue;
+        }
+        if (item->result != 0) {
+            snprintf(msg, sizeof(msg), "%s: %s failed (%d)", item->partition,
+                     item->filename, item->result);
+            job_log(msg, MSG_ERROR);
+            continue;
+        }
+        uint64_t us = item->flash_us ? item->flash_us : 1;
+        snprintf(msg, sizeof(msg), "%s: %llu MB in %llu ms (%llu KB/s)", item->partition,
+                 (unsigned long long)(item->image_size >> 20),
+                 (unsigned long long)(item->flash_us / 1000),
+                 (unsigned long long)(item->image_size * 1000000 / us / 1024));
+        job_log(msg, MSG_SUCCESS);
+        if (app.verify_flash && verify_partition(item->partition) != 0) result = -5;
+    }
+    
+    if (result == 0) {
+        job_message("Flash completed successfully!", MSG_SUCCESS);
+        return app.auto_reboot ? STATE_REBOOT : STATE_MAIN_MENU;
+    } else {
+        job_message(result == -5 ? "Verify failed!" : "Flash failed!", MSG_ERROR);
+        return STATE_MAIN_MENU;
+    }
+}
+
+void handle_batch_flashing(void) {
+    start_job(batch_job);
+}
+
+int flash_job(void* arg) {
     const char* filename = app.current_file;
+    
+    if (safe_mode_backup() != 0) return STATE_MAIN_MENU;
+    if (heimdall_is_package(filename)) {
+        return flash_package();
+    }
+    
     const char* partition = heimdall_determine_partition(filename);
     
     if (!partition) {
-        gui_show_message("Unknown file type", MSG_ERROR);
-        app.state = STATE_MAIN_MENU;
-        return;
+        job_message("Unknown file type", MSG_ERROR);
+        return STATE_MAIN_MENU;
     }
     
     char msg[512]; 
     snprintf(msg, sizeof(msg), "Flashing %s to %s...", filename, partition);
-    gui_show_message(msg, MSG_INFO);
-    
-    int result = heimdall_flash_file(filename, partition, on_flash_progress);
+    job_message(msg, MSG_INFO);
     
+    // Delta needs the PIT: the base is kept per device
+    int result;
+    if (app.delta_flash && app.pit_loaded) {
+        result = heimdall_flash_delta(filename, partition, on_flash_progress);
+        const FlashReport* report = heimdall_get_delta_report();
+        if (result == 0) {
+            snprintf(msg, sizeof(msg), "Delta: %u of %u blocks unchanged, %u sent",
+                     report->unchanged, report->parts, report->parts - report->unchanged);
+            job_log(msg, MSG_INFO);
+        }
+    } else {
+        result = heimdall_flash_file(filename, partition, on_flash_progress);
+    }
     if (result == 0) {
-        gui_show_message("Flash completed successfully!", MSG_SUCCESS);
-        app.state = app.auto_reboot ? STATE_REBOOT : STATE_MAIN_MENU;
+        const TelemetryStats* stats = telemetry_get();
+        snprintf(msg, sizeof(msg), "%.1f MB/s average, %.1f peak, %.1f min, %.1f s",
+                 stats->overall / (1024.0 * 1024.0), stats->peak / (1024.0 * 1024.0),
+                 stats->minimum / (1024.0 * 1024.0), stats->elapsed_us / 1000000.0);
+        job_log(msg, MSG_INFO);
+    }
+    int verified = 0;
+    if (result == 0 && app.verify_flash) {
+        verified = verify_partition(partition);
+    }
+    
+    if (result == 0 && verified == 0) {
+        job_message("Flash completed successfully!", MSG_SUCCESS);
+        return app.auto_reboot ? STATE_REBOOT : STATE_MAIN_MENU;
     } else {
-        gui_show_message("Flash failed!", MSG_ERROR);
-        app.state = STATE_MAIN_MENU;
+        job_message(result == 0 ? "Verify failed!" : "Flash failed!", MSG_ERROR);
+        return STATE_MAIN_MENU;
     }
-    app.flash_progress = 0;
+}
+
+void handle_flashing(void) {
+    start_job(flash_job);
 }
 
 void handle_reboot(void) {
     gui_show_message("Rebooting device...", MSG_INFO);
     if (heimdall_reboot() == 0) {
+        app.device_connected = 0; // Detect again once it is back in download mode
         gui_show_message("Reboot command sent", MSG_SUCCESS);
     } else {
         gui_show_message("Failed to send reboot", MSG_ERROR);
@@ -142,6 +451,13 @@ void handle_settings(u32 pressed) {
             case 2: app.safe_mode = !app.safe_mode; break;
             case 3: config_save(&app); gui_show_message("Settings saved", MSG_SUCCESS); break;
             case 4: app.state = STATE_MAIN_MENU; break;
+            case 5: app.delta_flash = !app.delta_flash; break;
+            case 6:
+                // 0 (off) to 32 MB of MEM2; the region is taken on first use,
+                // so a bigger budget than that only counts after a restart
+                app.cache_budget_mb = (app.cache_budget_mb >= 32) ? 0 : app.cache_budget_mb + 8;
+                cache_set_budget((uint32_t)app.cache_budget_mb << 20);
+                break;
         }
     }
     if (pressed & WPAD_BUTTON_B) app.state = STATE_MAIN_MENU;
@@ -167,20 +483,27 @@ int main(int argc, char **argv) {
     memset(&app, 0, sizeof(app));
     app.state = STATE_MAIN_MENU;
     app.safe_mode = 1;
+    app.cache_budget_mb = CACHE_DEFAULT_BUDGET >> 20;
     
     // Load existing settings if any
     config_load(&app);
+    cache_set_budget((uint32_t)app.cache_budget_mb << 20);
     
-    // 5. Initialize USB Subsystem
+    // 5. Initialize USB Subsystem on the Wii's own USB stack
+    usb_set_transport(usb_ogc_transport());
     if (heimdall_init() != 0) {
         gui_show_message("USB init failed! Connect to Port 0.", MSG_ERROR);
     }
+    if (worker_init() != 0) {
+        gui_show_message("Worker thread failed to start!", MSG_ERROR);
+    }
     
     while(running) {
         WPAD_ScanPads();
         u32 pressed = WPAD_ButtonsDown(0);
         
-        if (pressed & WPAD_BUTTON_HOME) break;
+        // While a job runs HOME cancels it first
+        if ((pressed & WPAD_BUTTON_HOME) && app.state != STATE_WORKING) break;
         
         switch(app.state) {
             case STATE_MAIN_MENU:
@@ -191,8 +514,12 @@ int main(int argc, char **argv) {
             case STATE_PIT_LOAD:      handle_pit_load(); break;
             case STATE_FLASHING:      handle_flashing(); break;
             case STATE_REBOOT:        handle_reboot(); break;
+            case STATE_BACKUP:        handle_backup(); break;
+            case STATE_BATCH:         handle_batch_flashing(); break;
+            case STATE_WORKING:       handle_working(pressed); break;
             case STATE_SETTINGS:
-                gui_show_settings(app.auto_reboot, app.verify_flash, app.safe_mode);
+                gui_show_settings(app.auto_reboot, app.verify_flash, app.safe_mode,
+                                  app.cache_budget_mb);
                 handle_settings(pressed);
                 break;
         }
@@ -202,6 +529,7 @@ int main(int argc, char **argv) {
     }
     
     // 6. Cleanup
+    worker_shutdown();
     heimdall_cleanup();
     gui_cleanup();
     
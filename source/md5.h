@@ -0,0 +1,22 @@
+// source/md5.h
+#ifndef MD5_H
+#define MD5_H
+
+#include <stdint.h>
+
+// MD5 (RFC 1321), fed incrementally. Used to check the digest Odin
+// appends to .tar.md5 packages while the package streams past.
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;            // Bytes hashed so far
+    uint8_t block[64];          // Partial input block
+} Md5Context;
+
+void md5_init(Md5Context* ctx);
+void md5_update(Md5Context* ctx, const uint8_t* data, uint32_t length);
+void md5_final(Md5Context* ctx, uint8_t digest[16]);
+
+// Lowercase hex, out must hold 33 bytes
+void md5_to_hex(const uint8_t digest[16], char* out);
+
+#endif
@@ -0,0 +1,148 @@
+// source/mem.c
+#include <gccore.h>
+#include <string.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "mem.h"
+
+typedef struct {
+    uint32_t size;
+    uint32_t count;
+    uint8_t* base;
+    uint16_t* free_list;        // Stack of free buffer indices
+    uint32_t free_count;
+} MemPool;
+
+static MemPool pools[MEM_POOLS] = {
+    { MEM_SMALL_SIZE, MEM_SMALL_COUNT, NULL, NULL, 0 },
+    { MEM_LARGE_SIZE, MEM_LARGE_COUNT, NULL, NULL, 0 },
+};
+static uint8_t* arena = NULL;
+static uint32_t arena_top = 0;
+static MemStats stats;
+static mutex_t mem_lock = LWP_MUTEX_NULL;
+static int mem_ready = 0;
+static int mem_failed = 0;
+
+// Carve the pools and the arena out of MEM2 once. Runs on the first
+// allocation, which comes from the main thread before any worker starts.
+static int mem_setup(void) {
+    if (mem_ready) return 0;
+    if (mem_failed) return -1;
+
+    for (int i = 0; i < MEM_POOLS; i++) {
+        MemPool* p = &pools[i];
+        p->base = SYS_AllocArena2MemLo(p->size * p->count, 32);
+        p->free_list = malloc(p->count * sizeof(uint16_t));
+        if (!p->base || !p->free_list) {
+            mem_failed = 1;
+            return -1;
+        }
+        // Lowest index on top, so a quiet session keeps reusing the same few
+        for (uint32_t j = 0; j < p->count; j++) {
+            p->free_list[j] = (uint16_t)(p->count - 1 - j);
+        }
+        p->free_count = p->count;
+        stats.pools[i].size = p->size;
+        stats.pools[i].count = p->count;
+    }
+    arena = SYS_AllocArena2MemLo(MEM_ARENA_SIZE, 32);
+    LWP_MutexInit(&mem_lock, false);
+    mem_ready = 1;
+    return 0;
+}
+
+static int mem_pool_of(const void* buffer) {
+    const uint8_t* p = (const uint8_t*)buffer;
+    for (int i = 0; i < MEM_POOLS; i++) {
+        if (pools[i].base && p >= pools[i].base &&
+            p < pools[i].base + pools[i].size * pools[i].count) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void* mem_alloc(uint32_t size) {
+    if (size == 0) return NULL;
+    if (mem_setup() == 0) {
+        LWP_MutexLock(mem_lock);
+        for (int i = 0; i < MEM_POOLS; i++) {
+            MemPool* p = &pools[i];
+            if (size > p->size || p->free_count == 0) continue;
+
+            uint16_t index = p->free_list[--p->free_count];
+            MemPoolStats* s = &stats.pools[i];
+            s->gets++;
+            if (++s->in_use > s->high_water) s->high_water = s->in_use;
+            LWP_MutexUnlock(mem_lock);
+            return p->base + (uint32_t)index * p->size;
+        }
+        stats.heap_allocs++;
+        stats.heap_bytes += size;
+        stats.heap_in_use++;
+        LWP_MutexUnlock(mem_lock);
+    }
+
+    // Round up so cache maintenance never touches a neighbouring allocation
+    return memalign(32, (size + 31) & ~31u);
+}
+
+void mem_free(void* buffer) {
+    if (!buffer) return;
+    int pool = mem_pool_of(buffer);
+    if (pool < 0) {
+        if (mem_ready) {
+            LWP_MutexLock(mem_lock);
+            if (stats.heap_in_use) stats.heap_in_use--;
+            LWP_MutexUnlock(mem_lock);
+        }
+        free(buffer);
+        return;
+    }
+
+    MemPool* p = &pools[pool];
+    LWP_MutexLock(mem_lock);
+    p->free_list[p->free_count++] = (uint16_t)(((uint8_t*)buffer - p->base) / p->size);
+    stats.pools[pool].in_use--;
+    LWP_MutexUnlock(mem_lock);
+}
+
+// --- Scratch Arena ---
+
+void* mem_scratch_alloc(uint32_t size) {
+    if (size == 0 || mem_setup() != 0 || !arena) return NULL;
+
+    uint32_t aligned = (size + 31) & ~31u;
+    if (aligned > MEM_ARENA_SIZE - arena_top) {
+        stats.arena_failures++;
+        return NULL;
+    }
+    void* p = arena + arena_top;
+    arena_top += aligned;
+    stats.arena_used = arena_top;
+    if (arena_top > stats.arena_high_water) stats.arena_high_water = arena_top;
+    return p;
+}
+
+uint32_t mem_scratch_mark(void) {
+    return arena_top;
+}
+
+void mem_scratch_release(uint32_t mark) {
+    if (mark < arena_top) arena_top = mark;
+    stats.arena_used = arena_top;
+}
+
+// --- Stats ---
+
+const MemStats* mem_get_stats(void) {
+    return &stats;
+}
+
+void mem_reset_high_water(void) {
+    for (int i = 0; i < MEM_POOLS; i++) {
+        stats.pools[i].high_water = stats.pools[i].in_use;
+    }
+    stats.arena_high_water = arena_top;
+}
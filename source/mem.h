@@ -0,0 +1,57 @@
+// source/mem.h
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdint.h>
+
+// Central allocator for the large buffers. Transfer rings, reader windows,
+// bounce buffers and staging blocks come from fixed pools of 32-byte
+// aligned buffers carved out of MEM2 on first use, so a long session of
+// flashes never fragments the small heap. Each pool holds one size; a
+// request goes to the smallest that fits and falls back to the heap only
+// when it is larger than any or its pool is empty. A bump arena holds
+// per-session scratch that is thrown away as a whole. Everything keeps a
+// high-water mark, so a repeat flash can be shown to allocate nothing new.
+
+#define MEM_SMALL_SIZE    0x10000         // One bulk message (USB_MAX_TRANSFER)
+#define MEM_SMALL_COUNT   24
+#define MEM_LARGE_SIZE    0x40000         // A file part, reader window or digest block
+#define MEM_LARGE_COUNT   16
+#define MEM_POOLS         2
+#define MEM_ARENA_SIZE    (1024 * 1024)
+
+typedef struct {
+    uint32_t size;              // Bytes per buffer
+    uint32_t count;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t gets;
+} MemPoolStats;
+
+typedef struct {
+    MemPoolStats pools[MEM_POOLS];
+    uint32_t heap_allocs;       // Requests the pools could not serve
+    uint64_t heap_bytes;
+    uint32_t heap_in_use;
+    uint32_t arena_used;
+    uint32_t arena_high_water;
+    uint32_t arena_failures;    // Scratch requests that did not fit
+} MemStats;
+
+// 32-byte aligned and padded to whole cache lines, so DMA and cache
+// maintenance never touch a neighbour. Give it back with mem_free.
+void* mem_alloc(uint32_t size);
+void mem_free(void* buffer);
+
+// Session scratch. mem_scratch_release(mark) frees everything allocated
+// since mem_scratch_mark() returned mark, in one go. Not thread safe:
+// only the thread running the job uses it.
+void* mem_scratch_alloc(uint32_t size);
+uint32_t mem_scratch_mark(void);
+void mem_scratch_release(uint32_t mark);
+
+const MemStats* mem_get_stats(void);
+// Restart the high-water marks from what is in use now
+void mem_reset_high_water(void);
+
+#endif
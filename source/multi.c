@@ -0,0 +1,121 @@
+// source/multi.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include "multi.h"
+#include "usb.h"
+#include "telemetry.h"
+#include "perf.h"
+
+static MultiReport multi_report;
+
+static void multi_end_sessions(UsbDevice* const* live, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        usb_device_end_flash_session(live[i]);
+    }
+}
+
+int multi_flash(UsbDevice* const* devices, uint32_t count, const TransferSource* source,
+                const char* partition, const TransferConfig* config,
+                FlashProgressCallback callback) {
+    memset(&multi_report, 0, sizeof(multi_report));
+    if (!devices || count == 0 || count > MULTI_MAX_DEVICES || !source || !partition) {
+        return -1;
+    }
+    u64 start = gettime();
+    multi_report.count = count;
+    multi_report.image_size = source->size;
+
+    // Devices that take the session share the transfer; the others are out
+    UsbDevice* live[MULTI_MAX_DEVICES];
+    MultiTarget* live_targets[MULTI_MAX_DEVICES];
+    uint32_t live_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        MultiTarget* target = &multi_report.targets[i];
+        target->device = devices[i];
+        target->result = -2;
+        if (devices[i] && usb_device_connect(devices[i]) == 0 &&
+            usb_device_start_flash_session(devices[i], partition) == 0) {
+            target->result = MULTI_PENDING;
+            live[live_count] = devices[i];
+            live_targets[live_count] = target;
+            live_count++;
+        }
+    }
+    if (live_count == 0) {
+        multi_report.failed = count;
+        return -2;
+    }
+
+    Transfer* transfer = transfer_open_multi(config, source, live, live_count);
+    if (!transfer) {
+        multi_end_sessions(live, live_count);
+        multi_report.failed = count;
+        return -3;
+    }
+
+    uint8_t* buffer;
+    uint32_t length;
+    int res;
+    int status = 0;
+
+    telemetry_start(source->size);
+    u64 wait_start = gettime();
+    while ((res = transfer_acquire(transfer, &buffer, &length)) > 0) {
+        u64 send_start = gettime();
+        if (flash_abort_requested() || transfer_submit(transfer, buffer, length) != 0) {
+            status = -4;
+            break;
+        }
+        u64 send_end = gettime();
+        telemetry_add(length, ticks_to_microsecs(send_end - send_start),
+                      ticks_to_microsecs(send_start - wait_start));
+        wait_start = send_end;
+
+        if (callback && telemetry_due()) {
+            for (uint32_t i = 0; i < live_count; i++) {
+                live_targets[i]->progress = transfer_target_error(transfer, i) ? 0.0f :
+                    (float)transfer_target_bytes(transfer, i) / (float)source->size;
+            }
+            char status_text[64];
+            telemetry_format("Transferring", status_text, sizeof(status_text));
+            callback((float)telemetry_get()->bytes / (float)source->size, status_text);
+        }
+    }
+    if (res < 0) status = -4;
+
+    // Every write has landed once drained, so the per-device outcome is final
+    transfer_drain(transfer);
+    for (uint32_t i = 0; i < live_count; i++) {
+        MultiTarget* target = live_targets[i];
+        target->bytes = transfer_target_bytes(transfer, i);
+        int ok = (status == 0 && transfer_target_error(transfer, i) == 0 &&
+                  target->bytes == source->size);
+        target->result = ok ? 0 : -4;
+        target->progress = ok ? 1.0f : target->progress;
+    }
+
+    TransferStats stats;
+    transfer_close(transfer, &stats);
+    multi_report.read_bytes = stats.bytes;
+    perf_add(PERF_SD_READ, stats.read_us);
+    perf_add(PERF_CHECKSUM, stats.checksum_us);
+    perf_add(PERF_USB, telemetry_get()->busy_us);
+    perf_add_bytes(stats.bytes);
+    multi_end_sessions(live, live_count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (multi_report.targets[i].result == 0) {
+            multi_report.flashed++;
+        } else {
+            multi_report.failed++;
+        }
+    }
+    multi_report.elapsed_us = ticks_to_microsecs(gettime() - start);
+    return (multi_report.failed == 0) ? 0 : -4;
+}
+
+const MultiReport* multi_get_report(void) {
+    return &multi_report;
+}
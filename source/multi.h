@@ -0,0 +1,47 @@
+// source/multi.h
+#ifndef MULTI_H
+#define MULTI_H
+
+#include <stdint.h>
+#include "transfer.h"
+#include "flash.h"
+
+// Multi-device flashing, for a bench of identical phones on both Wii
+// ports. The image comes off the card once: the transfer engine's reader
+// fills the ring and every buffer is written to each phone before it is
+// reused. Each phone has its own session context (USB handle, Odin
+// session, progress, result), so one that drops out does not stop the
+// others; the run moves at the pace of the slowest one.
+
+#define MULTI_MAX_DEVICES TRANSFER_MAX_TARGETS
+
+#define MULTI_PENDING 1             // result of a device the run never finished
+
+typedef struct {
+    UsbDevice* device;
+    int result;                 // 0, -2 no session, -4 transfer failed, MULTI_PENDING
+    uint64_t bytes;             // Bytes queued to it
+    float progress;
+} MultiTarget;
+
+// Time is in microseconds
+typedef struct {
+    uint32_t count;
+    uint32_t flashed;
+    uint32_t failed;
+    uint64_t image_size;
+    uint64_t read_bytes;        // Bytes read from the source, once for every device
+    uint64_t elapsed_us;
+    MultiTarget targets[MULTI_MAX_DEVICES];
+} MultiReport;
+
+// Open a session to partition on each device and stream source to all of
+// them. config may be NULL. Returns 0 when every device was flashed, -1 bad
+// arguments, -2 no device took a session, -3 transfer setup failed, -4 at
+// least one device failed.
+int multi_flash(UsbDevice* const* devices, uint32_t count, const TransferSource* source,
+                const char* partition, const TransferConfig* config,
+                FlashProgressCallback callback);
+const MultiReport* multi_get_report(void);
+
+#endif
@@ -0,0 +1,423 @@
+// source/odin.c
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include "odin.h"
+#include "fileio.h"
+#include "heimdall.h"
+#include "md5.h"
+#include "image.h"
+
+#define TAR_BLOCK 512
+
+// The digest line Odin appends: "<32 hex>  <name>\n"
+#define ODIN_MD5_TAIL 512
+
+struct OdinPackage {
+    FileReader* reader;
+    uint64_t tar_end;           // End of the archive proper, before the MD5 line
+
+    // Current member
+    uint64_t member_offset;
+    uint64_t member_size;
+    uint64_t member_pos;        // Read position inside the member
+    int ended;                  // Saw the end-of-archive blocks
+
+    // Every byte below hashed has gone through md5
+    int has_md5;
+    Md5Context md5;
+    uint64_t hashed;
+    char expected_md5[33];
+};
+
+static OdinReport odin_report;
+
+// --- Hashing ---
+
+// Fold a chunk read at position into the MD5, skipping what was already
+// hashed (a resent part reads the same bytes again)
+static void odin_hash(OdinPackage* p, const uint8_t* data, uint32_t length,
+                      uint64_t position) {
+    if (!p->has_md5 || position + length <= p->hashed || position > p->hashed) {
+        return;
+    }
+    uint32_t skip = (uint32_t)(p->hashed - position);
+    md5_update(&p->md5, data + skip, length - skip);
+    p->hashed += length - skip;
+}
+
+// Read from the package at the current position, hashing as it goes
+static int odin_read(OdinPackage* p, const uint8_t** chunk, uint32_t max) {
+    uint64_t position = fileio_reader_tell(p->reader);
+    int got = fileio_reader_read_chunk(p->reader, chunk, max);
+    if (got > 0) {
+        odin_hash(p, *chunk, (uint32_t)got, position);
+    }
+    return got;
+}
+
+// Move to offset. Forward moves read through unhashed bytes so the
+// digest never has a hole; plain tars just seek.
+static int odin_seek(OdinPackage* p, uint64_t offset) {
+    if (p->has_md5 && offset > p->hashed) {
+        if (fileio_reader_seek(p->reader, p->hashed) != 0) return -1;
+        while (p->hashed < offset) {
+            const uint8_t* chunk;
+            uint64_t left = offset - p->hashed;
+            int got = odin_read(p, &chunk, (left < FILEIO_READER_WINDOW) ?
+                                           (uint32_t)left : FILEIO_READER_WINDOW);
+            if (got <= 0) return -1;
+        }
+        return 0;
+    }
+    return fileio_reader_seek(p->reader, offset);
+}
+
+// --- Digest Line ---
+
+static int odin_is_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Find the trailing digest line of a .tar.md5 and where the tar stops
+static int odin_read_md5_line(OdinPackage* p) {
+    uint64_t size = fileio_reader_size(p->reader);
+    uint32_t tail = (size < ODIN_MD5_TAIL) ? (uint32_t)size : ODIN_MD5_TAIL;
+    char buffer[ODIN_MD5_TAIL + 1];
+
+    if (fileio_reader_seek(p->reader, size - tail) != 0) return -1;
+    if (fileio_reader_read(p->reader, (uint8_t*)buffer, tail) != (int)tail) return -1;
+    buffer[tail] = '\0';
+
+    // Last non-empty line; the tar's zero padding comes right before it
+    uint32_t end = tail;
+    while (end > 0 && (buffer[end - 1] == '\n' || buffer[end - 1] == '\r')) end--;
+    uint32_t start = end;
+    while (start > 0 && buffer[start - 1] != '\n' && buffer[start - 1] != '\0') start--;
+
+    if (end - start < 34) return -1;
+    for (int i = 0; i < 32; i++) {
+        if (!odin_is_hex(buffer[start + i])) return -1;
+    }
+    if (buffer[start + 32] != ' ' && buffer[start + 32] != '\t') return -1;
+
+    for (int i = 0; i < 32; i++) {
+        char c = buffer[start + i];
+        p->expected_md5[i] = (c >= 'A' && c <= 'F') ? (char)(c - 'A' + 'a') : c;
+    }
+    p->expected_md5[32] = '\0';
+    p->tar_end = size - (tail - start);
+
+    return fileio_reader_seek(p->reader, 0);
+}
+
+// --- Archive Walk ---
+
+// Octal field, or GNU base-256 for members of 8GB and up
+static uint64_t odin_tar_number(const uint8_t* field, uint32_t length) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7F;
+        for (uint32_t i = 1; i < length; i++) {
+            value = (value << 8) | field[i];
+        }
+        return value;
+    }
+    for (uint32_t i = 0; i < length && field[i]; i++) {
+        if (field[i] == ' ') continue;
+        if (field[i] < '0' || field[i] > '7') break;
+        value = (value << 3) | (uint64_t)(field[i] - '0');
+    }
+    return value;
+}
+
+static int odin_tar_header_valid(const uint8_t* header) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < TAR_BLOCK; i++) {
+        // The checksum field counts as spaces
+        sum += (i >= 148 && i < 156) ? ' ' : header[i];
+    }
+    return sum == (uint32_t)odin_tar_number(header + 148, 8);
+}
+
+static int odin_block_is_zero(const uint8_t* block) {
+    for (uint32_t i = 0; i < TAR_BLOCK; i++) {
+        if (block[i]) return 0;
+    }
+    return 1;
+}
+
+static int odin_read_block(OdinPackage* p, uint8_t* block) {
+    uint32_t filled = 0;
+    while (filled < TAR_BLOCK) {
+        const uint8_t* chunk;
+        int got = odin_read(p, &chunk, TAR_BLOCK - filled);
+        if (got <= 0) return -1;
+        memcpy(block + filled, chunk, got);
+        filled += got;
+    }
+    return 0;
+}
+
+OdinPackage* odin_open(const char* filename) {
+    if (!filename) return NULL;
+
+    OdinPackage* p = calloc(1, sizeof(OdinPackage));
+    if (!p) return NULL;
+
+    p->reader = fileio_reader_open(filename, 0);
+    if (!p->reader) {
+        free(p);
+        return NULL;
+    }
+    p->tar_end = fileio_reader_size(p->reader);
+
+    size_t length = strlen(filename);
+    if (length > 4 && strcasecmp(filename + length - 4, ".md5") == 0) {
+        if (odin_read_md5_line(p) != 0) {
+            odin_close(p);
+            return NULL;
+        }
+        p->has_md5 = 1;
+        md5_init(&p->md5);
+    }
+
+    return p;
+}
+
+int odin_next_member(OdinPackage* p, OdinMember* member) {
+    if (!p || !member) return -1;
+    if (p->ended) return 0;
+
+    char long_name[ODIN_NAME_MAX];
+    long_name[0] = '\0';
+
+    // Step over the rest of the previous member and its padding
+    uint64_t next = p->member_offset + ((p->member_size + TAR_BLOCK - 1) & ~(uint64_t)(TAR_BLOCK - 1));
+    if (odin_seek(p, next) != 0) return -2;
+
+    while (1) {
+        uint8_t header[TAR_BLOCK];
+        if (fileio_reader_tell(p->reader) + TAR_BLOCK > p->tar_end) {
+            // Some packers drop the end-of-archive blocks
+            p->ended = 1;
+            return 0;
+        }
+        if (odin_read_block(p, header) != 0) return -2;
+
+        if (odin_block_is_zero(header)) {
+            p->ended = 1;
+            return 0;
+        }
+        if (!odin_tar_header_valid(header)) return -2;
+
+        uint64_t size = odin_tar_number(header + 124, 12);
+        uint64_t offset = fileio_reader_tell(p->reader);
+        uint64_t padded = (size + TAR_BLOCK - 1) & ~(uint64_t)(TAR_BLOCK - 1);
+        if (offset + size > p->tar_end) return -2;
+
+        p->member_offset = offset;
+        p->member_size = size;
+        p->member_pos = 0;
+
+        char type = (char)header[156];
+        if (type == 'L') {
+            // GNU long name: the data is the name of the next member
+            uint32_t take = (size < ODIN_NAME_MAX - 1) ? (uint32_t)size : ODIN_NAME_MAX - 1;
+            if (fileio_reader_read(p->reader, (uint8_t*)long_name, take) != (int)take) return -2;
+            odin_hash(p, (const uint8_t*)long_name, take, offset);
+            long_name[take] = '\0';
+            if (odin_seek(p, offset + padded) != 0) return -2;
+            p->member_size = 0;
+            continue;
+        }
+        if (type != '0' && type != '\0' && type != '7') {
+            // Directories, links and pax headers carry nothing to flash
+            if (odin_seek(p, offset + padded) != 0) return -2;
+            p->member_size = 0;
+            continue;
+        }
+
+        if (long_name[0]) {
+            strcpy(member->name, long_name);
+        } else if (header[345] && memcmp(header + 257, "ustar", 5) == 0) {
+            snprintf(member->name, sizeof(member->name), "%.155s/%.100s",
+                     (const char*)(header + 345), (const char*)header);
+        } else {
+            snprintf(member->name, sizeof(member->name), "%.100s", (const char*)header);
+        }
+        member->size = size;
+        member->offset = offset;
+        return 1;
+    }
+}
+
+static int odin_member_chunk(void* ctx, const uint8_t** chunk, uint32_t max) {
+    OdinPackage* p = (OdinPackage*)ctx;
+    uint64_t left = p->member_size - p->member_pos;
+    if (left == 0) return 0;
+    if (max > left) max = (uint32_t)left;
+
+    int got = odin_read(p, chunk, max);
+    if (got > 0) p->member_pos += got;
+    return got;
+}
+
+static int odin_member_seek(void* ctx, uint32_t offset) {
+    OdinPackage* p = (OdinPackage*)ctx;
+    if (offset > p->member_size) return -1;
+    if (odin_seek(p, p->member_offset + offset) != 0) return -1;
+    p->member_pos = offset;
+    return 0;
+}
+
+void odin_member_source(OdinPackage* p, FlashSource* source) {
+    source->next = odin_member_chunk;
+    source->seek = odin_member_seek;
+    source->ctx = p;
+}
+
+int odin_finish(OdinPackage* p) {
+    if (!p) return -1;
+    if (!p->has_md5) return 0;
+
+    // Hash the trailing zero blocks and record padding too
+    if (odin_seek(p, p->tar_end) != 0) return -2;
+
+    uint8_t digest[16];
+    md5_final(&p->md5, digest);
+    md5_to_hex(digest, odin_report.actual_md5);
+    strcpy(odin_report.expected_md5, p->expected_md5);
+
+    odin_report.md5_ok = (strcmp(odin_report.actual_md5, p->expected_md5) == 0);
+    return odin_report.md5_ok ? 0 : -4;
+}
+
+void odin_close(OdinPackage* p) {
+    if (!p) return;
+    fileio_reader_close(p->reader);
+    free(p);
+}
+
+// --- Partition Mapping ---
+
+int odin_map_partition(const PitInfo* pit, const char* member, char* partition,
+                       uint32_t size) {
+    if (!member || !partition || size == 0) return -1;
+
+    const char* base = strrchr(member, '/');
+    base = base ? base + 1 : member;
+
+    if (pit) {
+        PitEntry entry;
+        char name[ODIN_NAME_MAX];
+        strncpy(name, base, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+
+        // Odin names images after the PIT's flash filename, sometimes with
+        // compression or filesystem suffixes the PIT leaves off
+        int found = (pit_find_partition(pit, name, &entry) == 0);
+        char* suffix;
+        while (!found && (suffix = strrchr(name, '.')) != NULL &&
+               (strcasecmp(suffix, ".lz4") == 0 || strcasecmp(suffix, ".ext4") == 0)) {
+            *suffix = '\0';
+            found = (pit_find_partition(pit, name, &entry) == 0);
+        }
+        if (found) {
+            snprintf(partition, size, "%s", entry.partition_name);
+            return 0;
+        }
+    }
+
+    const char* fallback = heimdall_determine_partition(base);
+    if (!fallback) return -1;
+    snprintf(partition, size, "%s", fallback);
+    return 0;
+}
+
+// --- Package Flashing ---
+
+static FlashProgressCallback package_cb = NULL;
+static uint64_t package_done;   // Package bytes before the current member
+static uint64_t package_member;
+static uint64_t package_total;
+
+// Turn the per-member progress of the flash engine into package progress
+static int odin_progress(float progress, const char* status) {
+    if (!package_cb || package_total == 0) return 1;
+    float overall = (float)(package_done + (uint64_t)(progress * package_member)) /
+                    (float)package_total;
+    return package_cb(overall, status);
+}
+
+int odin_flash_package(const char* filename, const PitInfo* pit,
+                       FlashProgressCallback callback) {
+    memset(&odin_report, 0, sizeof(odin_report));
+
+    OdinPackage* p = odin_open(filename);
+    if (!p) return -1;
+
+    odin_report.md5_present = p->has_md5;
+    package_cb = callback;
+    package_total = p->tar_end;
+
+    int result = 0;
+    OdinMember member;
+    int res;
+    while ((res = odin_next_member(p, &member)) > 0) {
+        odin_report.members++;
+
+        char partition[32];
+        const char* base = strrchr(member.name, '/');
+        base = base ? base + 1 : member.name;
+        size_t length = strlen(base);
+
+        // Repartition tables ride along in CSC packages; they are not images
+        int is_pit = (length > 4 && strcasecmp(base + length - 4, ".pit") == 0);
+        if (is_pit || member.size == 0 ||
+            odin_map_partition(pit, member.name, partition, sizeof(partition)) != 0) {
+            odin_report.skipped++;
+            continue;
+        }
+
+        package_done = member.offset;
+        package_member = member.size;
+
+        FlashSource source;
+        odin_member_source(p, &source);
+
+        // *.img.lz4 and sparse members are decoded straight out of the archive
+        ImageStream image;
+        int flashed = (image_open(&image, &source, member.size, base) == 0 &&
+                       image.size > 0 && image.size <= 0xFFFFFFFFull &&
+                       flash_stream(&image.source, (uint32_t)image.size, partition,
+                                    odin_progress) == 0);
+        uint64_t image_size = image.size;
+        image_close(&image);
+        if (!flashed) {
+            snprintf(odin_report.failed_member, ODIN_NAME_MAX, "%s", member.name);
+            result = -3;
+            break;
+        }
+
+        if (odin_report.flashed < ODIN_MAX_FLASHED) {
+            strcpy(odin_report.flashed_partitions[odin_report.flashed], partition);
+        }
+        odin_report.flashed++;
+        odin_report.bytes_flashed += image_size;
+    }
+    if (result == 0 && res < 0) result = -2;
+
+    if (result == 0) {
+        result = odin_finish(p);
+    }
+
+    odin_close(p);
+    package_cb = NULL;
+    return result;
+}
+
+const OdinReport* odin_get_report(void) {
+    return &odin_report;
+}
@@ -0,0 +1,60 @@
+// source/odin.h
+#ifndef ODIN_H
+#define ODIN_H
+
+#include <stdint.h>
+#include "flash.h"
+#include "pit.h"
+
+// Odin firmware packages (AP/BL/CP/CSC .tar and .tar.md5) flashed straight
+// from the SD card. The archive is walked header by header and each member
+// is streamed into the flash engine from the package itself, so nothing is
+// unpacked first. A .tar.md5 is hashed as it goes past and the digest Odin
+// appended is checked once the archive has been read.
+
+#define ODIN_NAME_MAX 257          // ustar prefix, '/', name and the NUL
+#define ODIN_MAX_FLASHED 64        // Partitions a report lists
+
+typedef struct {
+    char name[ODIN_NAME_MAX];   // Path inside the archive
+    uint64_t size;
+    uint64_t offset;            // Offset of the data in the package
+} OdinMember;
+
+typedef struct {
+    uint32_t members;           // Regular files in the archive
+    uint32_t flashed;
+    uint32_t skipped;           // No partition for them, or not flashable
+    uint64_t bytes_flashed;
+    int md5_present;
+    int md5_ok;                 // Only meaningful with md5_present
+    char expected_md5[33];
+    char actual_md5[33];
+    char failed_member[ODIN_NAME_MAX]; // Member being flashed when it failed
+    // Partitions this package wrote, in order (the first ODIN_MAX_FLASHED)
+    char flashed_partitions[ODIN_MAX_FLASHED][32];
+} OdinReport;
+
+typedef struct OdinPackage OdinPackage;
+
+// Low-level walk. odin_next_member returns 1 with a member, 0 at the end of
+// the archive, <0 on a malformed archive. Data the caller does not read is
+// skipped (and hashed) by the next call.
+OdinPackage* odin_open(const char* filename);
+int odin_next_member(OdinPackage* package, OdinMember* member);
+void odin_member_source(OdinPackage* package, FlashSource* source);
+int odin_finish(OdinPackage* package); // 0, or -4 on an MD5 mismatch
+void odin_close(OdinPackage* package);
+
+// PIT partition for a member name; falls back to the built-in filename map
+// when pit is NULL or has no match. Returns 0 when found.
+int odin_map_partition(const PitInfo* pit, const char* member, char* partition,
+                       uint32_t size);
+
+// Flash every mappable member over an open Odin session.
+// Returns 0, -1 can't open, -2 bad archive, -3 flash failed, -4 MD5 mismatch
+int odin_flash_package(const char* filename, const PitInfo* pit,
+                       FlashProgressCallback callback);
+const OdinReport* odin_get_report(void);
+
+#endif
@@ -0,0 +1,109 @@
+// source/perf.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "perf.h"
+#include "usb.h"
+#include "fileio.h"
+
+static const char* stage_names[PERF_STAGES] = {
+    "sd_read", "sd_write", "memcpy", "checksum", "usb"
+};
+static const char* latency_names[USB_LATENCY_COUNT] = {
+    "write", "write_async", "ack", "read"
+};
+
+static char perf_directory[128] = PERF_DIRECTORY;
+static char report_path[192] = "";
+static uint64_t stage_us[PERF_STAGES];
+static uint64_t perf_bytes;
+static u64 perf_start;
+
+void perf_set_directory(const char* directory) {
+    snprintf(perf_directory, sizeof(perf_directory), "%s",
+             directory ? directory : PERF_DIRECTORY);
+}
+
+void perf_begin(void) {
+    memset(stage_us, 0, sizeof(stage_us));
+    perf_bytes = 0;
+    usb_reset_perf();
+    perf_start = gettime();
+}
+
+void perf_add(int stage, uint64_t us) {
+    if (stage >= 0 && stage < PERF_STAGES) stage_us[stage] += us;
+}
+
+void perf_add_bytes(uint64_t bytes) {
+    perf_bytes += bytes;
+}
+
+// <timestamp>.log, with a counter when two sessions end in one second
+static int perf_open_report(FILE** f) {
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm* tm = localtime(&now);
+    if (!tm || strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", tm) == 0) {
+        snprintf(stamp, sizeof(stamp), "%lu", (unsigned long)now);
+    }
+
+    fileio_create_directory(perf_directory);
+    for (int n = 0; n < 100; n++) {
+        if (n == 0) {
+            snprintf(report_path, sizeof(report_path), "%s/%s.log", perf_directory, stamp);
+        } else {
+            snprintf(report_path, sizeof(report_path), "%s/%s-%d.log", perf_directory, stamp, n);
+        }
+        if (fileio_file_exists(report_path)) continue;
+        *f = fopen(report_path, "w");
+        if (*f) return 0;
+        break;
+    }
+    report_path[0] = '\0';
+    return -3;
+}
+
+int perf_end(const char* job, const char* target, int result) {
+    uint64_t elapsed_us = ticks_to_microsecs(gettime() - perf_start);
+    const UsbPerf* usb = usb_get_perf();
+
+    FILE* f = NULL;
+    if (perf_open_report(&f) != 0) return -3;
+
+    fprintf(f, "job %s %s\nresult %d\nbytes %llu\nelapsed_us %llu\n",
+            job ? job : "?", target ? target : "-", result,
+            (unsigned long long)perf_bytes, (unsigned long long)elapsed_us);
+    if (elapsed_us > 0) {
+        fprintf(f, "rate_kbps %llu\n",
+                (unsigned long long)(perf_bytes * 1000000 / elapsed_us / 1024));
+    }
+
+    // Bounce copies are usb.c's; the rest the engines reported
+    for (int i = 0; i < PERF_STAGES; i++) {
+        uint64_t us = stage_us[i] + (i == PERF_MEMCPY ? usb->bounce_us : 0);
+        fprintf(f, "stage %s_us %llu\n", stage_names[i], (unsigned long long)us);
+    }
+    fprintf(f, "bounce_bytes %llu\n", (unsigned long long)usb->bounce_bytes);
+
+    // One line per histogram: summary, then <bucket upper bound us>:<count>
+    for (int i = 0; i < USB_LATENCY_COUNT; i++) {
+        const UsbHistogram* h = &usb->latency[i];
+        if (h->count == 0) continue;
+        fprintf(f, "latency %s count %u avg_us %llu p50_us %u p99_us %u max_us %u |",
+                latency_names[i], h->count, (unsigned long long)(h->total_us / h->count),
+                usb_histogram_percentile(h, 50), usb_histogram_percentile(h, 99), h->max_us);
+        for (int b = 0; b < USB_HISTOGRAM_BUCKETS; b++) {
+            if (h->buckets[b]) fprintf(f, " %u:%u", b ? (1u << b) : 1u, h->buckets[b]);
+        }
+        fprintf(f, "\n");
+    }
+
+    return (fclose(f) == 0) ? 0 : -3;
+}
+
+const char* perf_get_report_path(void) {
+    return report_path;
+}
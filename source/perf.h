@@ -0,0 +1,36 @@
+// source/perf.h
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+// Per-session performance report. While a heimdall.c job runs, the engines
+// add the time they spend in each stage, and usb.c keeps its latency
+// histograms. At the end a short text report goes to PERF_DIRECTORY as
+// <timestamp>.log, so a slow phone can be compared with a fast one after
+// the fact. Stages overlap when the pipeline does its job: their sum can
+// exceed the elapsed time.
+
+#define PERF_DIRECTORY "sd:/heimdall/perf"
+
+#define PERF_SD_READ  0             // Reading (and decoding) the image
+#define PERF_SD_WRITE 1             // Writing backups
+#define PERF_MEMCPY   2             // Copies outside usb.c's bounce buffer
+#define PERF_CHECKSUM 3
+#define PERF_USB      4             // Sending, receiving and waiting for ACKs
+#define PERF_STAGES   5
+
+// NULL selects PERF_DIRECTORY
+void perf_set_directory(const char* directory);
+
+// Start a session: clears the stages and usb.c's histograms
+void perf_begin(void);
+void perf_add(int stage, uint64_t us);
+void perf_add_bytes(uint64_t bytes);
+// Write the report. job and target say what ran ("flash", "SYSTEM").
+// Returns 0, -3 SD write failure.
+int perf_end(const char* job, const char* target, int result);
+// Path of the last report written, "" if none
+const char* perf_get_report_path(void);
+
+#endif
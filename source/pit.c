@@ -2,11 +2,13 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
-// --- Parsing & Validation ---
+// --- Raw View ---
 
-int pit_parse(const uint8_t* data, uint32_t length, PitInfo* info) {
-    if (!data || !info || length < PIT_HEADER_SIZE) return -1;
+// Header and entry bounds, shared by the view and the parser
+static int pit_check(const uint8_t* data, uint32_t length, uint32_t* count) {
+    if (!data || length < PIT_HEADER_SIZE) return -1;
 
     // Check Magic (The first 4 bytes of a Samsung PIT)
     uint32_t magic = *(uint32_t*)data;
@@ -14,30 +16,151 @@ int pit_parse(const uint8_t* data, uint32_t length, PitInfo* info) {
         return -2; // Invalid Magic
     }
 
-    // Offset 4 is entry count
-    info->entry_count = *(uint32_t*)(data + 4);
-    
+    // Offset 4 is entry count; every entry it claims must be there
+    *count = *(uint32_t*)(data + 4);
+    if ((uint64_t)*count * PIT_ENTRY_SIZE > length - PIT_HEADER_SIZE) return -3;
+    return 0;
+}
+
+int pit_view_open(const uint8_t* data, uint32_t length, PitView* view) {
+    if (!view || ((uintptr_t)data & 3)) return -1;
+    uint32_t count;
+    int result = pit_check(data, length, &count);
+    if (result != 0) return result;
+
+    view->data = data;
+    view->length = length;
+    view->entry_count = count;
+    return 0;
+}
+
+const PitEntry* pit_view_entry(const PitView* view, uint32_t index) {
+    if (!view || index >= view->entry_count) return NULL;
+    return (const PitEntry*)(view->data + PIT_HEADER_SIZE + index * PIT_ENTRY_SIZE);
+}
+
+const PitEntry* pit_view_find(const PitView* view, const char* name) {
+    if (!view || !name) return NULL;
+    for (uint32_t i = 0; i < view->entry_count; i++) {
+        const PitEntry* e = pit_view_entry(view, i);
+        if (strncmp(e->partition_name, name, PIT_NAME_SIZE) == 0 ||
+            strncmp(e->flash_filename, name, PIT_NAME_SIZE) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// --- Index ---
+
+// FNV-1a over at most one name field
+static uint32_t pit_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < PIT_NAME_SIZE && name[i]; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void pit_index_insert(const PitInfo* info, uint32_t* slots, uint32_t field,
+                             uint32_t entry) {
+    const char* key = field ? info->entries[entry].flash_filename
+                            : info->entries[entry].partition_name;
+    if (!key[0]) return;
+
+    uint32_t slot = pit_hash(key) & info->index_mask;
+    while (slots[slot]) {
+        const PitEntry* other = &info->entries[slots[slot] - 1];
+        // The first entry with a name wins, as the table is searched in order
+        if (strcmp(field ? other->flash_filename : other->partition_name, key) == 0) return;
+        slot = (slot + 1) & info->index_mask;
+    }
+    slots[slot] = entry + 1;
+}
+
+// Twice as many slots as entries keeps the probe runs short
+static int pit_build_index(PitInfo* info) {
+    uint32_t size = 16;
+    while (size < info->entry_count * 2) size <<= 1;
+    if (size - 1 != info->index_mask || !info->index) {
+        uint32_t* index = realloc(info->index, 2 * size * sizeof(uint32_t));
+        if (!index) return -1;
+        info->index = index;
+        info->index_mask = size - 1;
+    }
+    memset(info->index, 0, 2 * size * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < info->entry_count; i++) {
+        pit_index_insert(info, info->index, 0, i);
+        pit_index_insert(info, info->index + size, 1, i);
+    }
+    return 0;
+}
+
+static const PitEntry* pit_index_find(const PitInfo* info, uint32_t field, const char* name,
+                                      uint32_t hash) {
+    const uint32_t* slots = info->index + (field ? info->index_mask + 1 : 0);
+    uint32_t slot = hash & info->index_mask;
+    while (slots[slot]) {
+        const PitEntry* e = &info->entries[slots[slot] - 1];
+        if (strcmp(field ? e->flash_filename : e->partition_name, name) == 0) return e;
+        slot = (slot + 1) & info->index_mask;
+    }
+    return NULL;
+}
+
+// --- Parsing & Validation ---
+
+int pit_parse(const uint8_t* data, uint32_t length, PitInfo* info) {
+    uint32_t count;
+    if (!info) return -1;
+    int result = pit_check(data, length, &count);
+    if (result != 0) return result;
+
+    // Grow only; a PitInfo parsed over and over keeps its memory
+    if (count > info->capacity || !info->entries) {
+        PitEntry* entries = realloc(info->entries, (count ? count : 1) * sizeof(PitEntry));
+        if (!entries) return -4;
+        info->entries = entries;
+        info->capacity = count ? count : 1;
+    }
+
+    info->entry_count = count;
+
     // Header also contains unknown1 and unknown2 at offsets 8 and 12
     info->unknown1 = *(uint32_t*)(data + 8);
     info->unknown2 = *(uint32_t*)(data + 12);
 
-    // Offset 28 is the device name
-    strncpy(info->device_name, (const char*)(data + 28), 63);
-
-    // Parse entries
-    uint32_t offset = PIT_HEADER_SIZE;
-    for (uint32_t i = 0; i < info->entry_count && i < 64; i++) {
-        if (offset + PIT_ENTRY_SIZE > length) break;
-        
-        memcpy(&info->entries[i], data + offset, PIT_ENTRY_SIZE);
-        offset += PIT_ENTRY_SIZE;
+    // Offset 28 is the device name, which runs to the end of the header
+    memset(info->device_name, 0, sizeof(info->device_name));
+    memcpy(info->device_name, data + 28, PIT_HEADER_SIZE - 28);
+
+    // The entries are laid out exactly as PitEntry; the names are cut
+    // short where a PIT fills the whole field
+    memcpy(info->entries, data + PIT_HEADER_SIZE, (size_t)count * PIT_ENTRY_SIZE);
+    for (uint32_t i = 0; i < count; i++) {
+        PitEntry* e = &info->entries[i];
+        e->partition_name[PIT_NAME_SIZE - 1] = '\0';
+        e->flash_filename[PIT_NAME_SIZE - 1] = '\0';
+        e->fota_filename[PIT_NAME_SIZE - 1] = '\0';
     }
 
+    if (pit_build_index(info) != 0) {
+        info->entry_count = 0;
+        return -4;
+    }
     return 0;
 }
 
+void pit_free(PitInfo* info) {
+    if (!info) return;
+    free(info->entries);
+    free(info->index);
+    memset(info, 0, sizeof(PitInfo));
+}
+
 int pit_validate(const PitInfo* info) {
-    if (info->entry_count == 0 || info->entry_count > 64) return -1;
+    if (info->entry_count == 0 || !info->entries) return -1;
     if (info->device_name[0] == '\0') return -2;
     return 0;
 }
@@ -45,15 +168,16 @@ int pit_validate(const PitInfo* info) {
 // --- Search & Utility ---
 
 int pit_find_partition(const PitInfo* info, const char* name, PitEntry* entry) {
-    for (uint32_t i = 0; i < info->entry_count; i++) {
-        // Samsung PITs sometimes use partition_name or flash_filename
-        if (strcmp(info->entries[i].partition_name, name) == 0 ||
-            strcmp(info->entries[i].flash_filename, name) == 0) {
-            if (entry) memcpy(entry, &info->entries[i], sizeof(PitEntry));
-            return 0;
-        }
-    }
-    return -1; // Not found
+    if (!info || !name || info->entry_count == 0 || !info->index) return -1;
+
+    // Samsung PITs sometimes use partition_name or flash_filename
+    uint32_t hash = pit_hash(name);
+    const PitEntry* found = pit_index_find(info, 0, name, hash);
+    if (!found) found = pit_index_find(info, 1, name, hash);
+    if (!found) return -1; // Not found
+
+    if (entry) memcpy(entry, found, sizeof(PitEntry));
+    return 0;
 }
 
 uint32_t pit_calculate_size(const PitInfo* info) {
@@ -20,25 +20,51 @@ typedef struct {
     char fota_filename[32];
 } PitEntry;
 
+// A parsed PIT. The entries and the index are owned by it: zero it before
+// the first pit_parse and release it with pit_free. Parsing again into the
+// same PitInfo reuses its memory when the new table fits.
 typedef struct {
     uint32_t entry_count;
     uint32_t unknown1;
     uint32_t unknown2;
     char device_name[64];
-    PitEntry entries[64];
+    PitEntry* entries;
+    uint32_t capacity;          // Entries allocated
+    // Open-addressed hash slots holding entry index + 1 (0 is empty): the
+    // first index_mask + 1 by partition name, the rest by flash filename
+    uint32_t* index;
+    uint32_t index_mask;
 } PitInfo;
 
+// The raw table in place, checked but not copied. Entries point into the
+// caller's buffer, which must stay alive and 4-byte aligned; their names
+// are only NUL-terminated if the PIT terminates them.
+typedef struct {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t entry_count;
+} PitView;
+
 // PIT functions
 int pit_parse(const uint8_t* data, uint32_t length, PitInfo* info);
+void pit_free(PitInfo* info);
 int pit_write(const PitInfo* info, uint8_t** data, uint32_t* length);
 int pit_print(const PitInfo* info);
+// By partition name, then by flash filename; O(1) through the index
 int pit_find_partition(const PitInfo* info, const char* name, PitEntry* entry);
 uint32_t pit_calculate_size(const PitInfo* info);
 int pit_validate(const PitInfo* info);
 
+// 0, -1 bad arguments or short header, -2 bad magic, -3 truncated entries
+int pit_view_open(const uint8_t* data, uint32_t length, PitView* view);
+const PitEntry* pit_view_entry(const PitView* view, uint32_t index);
+// Linear; for a one-off lookup that is not worth an index
+const PitEntry* pit_view_find(const PitView* view, const char* name);
+
 // Samsung PIT constants
 #define PIT_MAGIC 0x12349876
 #define PIT_HEADER_SIZE 44
 #define PIT_ENTRY_SIZE 132
+#define PIT_NAME_SIZE 32
 
 #endif
\ No newline at end of file
@@ -0,0 +1,144 @@
+// source/pitcache.c
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "pitcache.h"
+#include "fileio.h"
+#include "crc32.h"
+
+#define PIT_CACHE_INDEX_LINE 128
+
+static char pit_cache_directory[128] = PIT_CACHE_DIRECTORY;
+static PitCacheStats pit_cache_stats;
+
+void pit_cache_set_directory(const char* directory) {
+    snprintf(pit_cache_directory, sizeof(pit_cache_directory), "%s",
+             directory ? directory : PIT_CACHE_DIRECTORY);
+}
+
+// PIT device names are free text; keep them to what FAT takes
+static void pit_cache_name(const char* device, char* name, uint32_t size) {
+    uint32_t i = 0;
+    for (; device && device[i] && i < size - 1; i++) {
+        char c = device[i];
+        name[i] = (isalnum((unsigned char)c) || c == '-' || c == '_') ? c : '_';
+    }
+    name[i] = '\0';
+    if (i == 0) snprintf(name, size, "unknown");
+}
+
+static void pit_cache_index_path(char* path, uint32_t size) {
+    snprintf(path, size, "%s/index", pit_cache_directory);
+}
+
+static void pit_cache_table_path(const char* name, char* path, uint32_t size) {
+    snprintf(path, size, "%s/%s.pit", pit_cache_directory, name);
+}
+
+// Rewrite the index without name's line, and with a new one for it when
+// size is not 0
+static int pit_cache_update_index(const char* name, uint32_t size, uint32_t checksum) {
+    char path[256];
+    pit_cache_index_path(path, sizeof(path));
+
+    uint32_t length = 0;
+    uint8_t* old = fileio_read_file(path, &length);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fileio_free_file(old);
+        return -3;
+    }
+
+    // One line per device: "<name> <size> <crc32>"
+    const char* p = (const char*)old;
+    const char* end = p + (old ? length : 0);
+    while (p < end) {
+        const char* eol = memchr(p, '\n', end - p);
+        uint32_t n = (uint32_t)((eol ? eol : end) - p);
+        char line[PIT_CACHE_INDEX_LINE], other[64];
+        if (n < sizeof(line)) {
+            memcpy(line, p, n);
+            line[n] = '\0';
+            if (sscanf(line, "%63s", other) == 1 && strcmp(other, name) != 0) {
+                fprintf(f, "%s\n", line);
+            }
+        }
+        p += n + 1;
+    }
+    fileio_free_file(old);
+
+    if (size) fprintf(f, "%s %u %08x\n", name, size, checksum);
+    return (fclose(f) == 0) ? 0 : -3;
+}
+
+// --- Public API ---
+
+int pit_cache_load(uint32_t size, uint32_t checksum, PitInfo* info) {
+    if (!info || size == 0) return -1;
+
+    char path[256], line[PIT_CACHE_INDEX_LINE], name[64];
+    pit_cache_index_path(path, sizeof(path));
+    FILE* f = fopen(path, "r");
+    int found = 0;
+    while (f && !found && fgets(line, sizeof(line), f)) {
+        unsigned int stored_size, stored_crc;
+        if (sscanf(line, "%63s %u %x", name, &stored_size, &stored_crc) == 3 &&
+            stored_size == size && stored_crc == checksum) {
+            found = 1;
+        }
+    }
+    if (f) fclose(f);
+    if (!found) {
+        pit_cache_stats.misses++;
+        return -1;
+    }
+
+    // The index only says what should be there; the table must still hash
+    // to what the device announced
+    uint32_t length = 0;
+    pit_cache_table_path(name, path, sizeof(path));
+    uint8_t* data = fileio_read_file(path, &length);
+    if (!data || length != size || crc32_update(0, data, length) != checksum) {
+        fileio_free_file(data);
+        pit_cache_stats.damaged++;
+        pit_cache_forget(name);
+        return -2;
+    }
+
+    int result = pit_parse(data, length, info);
+    fileio_free_file(data);
+    if (result != 0) return -3;
+    pit_cache_stats.hits++;
+    return 0;
+}
+
+int pit_cache_save(const char* device, const uint8_t* data, uint32_t size) {
+    if (!data || size == 0) return -1;
+
+    char name[64], path[256];
+    pit_cache_name(device, name, sizeof(name));
+    pit_cache_table_path(name, path, sizeof(path));
+    fileio_create_directory(pit_cache_directory);
+
+    // The table first: an index line never points at a half-written file
+    if (fileio_write_file(path, data, size) != 0) {
+        pit_cache_update_index(name, 0, 0);
+        return -3;
+    }
+    if (pit_cache_update_index(name, size, crc32_update(0, data, size)) != 0) return -3;
+    pit_cache_stats.saves++;
+    return 0;
+}
+
+void pit_cache_forget(const char* device) {
+    char name[64], path[256];
+    pit_cache_name(device, name, sizeof(name));
+    pit_cache_update_index(name, 0, 0);
+    pit_cache_table_path(name, path, sizeof(path));
+    remove(path);
+}
+
+const PitCacheStats* pit_cache_get_stats(void) {
+    return &pit_cache_stats;
+}
@@ -0,0 +1,38 @@
+// source/pitcache.h
+#ifndef PITCACHE_H
+#define PITCACHE_H
+
+#include <stdint.h>
+#include "pit.h"
+
+// PITs downloaded from devices, kept on the card so a later session does
+// not have to fetch the table again. Each is stored as it came off the
+// device under its PIT device name, and an index records the size and
+// CRC32 of every stored table. The device announces the size and CRC32 of
+// its PIT before sending it (samsung_request_pit), so a match in the index
+// is found without reading the table over USB; the stored file is checked
+// against the same CRC32 before it is used.
+
+#define PIT_CACHE_DIRECTORY "sd:/heimdall/pit"
+
+typedef struct {
+    uint32_t hits;              // Tables taken from the card
+    uint32_t misses;            // No stored table matched the device's
+    uint32_t damaged;           // Stored tables that failed their CRC32
+    uint32_t saves;
+} PitCacheStats;
+
+// NULL selects PIT_CACHE_DIRECTORY
+void pit_cache_set_directory(const char* directory);
+
+// Parse the stored table with this size and CRC32 into info.
+// 0, -1 none stored, -2 stored copy damaged (it is dropped), -3 bad PIT
+int pit_cache_load(uint32_t size, uint32_t checksum, PitInfo* info);
+// Store a table for device, replacing what it had. 0, -1 bad arguments,
+// -3 SD write failure
+int pit_cache_save(const char* device, const uint8_t* data, uint32_t size);
+void pit_cache_forget(const char* device);
+
+const PitCacheStats* pit_cache_get_stats(void);
+
+#endif
@@ -0,0 +1,389 @@
+// source/sparse.c
+#include <gccore.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "sparse.h"
+#include "mem.h"
+#include "crc32.h"
+
+#define SPARSE_FILE_HEADER  28
+#define SPARSE_CHUNK_HEADER 12
+#define SPARSE_MAJOR        1
+#define SPARSE_FILL_SIZE    (128 * 1024)   // Largest generated FILL/DONT_CARE run
+
+// Where each chunk starts, filled in as headers go past so resends can
+// seek back without walking the image again
+typedef struct {
+    uint64_t out_offset;        // Expanded offset of the chunk's data
+    uint32_t in_offset;         // Input offset of the chunk header
+} SparseIndex;
+
+struct SparseStream {
+    FlashSource input;
+    uint32_t in_pos;            // Input offset; FlashSource cannot report it
+
+    // File header
+    uint32_t file_header_size;
+    uint32_t chunk_header_size;
+    uint32_t block_size;
+    uint32_t total_blocks;
+    uint32_t total_chunks;
+    uint64_t size;
+
+    SparseIndex* index;
+    uint32_t indexed;           // Chunks whose headers have been read
+    uint64_t indexed_end;       // Expanded offset after the last of them
+
+    // Current chunk
+    uint32_t next_chunk;        // Chunk after the current one
+    uint16_t type;
+    uint64_t chunk_start;
+    uint64_t chunk_length;      // Expanded bytes
+    uint64_t chunk_pos;
+    uint32_t data_in;           // Input offset of RAW data
+    uint8_t pattern[4];
+
+    // Generated FILL and DONT_CARE data, a repeated 4-byte pattern
+    uint8_t* fill;
+    uint8_t fill_pattern[4];
+    int fill_valid;             // Cleared while it holds the last RAW piece
+
+    // CRC32 of the expanded data from offset 0 up to crc_pos
+    uint32_t crc;
+    uint64_t crc_pos;
+
+    SparseStats stats;
+    int error;
+};
+
+static inline uint32_t sparse_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t sparse_le16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// --- Input ---
+
+// Exactly length bytes of input, gathered across chunks
+static int sparse_input(SparseStream* s, uint8_t* buffer, uint32_t length) {
+    uint32_t filled = 0;
+    while (filled < length) {
+        const uint8_t* chunk;
+        int got = s->input.next(s->input.ctx, &chunk, length - filled);
+        if (got <= 0) return -1; // Truncated
+        memcpy(buffer + filled, chunk, got);
+        filled += got;
+    }
+    s->in_pos += length;
+    return 0;
+}
+
+static int sparse_input_seek(SparseStream* s, uint64_t offset) {
+    if (offset > 0xFFFFFFFFull) return -1;
+    if (offset == s->in_pos) return 0;
+    if (s->input.seek(s->input.ctx, (uint32_t)offset) != 0) return -1;
+    s->in_pos = (uint32_t)offset;
+    return 0;
+}
+
+// --- Chunks ---
+
+// Make chunk k current, positioned at its start. A chunk that has not been
+// indexed yet must be the next one and the input must be at its header.
+static int sparse_load_chunk(SparseStream* s, uint32_t k) {
+    int fresh = (k == s->indexed);
+    if (k > s->indexed || k >= s->total_chunks) return -1;
+
+    if (fresh) {
+        s->index[k].out_offset = s->indexed_end;
+        s->index[k].in_offset = s->in_pos;
+    } else if (sparse_input_seek(s, s->index[k].in_offset) != 0) {
+        return -1;
+    }
+
+    uint8_t header[SPARSE_CHUNK_HEADER];
+    if (sparse_input(s, header, SPARSE_CHUNK_HEADER) != 0) return -1;
+    if (sparse_input_seek(s, (uint64_t)s->in_pos + s->chunk_header_size -
+                             SPARSE_CHUNK_HEADER) != 0) return -1;
+
+    uint16_t type = sparse_le16(header);
+    uint32_t blocks = sparse_le32(header + 4);
+    uint32_t total = sparse_le32(header + 8);
+    uint64_t length = (uint64_t)blocks * s->block_size;
+    uint32_t payload = total - s->chunk_header_size;
+    if (total < s->chunk_header_size) return -1;
+
+    s->type = type;
+    s->chunk_start = s->index[k].out_offset;
+    s->chunk_length = length;
+    s->chunk_pos = 0;
+    s->data_in = s->in_pos;
+    memset(s->pattern, 0, sizeof(s->pattern));
+
+    switch (type) {
+    case SPARSE_CHUNK_RAW:
+        if (payload != length) return -1;
+        if (fresh) s->stats.raw_bytes += length;
+        break;
+    case SPARSE_CHUNK_FILL:
+        if (payload != 4 || sparse_input(s, s->pattern, 4) != 0) return -1;
+        if (fresh) s->stats.fill_bytes += length;
+        break;
+    case SPARSE_CHUNK_DONT_CARE:
+        if (payload != 0) return -1;
+        if (fresh) s->stats.dont_care_bytes += length;
+        break;
+    case SPARSE_CHUNK_CRC32: {
+        uint8_t value[4];
+        if (payload != 4 || blocks != 0 || sparse_input(s, value, 4) != 0) return -1;
+        // Only checkable when everything before it has been hashed
+        if (s->crc_pos == s->chunk_start) {
+            if (sparse_le32(value) != s->crc) return -1;
+            if (fresh) s->stats.crc_checked++;
+        }
+        break;
+    }
+    default:
+        return -1;
+    }
+
+    if (s->chunk_start + length > s->size) return -1;
+    if (fresh) {
+        s->indexed++;
+        s->indexed_end += length;
+    }
+    s->next_chunk = k + 1;
+    return 0;
+}
+
+// Move within the current chunk
+static int sparse_position(SparseStream* s, uint64_t pos) {
+    if (s->type == SPARSE_CHUNK_RAW &&
+        sparse_input_seek(s, (uint64_t)s->data_in + pos) != 0) return -1;
+    s->chunk_pos = pos;
+    return 0;
+}
+
+// Fill buffer holding the current chunk's pattern
+static const uint8_t* sparse_fill(SparseStream* s) {
+    if (!s->fill_valid || memcmp(s->fill_pattern, s->pattern, 4) != 0) {
+        for (uint32_t i = 0; i < SPARSE_FILL_SIZE + 4; i += 4) {
+            memcpy(s->fill + i, s->pattern, 4);
+        }
+        memcpy(s->fill_pattern, s->pattern, 4);
+        s->fill_valid = 1;
+    }
+    // The pattern repeats from the (block aligned) start of the chunk
+    return s->fill + (s->chunk_pos & 3);
+}
+
+// --- Public API ---
+
+int sparse_is_sparse(const uint8_t* data, uint32_t length) {
+    return data && length >= 4 && sparse_le32(data) == SPARSE_HEADER_MAGIC;
+}
+
+SparseStream* sparse_open(const FlashSource* input) {
+    if (!input || !input->next || !input->seek) return NULL;
+
+    SparseStream* s = calloc(1, sizeof(SparseStream));
+    if (!s) return NULL;
+    s->input = *input;
+
+    uint8_t header[SPARSE_FILE_HEADER];
+    if (sparse_input(s, header, SPARSE_FILE_HEADER) != 0 ||
+        !sparse_is_sparse(header, SPARSE_FILE_HEADER) ||
+        sparse_le16(header + 4) != SPARSE_MAJOR) {
+        free(s);
+        return NULL;
+    }
+
+    s->file_header_size = sparse_le16(header + 8);
+    s->chunk_header_size = sparse_le16(header + 10);
+    s->block_size = sparse_le32(header + 12);
+    s->total_blocks = sparse_le32(header + 16);
+    s->total_chunks = sparse_le32(header + 20);
+    s->size = (uint64_t)s->total_blocks * s->block_size;
+
+    if (s->file_header_size < SPARSE_FILE_HEADER ||
+        s->chunk_header_size < SPARSE_CHUNK_HEADER ||
+        s->block_size == 0 || (s->block_size & 3) != 0 ||
+        sparse_input_seek(s, s->file_header_size) != 0) {
+        free(s);
+        return NULL;
+    }
+
+    s->index = malloc((s->total_chunks ? s->total_chunks : 1) * sizeof(SparseIndex));
+    s->fill = mem_alloc(SPARSE_FILL_SIZE + 4);
+    if (!s->index || !s->fill) {
+        sparse_close(s);
+        return NULL;
+    }
+
+    s->stats.block_size = s->block_size;
+    s->stats.total_blocks = s->total_blocks;
+    s->stats.total_chunks = s->total_chunks;
+    return s;
+}
+
+uint64_t sparse_size(SparseStream* s) {
+    return s ? s->size : 0;
+}
+
+int sparse_next(SparseStream* s, const uint8_t** chunk, uint32_t max) {
+    if (!s || !chunk || max == 0) return -1;
+    if (s->error) return s->error;
+
+    while (s->chunk_pos >= s->chunk_length) {
+        if (s->next_chunk >= s->total_chunks) {
+            // Every block has to be accounted for
+            if (s->indexed_end != s->size) s->error = -1;
+            return s->error;
+        }
+        if (sparse_load_chunk(s, s->next_chunk) != 0) {
+            s->error = -1;
+            return -1;
+        }
+    }
+
+    uint64_t offset = s->chunk_start + s->chunk_pos;
+    uint64_t left = s->chunk_length - s->chunk_pos;
+    uint32_t length = (left < max) ? (uint32_t)left : max;
+    const uint8_t* data;
+
+    if (s->type == SPARSE_CHUNK_RAW) {
+        // The last piece is staged in the fill buffer (see below)
+        if (offset + length == s->size && length > SPARSE_FILL_SIZE) {
+            length = SPARSE_FILL_SIZE;
+        }
+        int got = s->input.next(s->input.ctx, &data, length);
+        if (got <= 0) {
+            s->error = -1;
+            return -1;
+        }
+        length = (uint32_t)got;
+        s->in_pos += length;
+    } else {
+        // FILL and DONT_CARE cost no input at all
+        if (length > SPARSE_FILL_SIZE) length = SPARSE_FILL_SIZE;
+        data = sparse_fill(s);
+    }
+
+    if (offset == s->crc_pos) {
+        s->crc = crc32_update(s->crc, data, length);
+        s->crc_pos += length;
+    }
+    s->chunk_pos += length;
+
+    // A final CRC32 chunk has to be checked before the last bytes go out,
+    // since callers stop reading at the image size. Reading it may move
+    // the input window, so RAW data is copied out of the way first.
+    if (offset + length == s->size && s->next_chunk < s->total_chunks) {
+        if (s->type == SPARSE_CHUNK_RAW) {
+            memcpy(s->fill, data, length);
+            s->fill_valid = 0;
+            data = s->fill;
+        }
+        while (s->next_chunk < s->total_chunks) {
+            if (sparse_load_chunk(s, s->next_chunk) != 0) {
+                s->error = -1;
+                return -1;
+            }
+        }
+    }
+
+    *chunk = data;
+    return (int)length;
+}
+
+int sparse_read(SparseStream* s, uint8_t* buffer, uint32_t length) {
+    uint32_t copied = 0;
+    while (copied < length) {
+        const uint8_t* chunk = NULL;
+        int res = sparse_next(s, &chunk, length - copied);
+        if (res < 0) return res;
+        if (res == 0) break;
+        memcpy(buffer + copied, chunk, res);
+        copied += res;
+    }
+    return (int)copied;
+}
+
+int sparse_seek(SparseStream* s, uint64_t offset) {
+    if (!s || offset > s->size) return -1;
+
+    // Inside the current chunk
+    if (s->next_chunk > 0 && offset >= s->chunk_start &&
+        offset < s->chunk_start + s->chunk_length) {
+        return sparse_position(s, offset - s->chunk_start);
+    }
+
+    if (offset < s->indexed_end) {
+        // Last indexed chunk starting at or before offset
+        uint32_t lo = 0, hi = s->indexed - 1;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (s->index[mid].out_offset <= offset) lo = mid;
+            else hi = mid - 1;
+        }
+        if (sparse_load_chunk(s, lo) != 0 ||
+            sparse_position(s, offset - s->chunk_start) != 0) {
+            s->error = -1;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Past the index: walk the headers, skipping data without reading it
+    int res = 0;
+    if (s->indexed == 0) {
+        res = sparse_input_seek(s, s->file_header_size);
+        s->next_chunk = 0;
+        s->chunk_start = s->chunk_length = s->chunk_pos = 0;
+    } else {
+        res = sparse_load_chunk(s, s->indexed - 1);
+        if (res == 0) res = sparse_position(s, s->chunk_length);
+    }
+    while (res == 0 && offset >= s->chunk_start + s->chunk_length &&
+           s->next_chunk < s->total_chunks) {
+        res = sparse_load_chunk(s, s->next_chunk);
+        if (res == 0) res = sparse_position(s, s->chunk_length);
+    }
+    if (res == 0 && offset < s->chunk_start + s->chunk_length) {
+        res = sparse_position(s, offset - s->chunk_start);
+    } else if (res == 0 && offset != s->size) {
+        res = -1;
+    }
+    if (res != 0) s->error = -1;
+    return res;
+}
+
+static int sparse_source_next(void* ctx, const uint8_t** chunk, uint32_t max) {
+    return sparse_next((SparseStream*)ctx, chunk, max);
+}
+
+static int sparse_source_seek(void* ctx, uint32_t offset) {
+    return sparse_seek((SparseStream*)ctx, offset);
+}
+
+void sparse_source(SparseStream* s, FlashSource* source) {
+    source->next = sparse_source_next;
+    source->seek = sparse_source_seek;
+    source->ctx = s;
+}
+
+void sparse_get_stats(SparseStream* s, SparseStats* stats) {
+    if (s && stats) *stats = s->stats;
+}
+
+void sparse_close(SparseStream* s) {
+    if (!s) return;
+    free(s->index);
+    mem_free(s->fill);
+    free(s);
+}
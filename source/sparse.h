@@ -0,0 +1,53 @@
+// source/sparse.h
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <stdint.h>
+#include "flash.h"
+
+// Android sparse images (simg). Samsung bootloaders take them as they
+// are, which is the fast path: DONT_CARE runs never cross the bus. For
+// targets that need the raw image, SparseStream expands the chunks on the
+// fly: RAW data is passed through from the input, FILL and DONT_CARE are
+// generated from one small pattern buffer, and CRC32 chunks are checked
+// against the data produced so far. Nothing close to the image size is
+// ever held in memory or written to the card.
+
+#define SPARSE_HEADER_MAGIC 0xED26FF3A
+
+#define SPARSE_CHUNK_RAW       0xCAC1
+#define SPARSE_CHUNK_FILL      0xCAC2
+#define SPARSE_CHUNK_DONT_CARE 0xCAC3
+#define SPARSE_CHUNK_CRC32     0xCAC4
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t total_blocks;
+    uint32_t total_chunks;
+    uint64_t raw_bytes;         // Expanded bytes per chunk type, as seen so far
+    uint64_t fill_bytes;
+    uint64_t dont_care_bytes;
+    uint32_t crc_checked;       // CRC32 chunks verified
+} SparseStats;
+
+typedef struct SparseStream SparseStream;
+
+// Non-zero when data starts with a sparse image header
+int sparse_is_sparse(const uint8_t* data, uint32_t length);
+
+// Reads the file header. NULL if the input is not a sparse image.
+SparseStream* sparse_open(const FlashSource* input);
+
+// Size of the expanded image
+uint64_t sparse_size(SparseStream* stream);
+
+// Same contract as lz4_next/lz4_read/lz4_seek; <0 on a malformed image or
+// a CRC32 chunk that does not match
+int sparse_next(SparseStream* stream, const uint8_t** chunk, uint32_t max);
+int sparse_read(SparseStream* stream, uint8_t* buffer, uint32_t length);
+int sparse_seek(SparseStream* stream, uint64_t offset);
+void sparse_source(SparseStream* stream, FlashSource* source);
+void sparse_get_stats(SparseStream* stream, SparseStats* stats);
+void sparse_close(SparseStream* stream);
+
+#endif
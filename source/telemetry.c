@@ -0,0 +1,121 @@
+// source/telemetry.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include "telemetry.h"
+
+typedef struct {
+    u64 time;
+    uint64_t bytes;
+} TelemetrySample;
+
+static TelemetryStats stats;
+static uint32_t publish_interval = TELEMETRY_DEFAULT_PUBLISH_US;
+static u64 start_time;
+static u64 last_publish;
+
+// Ring of (time, bytes) taken at each publish, oldest at sample_head
+static TelemetrySample samples[TELEMETRY_SAMPLES];
+static uint32_t sample_head = 0;
+static uint32_t sample_count = 0;
+
+void telemetry_set_publish_interval(uint32_t us) {
+    publish_interval = us;
+}
+
+void telemetry_start(uint64_t total) {
+    memset(&stats, 0, sizeof(stats));
+    stats.total = total;
+    stats.eta_us = -1;
+    start_time = last_publish = gettime();
+
+    sample_head = 0;
+    sample_count = 1;
+    samples[0].time = start_time;
+    samples[0].bytes = 0;
+}
+
+void telemetry_add(uint32_t bytes, uint64_t busy_us, uint64_t stall_us) {
+    stats.bytes += bytes;
+    stats.busy_us += busy_us;
+    stats.stall_us += stall_us;
+    if (stats.chunks == 0 || busy_us < stats.chunk_min_us) stats.chunk_min_us = (uint32_t)busy_us;
+    if (busy_us > stats.chunk_max_us) stats.chunk_max_us = (uint32_t)busy_us;
+    stats.chunks++;
+}
+
+// Fold the publish point at now into the moving average
+static void telemetry_sample(u64 now) {
+    uint32_t tail = (sample_head + sample_count) % TELEMETRY_SAMPLES;
+    samples[tail].time = now;
+    samples[tail].bytes = stats.bytes;
+    if (sample_count < TELEMETRY_SAMPLES) {
+        sample_count++;
+    } else {
+        sample_head = (sample_head + 1) % TELEMETRY_SAMPLES;
+    }
+
+    // Drop samples until the oldest is the last one at least a window old
+    while (sample_count > 2 &&
+           ticks_to_microsecs(now - samples[(sample_head + 1) % TELEMETRY_SAMPLES].time) >=
+           TELEMETRY_WINDOW_US) {
+        sample_head = (sample_head + 1) % TELEMETRY_SAMPLES;
+        sample_count--;
+    }
+    const TelemetrySample* oldest = &samples[sample_head];
+    uint64_t age = ticks_to_microsecs(now - oldest->time);
+
+    stats.elapsed_us = ticks_to_microsecs(now - start_time);
+    if (stats.elapsed_us > 0) {
+        stats.overall = (double)stats.bytes * 1000000.0 / (double)stats.elapsed_us;
+    }
+    if (age > 0) {
+        stats.average = (double)(stats.bytes - oldest->bytes) * 1000000.0 / (double)age;
+    }
+
+    // Peak and minimum only count once the window has filled, so the ramp
+    // up and a short transfer do not show up as the slowest rate
+    if (age >= TELEMETRY_WINDOW_US) {
+        if (stats.average > stats.peak) stats.peak = stats.average;
+        if (stats.minimum == 0.0 || stats.average < stats.minimum) stats.minimum = stats.average;
+    }
+
+    double rate = (stats.average > 0.0) ? stats.average : stats.overall;
+    if (stats.total == 0 || rate <= 0.0) {
+        stats.eta_us = -1;
+    } else if (stats.bytes >= stats.total) {
+        stats.eta_us = 0;
+    } else {
+        stats.eta_us = (int64_t)((double)(stats.total - stats.bytes) * 1000000.0 / rate);
+    }
+}
+
+int telemetry_due(void) {
+    u64 now = gettime();
+    int complete = (stats.total > 0 && stats.bytes >= stats.total);
+    if (!complete && ticks_to_microsecs(now - last_publish) < publish_interval) {
+        return 0;
+    }
+    last_publish = now;
+    telemetry_sample(now);
+    stats.publishes++;
+    return 1;
+}
+
+const TelemetryStats* telemetry_get(void) {
+    // A transfer that was never published still gets its totals
+    if (stats.publishes == 0 && stats.bytes > 0) telemetry_sample(gettime());
+    return &stats;
+}
+
+void telemetry_format(const char* label, char* text, uint32_t size) {
+    double rate = (stats.average > 0.0) ? stats.average : stats.overall;
+    if (stats.eta_us < 0) {
+        snprintf(text, size, "%s %.1f MB/s", label, rate / (1024.0 * 1024.0));
+        return;
+    }
+    uint32_t seconds = (uint32_t)((stats.eta_us + 999999) / 1000000);
+    snprintf(text, size, "%s %.1f MB/s, %u:%02u left", label, rate / (1024.0 * 1024.0),
+             seconds / 60, seconds % 60);
+}
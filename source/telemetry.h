@@ -0,0 +1,50 @@
+// source/telemetry.h
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+// Transfer telemetry. The flash loops record every chunk (bytes, how long
+// the send took, how long they waited for data) at full rate, which costs
+// a few adds; the progress callback, and with it the GUI, only hears about
+// it once per publish interval. Rates are a moving average over the last
+// TELEMETRY_WINDOW_US, so the ETA follows the bus rather than the start.
+// Single thread: whoever runs the transfer owns it.
+
+#define TELEMETRY_DEFAULT_PUBLISH_US 16667     // One frame at 60 Hz
+#define TELEMETRY_WINDOW_US          1000000
+#define TELEMETRY_SAMPLES            64        // Publish points kept for the average
+
+typedef struct {
+    uint64_t total;             // Bytes expected, 0 unknown
+    uint64_t bytes;             // Bytes recorded
+    uint32_t chunks;
+    uint32_t publishes;
+    uint64_t busy_us;           // Sum of chunk send times
+    uint64_t stall_us;          // Sum of waits for data
+    uint32_t chunk_min_us;
+    uint32_t chunk_max_us;
+    uint64_t elapsed_us;
+
+    // Bytes per second
+    double average;             // Over the moving window
+    double peak;                // Highest and lowest window average seen
+    double minimum;             // ... once a full window had passed
+    double overall;             // bytes / elapsed
+    int64_t eta_us;             // -1 until a rate is known
+} TelemetryStats;
+
+// Start a transfer of total bytes
+void telemetry_start(uint64_t total);
+// One chunk went out: send time and the wait before it
+void telemetry_add(uint32_t bytes, uint64_t busy_us, uint64_t stall_us);
+// 1 when the progress callback should run: the publish interval passed
+// since the last time, or the transfer is complete
+int telemetry_due(void);
+const TelemetryStats* telemetry_get(void);
+// Status text with rate and ETA, e.g. "Transferring 24.1 MB/s, 0:42 left"
+void telemetry_format(const char* label, char* text, uint32_t size);
+// 0 publishes on every chunk
+void telemetry_set_publish_interval(uint32_t us);
+
+#endif
@@ -0,0 +1,379 @@
+// source/transfer.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "transfer.h"
+#include "usb.h"
+#include "crc32.h"
+
+#define READER_STACK_SIZE (16 * 1024)
+#define READER_PRIORITY   70
+
+typedef struct TransferSlot TransferSlot;
+
+// One buffer on its way to one device
+typedef struct {
+    TransferSlot* slot;
+    uint32_t target;
+} TransferWrite;
+
+struct TransferSlot {
+    Transfer* owner;
+    uint8_t* data;
+    uint32_t length;
+    u64 submitted;              // For the async write latency histogram
+    u64 completed;              // Last device done; 0 once recorded
+    volatile int pending;       // Devices still writing this buffer
+    TransferWrite writes[TRANSFER_MAX_TARGETS];
+};
+
+struct Transfer {
+    TransferConfig config;
+    TransferSource source;
+    TransferSlot* slots;
+
+    // free: empty buffers, full: buffers ready to send,
+    // queue: USB write slots not in flight
+    sem_t free_sem;
+    sem_t full_sem;
+    sem_t queue_sem;
+    lwp_t reader;
+
+    uint32_t read_index;        // Next slot the reader fills
+    uint32_t send_index;        // Next slot the submitter takes
+    int in_flight;              // Writes submitted since the last drain
+    int sems_ready;
+
+    UsbDevice* targets[TRANSFER_MAX_TARGETS];
+    uint32_t target_count;
+    volatile int target_error[TRANSFER_MAX_TARGETS];
+    volatile int failed_targets;
+    uint64_t target_bytes[TRANSFER_MAX_TARGETS];
+
+    volatile int abort;
+    volatile int read_error;
+    volatile int usb_error;     // Set once no device is left
+
+    TransferStats stats;
+    u64 start_time;
+};
+
+void transfer_default_config(TransferConfig* config) {
+    config->buffer_count = TRANSFER_DEFAULT_BUFFERS;
+    config->buffer_size = TRANSFER_DEFAULT_BUFFER_SIZE;
+    config->queue_depth = TRANSFER_DEFAULT_DEPTH;
+}
+
+static void transfer_normalize(TransferConfig* config) {
+    TransferConfig defaults;
+    transfer_default_config(&defaults);
+
+    if (config->buffer_count < 2) config->buffer_count = defaults.buffer_count;
+    if (config->buffer_size == 0) config->buffer_size = defaults.buffer_size;
+    if (config->queue_depth == 0) config->queue_depth = defaults.queue_depth;
+
+    // Every buffer must go out in a single DMA-aligned bulk message
+    if (config->buffer_size > USB_MAX_TRANSFER) config->buffer_size = USB_MAX_TRANSFER;
+    config->buffer_size &= ~31u;
+    if (config->buffer_size == 0) config->buffer_size = 32;
+
+    // More writes in flight than buffers would starve the reader
+    if (config->queue_depth >= config->buffer_count) {
+        config->queue_depth = config->buffer_count - 1;
+    }
+}
+
+// --- Reader Thread ---
+
+static void* transfer_reader(void* arg) {
+    Transfer* t = (Transfer*)arg;
+
+    while (!t->abort) {
+        u64 wait_start = gettime();
+        LWP_SemWait(t->free_sem);
+        u64 read_start = gettime();
+        t->stats.reader_stall_us += ticks_to_microsecs(read_start - wait_start);
+        if (t->abort) break;
+
+        TransferSlot* slot = &t->slots[t->read_index];
+        t->read_index = (t->read_index + 1) % t->config.buffer_count;
+
+        // Fill the whole buffer unless the source runs dry
+        uint32_t filled = 0;
+        while (filled < t->config.buffer_size) {
+            int res = t->source.read(t->source.ctx, slot->data + filled,
+                                     t->config.buffer_size - filled);
+            if (res < 0) {
+                t->read_error = res;
+                break;
+            }
+            if (res == 0) break;
+            filled += res;
+        }
+        u64 checksum_start = gettime();
+        t->stats.read_us += ticks_to_microsecs(checksum_start - read_start);
+
+        if (!t->read_error && t->source.digest) {
+            digest_update(t->source.digest, slot->data, filled);
+            t->stats.checksum = digest_checksum(t->source.digest);
+            t->stats.checksum_us += ticks_to_microsecs(gettime() - checksum_start);
+        } else if (!t->read_error) {
+            t->stats.checksum = crc32_update(t->stats.checksum, slot->data, filled);
+            t->stats.checksum_us += ticks_to_microsecs(gettime() - checksum_start);
+        }
+
+        // A zero-length slot tells the submitter the stream has ended
+        slot->length = t->read_error ? 0 : filled;
+        LWP_SemPost(t->full_sem);
+
+        if (filled == 0 || t->read_error) break;
+    }
+
+    return NULL;
+}
+
+// --- USB Completion ---
+
+// Runs from the IPC callback, so only semaphore posts are allowed here;
+// the completion tick is left in the slot for the submitter to record.
+// With several devices the callbacks of different ones can overlap.
+static void transfer_write_done_slot(TransferSlot* slot) {
+    Transfer* t = slot->owner;
+    if (__sync_sub_and_fetch(&slot->pending, 1) == 0) {
+        slot->completed = gettime();
+        LWP_SemPost(t->free_sem);
+        LWP_SemPost(t->queue_sem);
+    }
+}
+
+static void transfer_fail_target(Transfer* t, uint32_t target, int error) {
+    if (t->target_error[target]) return;
+    t->target_error[target] = error;
+    if ((uint32_t)__sync_add_and_fetch(&t->failed_targets, 1) == t->target_count) {
+        t->usb_error = error;
+    }
+}
+
+static s32 transfer_write_done(s32 result, void* arg) {
+    TransferWrite* write = (TransferWrite*)arg;
+    TransferSlot* slot = write->slot;
+    if (result != (s32)slot->length) {
+        transfer_fail_target(slot->owner, write->target, (result < 0) ? result : -1);
+    }
+    transfer_write_done_slot(slot);
+    return 0;
+}
+
+// The histograms are not safe to touch from the callback, so a slot's
+// write latency is recorded by the submitter once the slot comes back
+static void transfer_record_latency(TransferSlot* slot) {
+    if (!slot->completed) return;
+    usb_record_latency(USB_LATENCY_WRITE_ASYNC,
+                       ticks_to_microsecs(slot->completed - slot->submitted));
+    slot->completed = 0;
+}
+
+// --- Public API ---
+
+Transfer* transfer_open(const TransferConfig* config, const TransferSource* source) {
+    UsbDevice* device = usb_get_default_device();
+    return transfer_open_multi(config, source, &device, 1);
+}
+
+Transfer* transfer_open_multi(const TransferConfig* config, const TransferSource* source,
+                              UsbDevice* const* devices, uint32_t count) {
+    if (!source || !source->read || !devices || count == 0 ||
+        count > TRANSFER_MAX_TARGETS) {
+        return NULL;
+    }
+
+    Transfer* t = calloc(1, sizeof(Transfer));
+    if (!t) return NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        t->targets[i] = devices[i];
+    }
+    t->target_count = count;
+
+    if (config) {
+        t->config = *config;
+    }
+    transfer_normalize(&t->config);
+    t->source = *source;
+    t->reader = LWP_THREAD_NULL;
+    t->start_time = gettime();
+
+    LWP_SemInit(&t->free_sem, t->config.buffer_count, t->config.buffer_count);
+    LWP_SemInit(&t->full_sem, 0, t->config.buffer_count);
+    LWP_SemInit(&t->queue_sem, t->config.queue_depth, t->config.queue_depth);
+    t->sems_ready = 1;
+
+    t->slots = calloc(t->config.buffer_count, sizeof(TransferSlot));
+    if (!t->slots) {
+        transfer_close(t, NULL);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < t->config.buffer_count; i++) {
+        t->slots[i].owner = t;
+        for (uint32_t j = 0; j < count; j++) {
+            t->slots[i].writes[j].slot = &t->slots[i];
+            t->slots[i].writes[j].target = j;
+        }
+        t->slots[i].data = usb_lend_buffer(t->config.buffer_size);
+        if (!t->slots[i].data) {
+            transfer_close(t, NULL);
+            return NULL;
+        }
+    }
+
+    if (LWP_CreateThread(&t->reader, transfer_reader, t, NULL,
+                         READER_STACK_SIZE, READER_PRIORITY) < 0) {
+        t->reader = LWP_THREAD_NULL;
+        transfer_close(t, NULL);
+        return NULL;
+    }
+
+    return t;
+}
+
+int transfer_acquire(Transfer* t, uint8_t** buffer, uint32_t* length) {
+    if (t->usb_error) return t->usb_error;
+
+    u64 wait_start = gettime();
+    LWP_SemWait(t->full_sem);
+    t->stats.writer_stall_us += ticks_to_microsecs(gettime() - wait_start);
+
+    TransferSlot* slot = &t->slots[t->send_index];
+    transfer_record_latency(slot);
+    if (slot->length == 0) {
+        // Leave the end marker visible for later calls
+        LWP_SemPost(t->full_sem);
+        return t->read_error ? t->read_error : 0;
+    }
+
+    t->send_index = (t->send_index + 1) % t->config.buffer_count;
+    *buffer = slot->data;
+    *length = slot->length;
+    return 1;
+}
+
+int transfer_submit(Transfer* t, uint8_t* buffer, uint32_t length) {
+    // Buffers are handed out in ring order, so this is the previous slot
+    uint32_t index = (t->send_index + t->config.buffer_count - 1) % t->config.buffer_count;
+    TransferSlot* slot = &t->slots[index];
+    if (slot->data != buffer || length > slot->length) return -1;
+    slot->length = length;
+
+    u64 wait_start = gettime();
+    LWP_SemWait(t->queue_sem);
+    t->stats.usb_stall_us += ticks_to_microsecs(gettime() - wait_start);
+
+    if (t->usb_error) {
+        LWP_SemPost(t->queue_sem);
+        LWP_SemPost(t->free_sem);
+        return t->usb_error;
+    }
+
+    t->in_flight = 1;
+    slot->submitted = gettime();
+
+    // Every device's write is counted before the first one can complete
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < t->target_count; i++) {
+        if (!t->target_error[i]) live++;
+    }
+    slot->pending = (int)live + 1;
+    for (uint32_t i = 0; i < t->target_count; i++) {
+        if (t->target_error[i]) continue;
+        if (usb_device_send_data_async(t->targets[i], buffer, length,
+                                       transfer_write_done, &slot->writes[i]) != 0) {
+            transfer_fail_target(t, i, -1);
+            transfer_write_done_slot(slot);
+        } else {
+            t->target_bytes[i] += length;
+        }
+    }
+    // Drop the submitter's own count; frees the slot if nothing is in flight
+    transfer_write_done_slot(slot);
+    if (t->usb_error) return t->usb_error;
+
+    t->stats.bytes += length;
+    t->stats.buffers++;
+    return 0;
+}
+
+int transfer_target_error(const Transfer* t, uint32_t index) {
+    return (index < t->target_count) ? t->target_error[index] : -1;
+}
+
+uint64_t transfer_target_bytes(const Transfer* t, uint32_t index) {
+    return (index < t->target_count) ? t->target_bytes[index] : 0;
+}
+
+int transfer_drain(Transfer* t) {
+    if (!t->in_flight) return t->usb_error;
+
+    // Collecting every queue slot means every write has completed
+    u64 wait_start = gettime();
+    for (uint32_t i = 0; i < t->config.queue_depth; i++) {
+        LWP_SemWait(t->queue_sem);
+    }
+    for (uint32_t i = 0; i < t->config.queue_depth; i++) {
+        LWP_SemPost(t->queue_sem);
+    }
+    t->in_flight = 0;
+    t->stats.usb_stall_us += ticks_to_microsecs(gettime() - wait_start);
+
+    return t->usb_error;
+}
+
+int transfer_close(Transfer* t, TransferStats* stats) {
+    if (!t) return -1;
+
+    int result = 0;
+    if (t->reader != LWP_THREAD_NULL) {
+        result = transfer_drain(t);
+
+        // Wake the reader if it is parked waiting for a free buffer
+        t->abort = 1;
+        for (uint32_t i = 0; i < t->config.buffer_count; i++) {
+            LWP_SemPost(t->free_sem);
+        }
+        LWP_JoinThread(t->reader, NULL);
+
+        for (uint32_t i = 0; i < t->config.buffer_count; i++) {
+            transfer_record_latency(&t->slots[i]);
+        }
+    }
+
+    if (t->sems_ready) {
+        LWP_SemDestroy(t->free_sem);
+        LWP_SemDestroy(t->full_sem);
+        LWP_SemDestroy(t->queue_sem);
+    }
+
+    // A device writes in order and at most queue_depth buffers are out at
+    // once, so after a failure everything before the last of them landed
+    t->stats.confirmed = t->stats.bytes;
+    if (result != 0 || t->failed_targets > 0) {
+        uint64_t in_flight = (uint64_t)t->config.queue_depth * t->config.buffer_size;
+        t->stats.confirmed = (t->stats.bytes > in_flight) ? t->stats.bytes - in_flight : 0;
+    }
+
+    t->stats.elapsed_us = ticks_to_microsecs(gettime() - t->start_time);
+    if (stats) {
+        *stats = t->stats;
+    }
+
+    if (t->slots) {
+        for (uint32_t i = 0; i < t->config.buffer_count; i++) {
+            usb_return_buffer(t->slots[i].data);
+        }
+        free(t->slots);
+    }
+    free(t);
+    return result;
+}
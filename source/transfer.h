@@ -0,0 +1,86 @@
+// source/transfer.h
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdint.h>
+#include "digest.h"
+#include "usb.h"
+
+// Pipelined SD -> USB transfer engine.
+// A reader thread fills a ring of 32-byte aligned buffers from the source
+// while the caller hands filled buffers to USB_WriteBlkMsgAsync, so the SD
+// card and the USB bus are busy at the same time. The reader also folds
+// each buffer into a running CRC32 while the bus is still busy with the
+// previous one, so the checksum never costs a second pass.
+// The ring can also fan out to several devices: each buffer is read once
+// and written to every device still in the transfer.
+
+// Returns bytes read, 0 at end of data, <0 on error
+typedef int (*TransferReadFn)(void* ctx, uint8_t* buffer, uint32_t length);
+
+typedef struct {
+    TransferReadFn read;
+    void* ctx;
+    uint64_t size;              // Total bytes expected from read()
+    ImageDigest* digest;        // Optional: per-block CRCs for flash_verify
+} TransferSource;
+
+typedef struct {
+    uint32_t buffer_count;      // Buffers in the ring
+    uint32_t buffer_size;       // Bytes per buffer (multiple of 32)
+    uint32_t queue_depth;       // Async USB writes allowed in flight
+} TransferConfig;
+
+// Time is in microseconds
+typedef struct {
+    uint64_t bytes;
+    uint64_t confirmed;         // Of those, bytes known to have reached every device
+    uint32_t buffers;
+    uint64_t read_us;           // Reader inside read()
+    uint64_t reader_stall_us;   // Reader waiting for a free buffer
+    uint64_t writer_stall_us;   // Submitter waiting for a filled buffer
+    uint64_t usb_stall_us;      // Submitter waiting for a free queue slot
+    uint64_t checksum_us;       // Reader inside crc32_update()
+    uint64_t elapsed_us;
+    uint32_t checksum;          // CRC32 of every byte read, taken as it was read
+} TransferStats;
+
+typedef struct Transfer Transfer;
+
+#define TRANSFER_MAX_TARGETS        4
+#define TRANSFER_DEFAULT_BUFFERS    8
+#define TRANSFER_DEFAULT_BUFFER_SIZE 0x8000
+#define TRANSFER_DEFAULT_DEPTH      2
+
+void transfer_default_config(TransferConfig* config);
+
+// Start the reader thread. Zero fields in config take the defaults.
+Transfer* transfer_open(const TransferConfig* config, const TransferSource* source);
+
+// transfer_open for count devices at once. A buffer goes back to the
+// reader once the last device finished writing it, so the ring moves at
+// the pace of the slowest one. A device whose write fails drops out and
+// the rest carry on; the transfer fails only when none is left.
+Transfer* transfer_open_multi(const TransferConfig* config, const TransferSource* source,
+                              UsbDevice* const* devices, uint32_t count);
+// <0 once a write to the index'th device failed
+int transfer_target_error(const Transfer* t, uint32_t index);
+// Bytes queued to the index'th device
+uint64_t transfer_target_bytes(const Transfer* t, uint32_t index);
+
+// Next filled buffer in read order. Returns 1 with a buffer, 0 at end of
+// data, <0 on read error or when an earlier USB write failed.
+int transfer_acquire(Transfer* t, uint8_t** buffer, uint32_t* length);
+
+// Queue an acquired buffer on the bulk OUT endpoint. The buffer goes back
+// to the reader once the write completes (on every device, see above). Buffers must be submitted in the
+// order they were acquired.
+int transfer_submit(Transfer* t, uint8_t* buffer, uint32_t length);
+
+// Wait for every submitted write. Returns <0 if any of them failed.
+int transfer_drain(Transfer* t);
+
+// Drain, stop the reader and free the ring. stats may be NULL.
+int transfer_close(Transfer* t, TransferStats* stats);
+
+#endif
@@ -0,0 +1,141 @@
+// source/tuner.c
+#include <stdio.h>
+#include <string.h>
+#include "tuner.h"
+
+// Bulk message size, writes in flight, ring buffers. The first is the
+// transfer engine's default, so a new phone starts where it always did.
+static const uint32_t candidates[TUNER_CANDIDATES][3] = {
+    { 0x8000, 2, 8 },
+    { 0x4000, 2, 16 },
+    { 0xFFE0, 2, 8 },
+    { 0x8000, 4, 8 },
+    { 0xFFE0, 4, 8 },
+    { 0x4000, 4, 16 },
+};
+
+static TunerProfile profiles[TUNER_DEVICES];
+static uint32_t tuner_clock = 0;
+static int tuner_dirty = 0;
+
+void tuner_candidate(uint32_t index, TransferConfig* config) {
+    if (index >= TUNER_CANDIDATES) index = 0;
+    config->buffer_size = candidates[index][0];
+    config->queue_depth = candidates[index][1];
+    config->buffer_count = candidates[index][2];
+}
+
+static TunerProfile* tuner_lookup(const char* device, int create) {
+    if (!device || !device[0]) return NULL;
+
+    for (int i = 0; i < TUNER_DEVICES; i++) {
+        if (profiles[i].device[0] &&
+            strncmp(profiles[i].device, device, sizeof(profiles[i].device) - 1) == 0) {
+            return &profiles[i];
+        }
+    }
+    if (!create) return NULL;
+
+    // A free slot, or the model not flashed for longest
+    TunerProfile* oldest = &profiles[0];
+    for (int i = 0; i < TUNER_DEVICES && oldest->device[0]; i++) {
+        if (!profiles[i].device[0] || profiles[i].used < oldest->used) oldest = &profiles[i];
+    }
+    memset(oldest, 0, sizeof(*oldest));
+    snprintf(oldest->device, sizeof(oldest->device), "%s", device);
+    oldest->best = -1;
+    tuner_dirty = 1;
+    return oldest;
+}
+
+static int tuner_usable(const TunerProfile* p, int index) {
+    return p->failures[index] < TUNER_MAX_FAILURES;
+}
+
+int tuner_select(const char* device, TransferConfig* config) {
+    int index = 0;
+    TunerProfile* p = tuner_lookup(device, 1);
+    if (p) {
+        p->used = ++tuner_clock;
+        if (p->best >= 0) {
+            index = p->best;
+        } else {
+            // Next candidate without a rate, in order
+            for (index = 0; index < TUNER_CANDIDATES; index++) {
+                if (tuner_usable(p, index) && p->kbps[index] == 0) break;
+            }
+            if (index == TUNER_CANDIDATES) index = 0;
+        }
+    }
+    tuner_candidate(index, config);
+    return index;
+}
+
+// Once every usable candidate has a rate, settle on the fastest
+static void tuner_choose(TunerProfile* p) {
+    int best = -1;
+    for (int i = 0; i < TUNER_CANDIDATES; i++) {
+        if (!tuner_usable(p, i)) continue;
+        if (p->kbps[i] == 0) {
+            p->best = -1;
+            return;
+        }
+        if (best < 0 || p->kbps[i] > p->kbps[best]) best = i;
+    }
+    p->best = best;
+}
+
+void tuner_record(const char* device, int candidate, uint64_t bytes,
+                  uint64_t elapsed_us, int ok) {
+    TunerProfile* p = tuner_lookup(device, 0);
+    if (!p || candidate < 0 || candidate >= TUNER_CANDIDATES) return;
+
+    if (!ok) {
+        if (p->failures[candidate] < 0xFF) p->failures[candidate]++;
+    } else {
+        if (bytes < TUNER_MIN_BYTES || elapsed_us == 0) return;
+        uint64_t rate = bytes * 1000000 / elapsed_us / 1024;
+        uint32_t kbps = (rate > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (rate ? (uint32_t)rate : 1);
+        // Smoothed, so one slow SD card run does not throw the choice away
+        uint32_t old = p->kbps[candidate];
+        p->kbps[candidate] = old ? (uint32_t)(((uint64_t)old * 3 + kbps) / 4) : kbps;
+    }
+    tuner_choose(p);
+    tuner_dirty = 1;
+}
+
+const TunerProfile* tuner_find(const char* device) {
+    return tuner_lookup(device, 0);
+}
+
+void tuner_forget(const char* device) {
+    TunerProfile* p = tuner_lookup(device, 0);
+    if (p) {
+        memset(p, 0, sizeof(*p));
+        tuner_dirty = 1;
+    }
+}
+
+// --- Persistence ---
+
+int tuner_is_dirty(void) {
+    return tuner_dirty;
+}
+
+void tuner_export(TunerProfile* out) {
+    memcpy(out, profiles, sizeof(profiles));
+    tuner_dirty = 0;
+}
+
+void tuner_import(const TunerProfile* in) {
+    memcpy(profiles, in, sizeof(profiles));
+    tuner_clock = 0;
+    for (int i = 0; i < TUNER_DEVICES; i++) {
+        TunerProfile* p = &profiles[i];
+        p->device[sizeof(p->device) - 1] = '\0';
+        // A damaged entry starts probing again
+        if (p->best < -1 || p->best >= TUNER_CANDIDATES) p->best = -1;
+        if (p->used > tuner_clock) tuner_clock = p->used;
+    }
+    tuner_dirty = 0;
+}
@@ -0,0 +1,46 @@
+// source/tuner.h
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdint.h>
+#include "transfer.h"
+
+// Transfer size auto-tuner. Phones differ in how large a bulk message and
+// how many writes in flight they take best, so heimdall_flash_file does not
+// use one setting for all of them. For each device model (PIT device_name)
+// the first flashes each try the next candidate and record the rate they
+// got; once all have run, the fastest one that never failed is used from
+// then on. Later flashes keep refining the rate of the one in use, so a
+// setting that gets slower gives way to the runner-up. The profiles are
+// kept in the config file, so a known phone starts at its best setting.
+
+#define TUNER_CANDIDATES   6
+#define TUNER_DEVICES      4                   // Models remembered, least recent dropped
+#define TUNER_MIN_BYTES    (4 * 1024 * 1024)   // Shorter flashes say little about the bus
+#define TUNER_MAX_FAILURES 2                   // Failed flashes before a candidate is out
+
+typedef struct {
+    char device[32];            // PIT device_name, "" = free slot
+    uint32_t kbps[TUNER_CANDIDATES];    // Measured rate, 0 = not tried yet
+    uint8_t failures[TUNER_CANDIDATES];
+    int32_t best;               // Candidate in use once all were tried, -1 = probing
+    uint32_t used;              // Recency, for replacing the oldest profile
+} TunerProfile;
+
+// Settings of candidate index
+void tuner_candidate(uint32_t index, TransferConfig* config);
+// Fill config for the next flash to device. Returns the candidate index.
+int tuner_select(const char* device, TransferConfig* config);
+// Outcome of a flash made with candidate. ok is 0 for a transfer failure.
+void tuner_record(const char* device, int candidate, uint64_t bytes,
+                  uint64_t elapsed_us, int ok);
+// NULL when the device has no profile
+const TunerProfile* tuner_find(const char* device);
+void tuner_forget(const char* device);
+
+// Persistence through config.c. tuner_export clears the changed flag.
+int tuner_is_dirty(void);
+void tuner_export(TunerProfile* profiles);          // TUNER_DEVICES entries
+void tuner_import(const TunerProfile* profiles);
+
+#endif
@@ -1,135 +1,390 @@
 #include <gccore.h>
+#include <ogc/lwp_watchdog.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <malloc.h>
 #include "usb.h"
+#include "mem.h"
 
-#define SAMSUNG_VID 0x04E8
-#define SAMSUNG_PID 0x685D
+// One phone: its transport, handle and bounce buffer
+struct UsbDevice {
+    const UsbTransport* transport;
+    int transport_ready;
+    int open;
+    UsbDeviceInfo info;
+    uint8_t* buffer;            // Bounce buffer and command packets
+};
 
-static s32 usb_device_fd = -1;
-static uint8_t* usb_buffer = NULL; 
-static const uint32_t BUFFER_SIZE = 0x10000;
+// What the plain usb_* calls work on
+static UsbDevice usb_default;
+static UsbSessionStats session_stats;
+static const uint32_t BUFFER_SIZE = USB_MAX_TRANSFER;
+static UsbPerf usb_perf;
 
-// Hardware Endpoints for Samsung Download Mode
-static u8 endpoint_out = 0x01;
-static u8 endpoint_in = 0x81;
+void usb_set_transport(const UsbTransport* new_transport) {
+    usb_close_device();
+    usb_default.transport = new_transport;
+    usb_default.transport_ready = 0;
+}
 
-int usb_init_device(void) {
-    if (USB_Initialize() < 0) return -1;
-    if (!usb_buffer) {
-        // Allocate 32-byte aligned memory for DMA
-        usb_buffer = memalign(32, BUFFER_SIZE);
+const UsbTransport* usb_get_transport(void) {
+    return usb_default.transport;
+}
+
+UsbDevice* usb_get_default_device(void) {
+    return &usb_default;
+}
+
+// --- Device Contexts ---
+
+UsbDevice* usb_device_create(const UsbTransport* transport) {
+    if (!transport) return NULL;
+    UsbDevice* dev = calloc(1, sizeof(UsbDevice));
+    if (dev) dev->transport = transport;
+    return dev;
+}
+
+void usb_device_destroy(UsbDevice* dev) {
+    if (!dev || dev == &usb_default) return;
+    usb_device_close(dev);
+    mem_free(dev->buffer);
+    free(dev);
+}
+
+int usb_device_init(UsbDevice* dev) {
+    if (!dev->transport) return -1;
+    if (!dev->transport_ready) {
+        // Host stack setup is paid once per transport, not on every detect
+        if (dev->transport->init && dev->transport->init(dev->transport->ctx) < 0) return -1;
+        dev->transport_ready = 1;
+        session_stats.inits++;
+    }
+    if (!dev->buffer) {
+        // 32-byte aligned memory for DMA, from the MEM2 pools
+        dev->buffer = mem_alloc(BUFFER_SIZE);
     }
-    return (usb_buffer) ? 0 : -1;
+    return (dev->buffer) ? 0 : -1;
 }
 
-int usb_open_device(int index) {
-    // 1. Open the device handle
-    s32 result = USB_OpenDevice(index, SAMSUNG_VID, SAMSUNG_PID, &usb_device_fd);
-    if (result < 0) {
-        result = USB_OpenDevice(index, SAMSUNG_VID, 0x68C0, &usb_device_fd);
+int usb_device_open(UsbDevice* dev, int index) {
+    const UsbTransport* transport = dev->transport;
+    if (!transport) return -1;
+    if (dev->open) usb_device_close(dev);
+
+    int result = transport->open(transport->ctx, index);
+    if (result < 0) return result;
+
+    memset(&dev->info, 0, sizeof(dev->info));
+    dev->info.endpoint_out = 0x01;
+    dev->info.endpoint_in = 0x81;
+    if (transport->describe && transport->describe(transport->ctx, &dev->info) < 0) {
+        transport->close(transport->ctx);
+        return -2;
     }
 
-    if (result < 0) return -1;
+    dev->open = 1;
+    session_stats.opens++;
+    return 0;
+}
 
-    // 2. REAL INTERFACE CLAIMING
-    // On the Wii, "claiming" is done by selecting the configuration 
-    // and setting the alternate interface.
-    
-    u8 config = 0;
-    // Get the first configuration
-    if (USB_GetConfiguration(usb_device_fd, &config) < 0) {
-        config = 1; // Default to 1 if read fails
+void usb_device_close(UsbDevice* dev) {
+    if (dev->open && dev->transport) {
+        dev->transport->close(dev->transport->ctx);
     }
+    dev->open = 0;
+}
 
-    if (USB_SetConfiguration(usb_device_fd, config) < 0) {
-        return -2;
+int usb_device_connect(UsbDevice* dev) {
+    if (dev->open) {
+        if (!dev->transport->probe || dev->transport->probe(dev->transport->ctx) == 0) {
+            session_stats.reuses++;
+            return 0;
+        }
+        // Unplugged or rebooted: the handle is stale
+        usb_device_close(dev);
     }
+    if (usb_device_init(dev) != 0) return -1;
+    return (usb_device_open(dev, 0) == 0) ? 0 : -1;
+}
+
+int usb_device_is_open(const UsbDevice* dev) {
+    return dev->open;
+}
 
-    // Samsung uses Interface 0, AltSetting 0 for Odin/Heimdall protocol
-    if (USB_SetAlternativeInterface(usb_device_fd, 0, 0) < 0) {
-        // Some devices don't require this call, but it's safer to attempt
+const UsbDeviceInfo* usb_device_get_info(const UsbDevice* dev) {
+    return dev->open ? &dev->info : NULL;
+}
+
+// --- Default Device ---
+
+int usb_init_device(void) {
+    return usb_device_init(&usb_default);
+}
+
+uint8_t* usb_lend_buffer(uint32_t size) {
+    return mem_alloc(size);
+}
+
+void usb_return_buffer(uint8_t* buffer) {
+    mem_free(buffer);
+}
+
+int usb_open_device(int index) {
+    return usb_device_open(&usb_default, index);
+}
+
+void usb_close_device(void) {
+    usb_device_close(&usb_default);
+}
+
+int usb_connect(void) {
+    return usb_device_connect(&usb_default);
+}
+
+const UsbDeviceInfo* usb_get_device_info(void) {
+    return usb_device_get_info(&usb_default);
+}
+
+const UsbSessionStats* usb_get_session_stats(void) {
+    return &session_stats;
+}
+
+// --- Latency ---
+
+void usb_record_latency(int which, uint64_t us) {
+    if (which < 0 || which >= USB_LATENCY_COUNT) return;
+    UsbHistogram* h = &usb_perf.latency[which];
+    uint32_t bucket = us ? 32 - __builtin_clz(us > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)us) : 0;
+    if (bucket >= USB_HISTOGRAM_BUCKETS) bucket = USB_HISTOGRAM_BUCKETS - 1;
+    h->buckets[bucket]++;
+    h->count++;
+    h->total_us += us;
+    if (us > h->max_us) h->max_us = (us > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (uint32_t)us;
+}
+
+const UsbPerf* usb_get_perf(void) {
+    return &usb_perf;
+}
+
+void usb_reset_perf(void) {
+    memset(&usb_perf, 0, sizeof(usb_perf));
+}
+
+uint32_t usb_histogram_percentile(const UsbHistogram* histogram, uint32_t percent) {
+    if (!histogram || histogram->count == 0) return 0;
+    uint64_t wanted = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < USB_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= wanted && seen > 0) {
+            return (i == USB_HISTOGRAM_BUCKETS - 1) ? histogram->max_us : (1u << i);
+        }
     }
+    return histogram->max_us;
+}
 
-    return 0;
+// Timed bulk OUT, the one place USB_WriteBlkMsg is reached from
+static int usb_bulk_out(UsbDevice* dev, const uint8_t* data, uint32_t length) {
+    u64 start = gettime();
+    int res = dev->transport->bulk_out(dev->transport->ctx, data, length);
+    usb_record_latency(USB_LATENCY_WRITE, ticks_to_microsecs(gettime() - start));
+    return res;
+}
+
+int usb_is_device_open(void) {
+    return usb_default.open;
 }
 
 // --- The Handshake ---
 
-int usb_send_samsung_cmd(const char* cmd_str, uint32_t param) {
-    if (usb_device_fd < 0) return -1;
+int usb_device_send_samsung_cmd(UsbDevice* dev, const char* cmd_str, uint32_t param) {
+    uint8_t* packet = dev->buffer;
+    if (!dev->open || !packet) return -1;
 
     // Samsung protocol expects exactly 16 bytes
-    memset(usb_buffer, 0, 16);
-    memcpy(usb_buffer, cmd_str, strlen(cmd_str) > 16 ? 16 : strlen(cmd_str));
-    
+    memset(packet, 0, 16);
+    memcpy(packet, cmd_str, strlen(cmd_str) > 16 ? 16 : strlen(cmd_str));
+
     // Pack parameter as Big Endian at the end of the 16-byte packet
-    usb_buffer[12] = (param >> 24) & 0xFF;
-    usb_buffer[13] = (param >> 16) & 0xFF;
-    usb_buffer[14] = (param >> 8) & 0xFF;
-    usb_buffer[15] = param & 0xFF;
+    packet[12] = (param >> 24) & 0xFF;
+    packet[13] = (param >> 16) & 0xFF;
+    packet[14] = (param >> 8) & 0xFF;
+    packet[15] = param & 0xFF;
 
-    s32 res = USB_WriteBlkMsg(usb_device_fd, endpoint_out, 16, usb_buffer);
+    int res = usb_bulk_out(dev, packet, 16);
     return (res == 16) ? 0 : -1;
 }
 
-int usb_start_flash_session(const char* partition) {
+int usb_send_samsung_cmd(const char* cmd_str, uint32_t param) {
+    return usb_device_send_samsung_cmd(&usb_default, cmd_str, param);
+}
+
+int usb_device_start_session(UsbDevice* dev) {
     // This is the sequence Heimdall/Odin uses to "wake up" the phone
-    if (usb_send_samsung_cmd("Odin", 0) < 0) return -1;
-    
+    if (usb_device_send_samsung_cmd(dev, "Odin", 0) < 0) return -1;
+
     // Request to begin PIT transmission
-    if (usb_send_samsung_cmd("PITR", 0) < 0) return -2;
-    
+    if (usb_device_send_samsung_cmd(dev, "PITR", 0) < 0) return -2;
+
+    return 0;
+}
+
+int usb_start_session(void) {
+    return usb_device_start_session(&usb_default);
+}
+
+int usb_device_start_flash_session(UsbDevice* dev, const char* partition) {
+    int res = usb_device_start_session(dev);
+    if (res != 0) return res;
+
     // Select the target partition
-    if (usb_send_samsung_cmd(partition, 0) < 0) return -3;
+    if (usb_device_send_samsung_cmd(dev, partition, 0) < 0) return -3;
 
     return 0;
 }
 
-int usb_send_data(const uint8_t* data, uint32_t size) {
-    if (usb_device_fd < 0) return -1;
+int usb_start_flash_session(const char* partition) {
+    return usb_device_start_flash_session(&usb_default, partition);
+}
+
+// Write one bulk message, bouncing through the device's buffer only when
+// the caller's memory is not DMA-aligned
+static int usb_write_chunk(UsbDevice* dev, const uint8_t* data, uint32_t chunk) {
+    const uint8_t* dma = data;
+    if ((uintptr_t)data & 31) {
+        u64 start = gettime();
+        memcpy(dev->buffer, data, chunk);
+        usb_perf.bounce_us += ticks_to_microsecs(gettime() - start);
+        usb_perf.bounce_bytes += chunk;
+        dma = dev->buffer;
+    }
+
+    int res = usb_bulk_out(dev, dma, chunk);
+    return (res == (int)chunk) ? 0 : -1;
+}
+
+int usb_device_send_data(UsbDevice* dev, const uint8_t* data, uint32_t size) {
+    if (!dev->open || !dev->buffer) return -1;
 
     uint32_t sent = 0;
     while (sent < size) {
         uint32_t chunk = (size - sent > BUFFER_SIZE) ? BUFFER_SIZE : (size - sent);
-        
-        // Copy to aligned buffer
-        memcpy(usb_buffer, data + sent, chunk);
-        
-        // Write to Bulk OUT endpoint
-        s32 res = USB_WriteBlkMsg(usb_device_fd, endpoint_out, chunk, usb_buffer);
-        if (res != (s32)chunk) return -1;
-        
+
+        // Aligned chunks stay aligned since BUFFER_SIZE is a multiple of 32
+        if (usb_write_chunk(dev, data + sent, chunk) != 0) return -1;
+
         sent += chunk;
     }
     return 0;
 }
 
-void usb_cleanup(void) {
-    if (usb_device_fd >= 0) {
-        USB_CloseDevice(&usb_device_fd);
-        usb_device_fd = -1;
+int usb_send_data(const uint8_t* data, uint32_t size) {
+    return usb_device_send_data(&usb_default, data, size);
+}
+
+int usb_send_bulk(const uint8_t* data, uint32_t length) {
+    if (usb_send_data(data, length) != 0) return -1;
+    return (int)length;
+}
+
+int usb_device_receive_bulk(UsbDevice* dev, uint8_t** data, uint32_t* length) {
+    if (!dev->open || !dev->buffer || !data || !length || *length == 0) return -1;
+
+    uint32_t wanted = *length;
+    if (!*data) {
+        // Caller gives the buffer back with usb_return_buffer()
+        *data = usb_lend_buffer(wanted);
+        if (!*data) return -1;
     }
-    if (usb_buffer) {
-        free(usb_buffer);
-        usb_buffer = NULL;
+
+    uint8_t* dst = *data;
+    uint32_t received = 0;
+    while (received < wanted) {
+        uint32_t chunk = (wanted - received > BUFFER_SIZE) ? BUFFER_SIZE : (wanted - received);
+
+        // DMA straight into the caller's memory only when whole cache lines
+        // are covered, otherwise invalidation could clobber neighbouring data
+        uint8_t* target = dst + received;
+        int direct = (((uintptr_t)target & 31) == 0) && ((chunk & 31) == 0);
+
+        u64 start = gettime();
+        int res = dev->transport->bulk_in(dev->transport->ctx,
+                                          direct ? target : dev->buffer, chunk);
+        u64 end = gettime();
+        usb_record_latency(wanted <= USB_ACK_MAX_LENGTH ? USB_LATENCY_ACK : USB_LATENCY_READ,
+                           ticks_to_microsecs(end - start));
+        if (res < 0) return -1;
+        if (!direct) {
+            memcpy(target, dev->buffer, res);
+            usb_perf.bounce_us += ticks_to_microsecs(gettime() - end);
+            usb_perf.bounce_bytes += res;
+        }
+
+        received += res;
+        if ((uint32_t)res < chunk) break; // Short packet ends the transfer
+    }
+
+    *length = received;
+    return 0;
+}
+
+int usb_receive_bulk(uint8_t** data, uint32_t* length) {
+    return usb_device_receive_bulk(&usb_default, data, length);
+}
+
+int usb_device_send_data_async(UsbDevice* dev, const uint8_t* data, uint32_t size,
+                               UsbAsyncCallback callback, void* arg) {
+    if (!dev->open) return -1;
+
+    // The transport DMAs straight out of the caller's buffer, so no bounce copy here
+    if (((uintptr_t)data & 31) || size == 0 || size > USB_MAX_TRANSFER) return -2;
+
+    if (!dev->transport->bulk_out_async) {
+        s32 res = usb_bulk_out(dev, data, size);
+        if (callback) callback(res, arg);
+        return 0;
+    }
+
+    return dev->transport->bulk_out_async(dev->transport->ctx, data, size, callback, arg);
+}
+
+int usb_send_data_async(const uint8_t* data, uint32_t size,
+                        UsbAsyncCallback callback, void* arg) {
+    return usb_device_send_data_async(&usb_default, data, size, callback, arg);
+}
+
+int usb_send_control(uint8_t request, uint16_t value, uint16_t index,
+                     uint8_t* data, uint16_t length) {
+    const UsbTransport* transport = usb_default.transport;
+    if (!usb_default.open || !transport->control) return -1;
+
+    // Vendor request to the interface, host to device
+    return transport->control(transport->ctx, 0x41, request, value, index, data, length);
+}
+
+void usb_cleanup(void) {
+    usb_close_device();
+    if (usb_default.buffer) {
+        mem_free(usb_default.buffer);
+        usb_default.buffer = NULL;
     }
 }
 
 // This allows heimdall.c to check if the device is still there
 int usb_is_connected(void) {
-    return (usb_device_fd >= 0);
+    return usb_default.open;
 }
 
-// This allows heimdall.c to properly close the Samsung session
-int usb_end_flash_session(void) {
-    if (usb_device_fd < 0) return -1;
-    
+int usb_device_end_flash_session(UsbDevice* dev) {
+    if (!dev->open) return -1;
+
     // Send the Samsung "End Session" command
     // Some devices use "ENDC", others just need the session closed
-    int res = usb_send_samsung_cmd("ENDC", 0);
-    
-    return res;
+    return usb_device_send_samsung_cmd(dev, "ENDC", 0);
+}
+
+// This allows heimdall.c to properly close the Samsung session
+int usb_end_flash_session(void) {
+    return usb_device_end_flash_session(&usb_default);
 }
@@ -4,22 +4,125 @@
 #include <stdint.h>
 #include <gctypes.h>
 
+// Largest single bulk message (libogc takes a u16 length), kept 32-byte aligned
+#define USB_MAX_TRANSFER 0xFFE0
+
+// Completion for async writes; result is bytes written or <0.
+// Called from the IPC callback context.
+typedef s32 (*UsbAsyncCallback)(s32 result, void* arg);
+
+// What a transport found on the device it opened. Read from the
+// descriptors once per open; the bulk pair is the first interface that has one.
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t configuration;      // bConfigurationValue in use
+    uint8_t interface;
+    uint8_t alternate;
+    uint8_t endpoint_out;       // Bulk OUT address
+    uint8_t endpoint_in;        // Bulk IN address, 0x80 set
+    uint16_t max_packet;        // wMaxPacketSize of the bulk OUT endpoint
+} UsbDeviceInfo;
+
+// Transport behind the usb_* functions. Buffers handed to bulk_out,
+// bulk_out_async and bulk_in are 32-byte aligned, padded to whole cache
+// lines and at most USB_MAX_TRANSFER bytes; usb.c bounces and splits
+// everything else. bulk_* return bytes transferred or <0.
+typedef struct {
+    const char* name;
+    int (*init)(void* ctx);
+    int (*open)(void* ctx, int index);
+    int (*bulk_out)(void* ctx, const uint8_t* data, uint32_t length);
+    // Optional; without it async writes complete synchronously
+    int (*bulk_out_async)(void* ctx, const uint8_t* data, uint32_t length,
+                          UsbAsyncCallback callback, void* arg);
+    int (*bulk_in)(void* ctx, uint8_t* data, uint32_t length);
+    int (*control)(void* ctx, uint8_t request_type, uint8_t request,
+                   uint16_t value, uint16_t index, uint8_t* data, uint16_t length);
+    void (*close)(void* ctx);
+    // Optional; without it the device keeps the Odin defaults (0x01/0x81)
+    int (*describe)(void* ctx, UsbDeviceInfo* info);
+    // Optional; 0 while the open device still answers. Without it an open
+    // device is taken to be there.
+    int (*probe)(void* ctx);
+    void* ctx;
+} UsbTransport;
+
+// Select the transport used by every usb_* call (closes any open device)
+void usb_set_transport(const UsbTransport* transport);
+const UsbTransport* usb_get_transport(void);
+
+// The Wii's own USB stack (usb_ogc.c). usb_ogc_transport drives the first
+// Samsung device on the bus, usb_ogc_port_transport the slot'th one
+// (0 .. USB_OGC_SLOTS-1), so both Wii ports can be used at once.
+#define USB_OGC_SLOTS 2
+const UsbTransport* usb_ogc_transport(void);
+const UsbTransport* usb_ogc_port_transport(int slot);
+
 // Core USB subsystem
 int usb_init(void);
 void usb_cleanup(void);
 
 // Logic-level functions (ADD THESE: they fix your compiler errors)
 int usb_init_device(void); 
+int usb_start_session(void);             // Odin handshake only, for the file protocol
 int usb_start_flash_session(const char* partition);
 int usb_send_data(const uint8_t* data, uint32_t size);
+// data must be 32-byte aligned and size <= USB_MAX_TRANSFER
+int usb_send_data_async(const uint8_t* data, uint32_t size,
+                        UsbAsyncCallback callback, void* arg);
 int usb_end_flash_session(void);
 
-// Device management
+// DMA-safe buffers (32-byte aligned, padded to whole cache lines).
+// Data sent from a lent buffer goes to USB without a bounce copy.
+uint8_t* usb_lend_buffer(uint32_t size);
+void usb_return_buffer(uint8_t* buffer);
+
+// Device management. The transport is initialised once and the device,
+// once opened, stays open across sessions: usb_connect only goes back to
+// the bus when the handle stopped answering.
 int usb_scan_devices(void);
 int usb_open_device(int index);
 void usb_close_device(void);
 int usb_is_device_open(void);
 int usb_is_connected(void);
+// Reuse the open device, or open device 0. Returns 0 when one is there.
+int usb_connect(void);
+// Descriptors of the open device, NULL when none is open
+const UsbDeviceInfo* usb_get_device_info(void);
+
+// Per-phone contexts, for driving several devices at once (see multi.h).
+// Each has its own transport, handle and bounce buffer; the usb_* calls
+// above and below work on the default one, whose transport is the one
+// usb_set_transport selects.
+typedef struct UsbDevice UsbDevice;
+
+UsbDevice* usb_get_default_device(void);
+UsbDevice* usb_device_create(const UsbTransport* transport);
+void usb_device_destroy(UsbDevice* dev);   // Closes it first
+int usb_device_init(UsbDevice* dev);
+int usb_device_open(UsbDevice* dev, int index);
+void usb_device_close(UsbDevice* dev);
+int usb_device_connect(UsbDevice* dev);
+int usb_device_is_open(const UsbDevice* dev);
+const UsbDeviceInfo* usb_device_get_info(const UsbDevice* dev);
+int usb_device_send_samsung_cmd(UsbDevice* dev, const char* cmd_str, uint32_t param);
+int usb_device_start_session(UsbDevice* dev);
+int usb_device_start_flash_session(UsbDevice* dev, const char* partition);
+int usb_device_end_flash_session(UsbDevice* dev);
+int usb_device_send_data(UsbDevice* dev, const uint8_t* data, uint32_t size);
+int usb_device_send_data_async(UsbDevice* dev, const uint8_t* data, uint32_t size,
+                               UsbAsyncCallback callback, void* arg);
+int usb_device_receive_bulk(UsbDevice* dev, uint8_t** data, uint32_t* length);
+
+// How often the bus was set up, to tell a reused session from a new one
+typedef struct {
+    uint32_t inits;             // transport->init calls
+    uint32_t opens;             // transport->open calls that succeeded
+    uint32_t reuses;            // usb_connect calls served by the open device
+} UsbSessionStats;
+
+const UsbSessionStats* usb_get_session_stats(void);
 
 // Low-level IO
 int usb_send_bulk(const uint8_t* data, uint32_t length);
@@ -27,6 +130,38 @@ int usb_receive_bulk(uint8_t** data, uint32_t* length);
 int usb_send_control(uint8_t request, uint16_t value, uint16_t index, 
                      uint8_t* data, uint16_t length);
 
+// Latency histograms. Every bulk message is timed with gettime and
+// counted in a power-of-two bucket: bucket 0 is under 1 us, bucket i holds
+// [2^(i-1), 2^i) us, the last one everything above. Recording is a few
+// adds, so it stays on.
+#define USB_HISTOGRAM_BUCKETS 24
+#define USB_ACK_MAX_LENGTH    64    // Bulk IN this short is a protocol answer
+
+#define USB_LATENCY_WRITE       0   // Synchronous bulk OUT message
+#define USB_LATENCY_WRITE_ASYNC 1   // Async bulk OUT, submit to completion
+#define USB_LATENCY_ACK         2   // Bulk IN of an ACK or other answer
+#define USB_LATENCY_READ        3   // Bulk IN of data (readback, dumps)
+#define USB_LATENCY_COUNT       4
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t buckets[USB_HISTOGRAM_BUCKETS];
+} UsbHistogram;
+
+typedef struct {
+    UsbHistogram latency[USB_LATENCY_COUNT];
+    uint64_t bounce_bytes;      // Copied through a bounce buffer for alignment
+    uint64_t bounce_us;
+} UsbPerf;
+
+void usb_record_latency(int which, uint64_t us);
+const UsbPerf* usb_get_perf(void);
+void usb_reset_perf(void);
+// Upper bound in us of the bucket holding the percent'th percentile
+uint32_t usb_histogram_percentile(const UsbHistogram* histogram, uint32_t percent);
+
 // Samsung specific
 // Change this line in usb.h:
 int usb_send_samsung_cmd(const char* cmd_str, uint32_t param);
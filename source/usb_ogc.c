@@ -0,0 +1,223 @@
+// source/usb_ogc.c
+// libogc transport: the real USB host stack behind IOS
+#include <gccore.h>
+#include <stdio.h>
+#include <string.h>
+#include "usb.h"
+
+#define SAMSUNG_VID 0x04E8
+#define SAMSUNG_PID 0x685D
+#define SAMSUNG_PID_ALT 0x68C0
+#define OGC_MAX_ENTRIES 8
+
+// One Samsung device on the bus. The slot'th one found is opened, so
+// phones on both ports each get their own handle.
+typedef struct {
+    int slot;
+    s32 fd;
+    // Read from the descriptors when the device is opened. The defaults are
+    // the usual Samsung download mode endpoints, for a device whose
+    // descriptors cannot be read.
+    UsbDeviceInfo info;
+    u8 status[32] ATTRIBUTE_ALIGN(32);
+} OgcDevice;
+
+static OgcDevice ogc_devices[USB_OGC_SLOTS];
+static int ogc_ready = 0;
+
+static int ogc_init(void* ctx) {
+    // Both slots share the host stack; it is only brought up once
+    if (ogc_ready) return 0;
+    if (USB_Initialize() < 0) return -1;
+    ogc_ready = 1;
+    return 0;
+}
+
+// The first interface with a bulk IN/OUT pair carries the Odin protocol;
+// on CDC-style phones that is the data interface, not interface 0
+static void ogc_read_descriptors(OgcDevice* dev) {
+    usb_devdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    if (USB_GetDescriptors(dev->fd, &desc) < 0) return;
+
+    dev->info.vid = desc.idVendor;
+    dev->info.pid = desc.idProduct;
+    if (desc.bNumConfigurations > 0 && desc.configurations) {
+        usb_configurationdesc* config = &desc.configurations[0];
+        dev->info.configuration = config->bConfigurationValue;
+
+        for (int i = 0; i < config->bNumInterfaces; i++) {
+            usb_interfacedesc* iface = &config->interfaces[i];
+            u8 out = 0, in = 0;
+            u16 max_packet = 0;
+            for (int e = 0; e < iface->bNumEndpoints; e++) {
+                usb_endpointdesc* ep = &iface->endpoints[e];
+                if ((ep->bmAttributes & 0x03) != USB_ENDPOINT_BULK) continue;
+                if (ep->bEndpointAddress & USB_ENDPOINT_IN) {
+                    if (!in) in = ep->bEndpointAddress;
+                } else if (!out) {
+                    out = ep->bEndpointAddress;
+                    max_packet = ep->wMaxPacketSize;
+                }
+            }
+            if (in && out) {
+                dev->info.interface = iface->bInterfaceNumber;
+                dev->info.alternate = iface->bAlternateSetting;
+                dev->info.endpoint_out = out;
+                dev->info.endpoint_in = in;
+                dev->info.max_packet = max_packet;
+                break;
+            }
+        }
+    }
+    USB_FreeDescriptors(&desc);
+}
+
+// Open the nth Samsung device in download mode. Returns its PID, <0 if
+// there are not that many.
+static int ogc_open_nth(OgcDevice* dev, int nth) {
+    usb_device_entry entries[OGC_MAX_ENTRIES];
+    u8 count = 0;
+    if (USB_GetDeviceList(entries, OGC_MAX_ENTRIES, 0, &count) >= 0) {
+        for (int i = 0; i < count; i++) {
+            if (entries[i].vid != SAMSUNG_VID ||
+                (entries[i].pid != SAMSUNG_PID && entries[i].pid != SAMSUNG_PID_ALT)) continue;
+            if (nth-- > 0) continue;
+            if (USB_OpenDevice(entries[i].device_id, SAMSUNG_VID, entries[i].pid, &dev->fd) < 0) {
+                return -1;
+            }
+            return entries[i].pid;
+        }
+        return -1;
+    }
+
+    // No device list: the first device is still reachable the old way
+    if (nth != 0) return -1;
+    if (USB_OpenDevice(0, SAMSUNG_VID, SAMSUNG_PID, &dev->fd) >= 0) return SAMSUNG_PID;
+    if (USB_OpenDevice(0, SAMSUNG_VID, SAMSUNG_PID_ALT, &dev->fd) >= 0) return SAMSUNG_PID_ALT;
+    return -1;
+}
+
+static int ogc_open(void* ctx, int index) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+
+    // 1. Open the device handle
+    dev->fd = -1;
+    int pid = ogc_open_nth(dev, dev->slot + index);
+    if (pid < 0) {
+        dev->fd = -1;
+        return -1;
+    }
+
+    memset(&dev->info, 0, sizeof(dev->info));
+    dev->info.vid = SAMSUNG_VID;
+    dev->info.pid = (uint16_t)pid;
+    dev->info.endpoint_out = 0x01;
+    dev->info.endpoint_in = 0x81;
+    ogc_read_descriptors(dev);
+
+    // 2. REAL INTERFACE CLAIMING
+    // On the Wii, "claiming" is done by selecting the configuration
+    // and setting the alternate interface. Setting the configuration the
+    // device already runs only resets its endpoints, so it is skipped then.
+    u8 config = 0;
+    if (USB_GetConfiguration(dev->fd, &config) < 0) {
+        config = 0;
+    }
+    u8 wanted = dev->info.configuration ? dev->info.configuration : 1;
+    if (config != wanted) {
+        if (USB_SetConfiguration(dev->fd, wanted) < 0) {
+            USB_CloseDevice(&dev->fd);
+            dev->fd = -1;
+            return -2;
+        }
+    }
+    dev->info.configuration = wanted;
+
+    if (USB_SetAlternativeInterface(dev->fd, dev->info.interface, dev->info.alternate) < 0) {
+        // Some devices don't require this call, but it's safer to attempt
+    }
+
+    return 0;
+}
+
+static int ogc_describe(void* ctx, UsbDeviceInfo* info) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd < 0) return -1;
+    *info = dev->info;
+    return 0;
+}
+
+// GET_STATUS on the device: a few microseconds when it is still there
+static int ogc_probe(void* ctx) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd < 0) return -1;
+    return (USB_ReadCtrlMsg(dev->fd, 0x80, 0x00, 0, 0, 2, dev->status) < 0) ? -1 : 0;
+}
+
+static int ogc_bulk_out(void* ctx, const uint8_t* data, uint32_t length) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd < 0) return -1;
+    return USB_WriteBlkMsg(dev->fd, dev->info.endpoint_out, (u16)length, (void*)data);
+}
+
+static int ogc_bulk_out_async(void* ctx, const uint8_t* data, uint32_t length,
+                              UsbAsyncCallback callback, void* arg) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd < 0) return -1;
+    s32 res = USB_WriteBlkMsgAsync(dev->fd, dev->info.endpoint_out, (u16)length,
+                                   (void*)data, callback, arg);
+    return (res < 0) ? -1 : 0;
+}
+
+static int ogc_bulk_in(void* ctx, uint8_t* data, uint32_t length) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd < 0) return -1;
+    return USB_ReadBlkMsg(dev->fd, dev->info.endpoint_in, (u16)length, data);
+}
+
+static int ogc_control(void* ctx, uint8_t request_type, uint8_t request,
+                       uint16_t value, uint16_t index, uint8_t* data, uint16_t length) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd < 0) return -1;
+    if (request_type & 0x80) {
+        return USB_ReadCtrlMsg(dev->fd, request_type, request, value, index, length, data);
+    }
+    return USB_WriteCtrlMsg(dev->fd, request_type, request, value, index, length, data);
+}
+
+static void ogc_close(void* ctx) {
+    OgcDevice* dev = (OgcDevice*)ctx;
+    if (dev->fd >= 0) {
+        USB_CloseDevice(&dev->fd);
+        dev->fd = -1;
+    }
+}
+
+static UsbTransport ogc_transports[USB_OGC_SLOTS];
+
+const UsbTransport* usb_ogc_port_transport(int slot) {
+    if (slot < 0 || slot >= USB_OGC_SLOTS) return NULL;
+
+    UsbTransport* t = &ogc_transports[slot];
+    if (!t->name) {
+        ogc_devices[slot].slot = slot;
+        ogc_devices[slot].fd = -1;
+        t->name = "libogc";
+        t->init = ogc_init;
+        t->open = ogc_open;
+        t->bulk_out = ogc_bulk_out;
+        t->bulk_out_async = ogc_bulk_out_async;
+        t->bulk_in = ogc_bulk_in;
+        t->control = ogc_control;
+        t->close = ogc_close;
+        t->describe = ogc_describe;
+        t->probe = ogc_probe;
+        t->ctx = &ogc_devices[slot];
+    }
+    return t;
+}
+
+const UsbTransport* usb_ogc_transport(void) {
+    return usb_ogc_port_transport(0);
+}
@@ -0,0 +1,629 @@
+// source/usb_sim.c
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "usb_sim.h"
+#include "crc32.h"
+
+#define SIM_QUEUE_SIZE     32
+#define SIM_RESPONSES      64
+#define SIM_STACK_SIZE     (16 * 1024)
+#define SIM_PRIORITY       80
+#define SIM_PARTITIONS     16
+
+// Protocol states
+#define SIM_IDLE       0   // Waiting for a 16-byte command or a file header
+#define SIM_RAW        1   // Partition selected, everything is image data
+#define SIM_FILE       2   // File header seen, waiting for a part or the end
+#define SIM_PART_DATA  3   // Collecting the data of one part
+
+// Contents of one partition as the host wrote it
+typedef struct {
+    char name[32];
+    uint8_t* data;
+    uint64_t size;
+    uint64_t capacity;
+} SimPartition;
+
+typedef struct {
+    const uint8_t* data;
+    uint32_t length;
+    UsbAsyncCallback callback;
+    void* arg;
+} SimWrite;
+
+struct UsbSim {
+    UsbSimConfig config;
+    UsbTransport transport;
+    UsbSimStats stats;
+
+    // Protocol state, guarded by state_lock
+    mutex_t state_lock;
+    int state;
+    uint32_t part_sequence;
+    uint32_t part_remaining;
+    int part_rejected;
+    int part_summed;            // Part is the next one in order, fold it in
+    uint32_t file_checksum;     // CRC32 of parts 0..checksum_parts-1
+    uint32_t checksum_parts;
+    int ack_dropped;
+    uint32_t part_size;         // Length of part 0, which fixes part offsets
+    int delta;                  // Parts not sent keep the stored data
+    uint32_t file_size;
+    uint64_t part_offset;
+    uint8_t responses[SIM_RESPONSES][16];
+    uint32_t response_head;
+    uint32_t response_count;
+
+    // Storage, and the partition being written or read back
+    SimPartition partitions[SIM_PARTITIONS];
+    SimPartition* target;
+    uint64_t raw_offset;
+    SimPartition* dump;
+    uint64_t dump_offset;
+    uint64_t dump_remaining;
+    uint8_t* pit;               // What PITD hands out
+    uint32_t pit_size;
+    uint32_t pit_offset;
+    uint32_t pit_remaining;     // Sent after the PITD answer has been read
+
+    // Async write queue, drained in order by the bus thread
+    mutex_t queue_lock;
+    cond_t queue_cond;
+    SimWrite queue[SIM_QUEUE_SIZE];
+    uint32_t queue_head;
+    uint32_t queue_count;
+    int queue_busy;
+    int stop;
+    lwp_t thread;
+
+    int64_t debt_us;            // Modelled bus time not yet slept
+    int open;
+    int link_failed;            // fail_after has fired
+};
+
+void usb_sim_default_config(UsbSimConfig* config) {
+    config->latency_us = 125;           // One USB 2.0 microframe
+    config->bandwidth = 30 * 1024 * 1024;
+    config->echo_sequence = 1;
+    config->reject_pipelining = 0;
+    config->drop_ack = -1;
+    config->corrupt_offset = -1;
+    config->fail_after = -1;
+}
+
+// --- Bus Timing ---
+
+static void sim_charge(UsbSim* sim, uint32_t bytes) {
+    int64_t cost = sim->config.latency_us;
+    if (sim->config.bandwidth) {
+        cost += ((int64_t)bytes * 1000000) / sim->config.bandwidth;
+    }
+
+    // Sleep in batches so timer granularity does not skew small transfers
+    sim->debt_us += cost;
+    if (sim->debt_us >= 1000) {
+        u64 start = gettime();
+        usleep((useconds_t)sim->debt_us);
+        sim->debt_us -= (int64_t)ticks_to_microsecs(gettime() - start);
+    }
+}
+
+// --- Storage ---
+
+// Partition by name; "SYSTEM.img" from a file header is the same as SYSTEM
+static SimPartition* sim_partition(UsbSim* sim, const char* name) {
+    char key[32];
+    strncpy(key, name, sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+    char* dot = strrchr(key, '.');
+    if (dot && strcmp(dot, ".img") == 0) *dot = '\0';
+
+    SimPartition* free_slot = NULL;
+    for (int i = 0; i < SIM_PARTITIONS; i++) {
+        SimPartition* p = &sim->partitions[i];
+        if (p->name[0] && strcmp(p->name, key) == 0) return p;
+        if (!p->name[0] && !free_slot) free_slot = p;
+    }
+    if (free_slot) strcpy(free_slot->name, key);
+    return free_slot;
+}
+
+static void sim_store(UsbSim* sim, SimPartition* p, uint64_t offset,
+                      const uint8_t* data, uint32_t length) {
+    if (!p || length == 0) return;
+
+    uint64_t end = offset + length;
+    if (end > p->capacity) {
+        uint64_t capacity = p->capacity ? p->capacity : 1024 * 1024;
+        while (capacity < end) capacity *= 2;
+        uint8_t* grown = realloc(p->data, capacity);
+        if (!grown) return;
+        memset(grown + p->capacity, 0, capacity - p->capacity);
+        p->data = grown;
+        p->capacity = capacity;
+    }
+    memcpy(p->data + offset, data, length);
+    if (end > p->size) p->size = end;
+
+    int64_t corrupt = sim->config.corrupt_offset;
+    if (corrupt >= 0 && (uint64_t)corrupt >= offset && (uint64_t)corrupt < end) {
+        p->data[corrupt] ^= 0x01;
+    }
+}
+
+// --- Protocol ---
+
+static void sim_respond(UsbSim* sim, uint32_t status, uint32_t sequence) {
+    if (sim->response_count >= SIM_RESPONSES) return;
+
+    uint8_t* packet = sim->responses[(sim->response_head + sim->response_count) % SIM_RESPONSES];
+    memset(packet, 0, 16);
+    *(uint32_t*)(packet + 0) = status;
+    *(uint32_t*)(packet + 4) = sim->config.echo_sequence ? sequence : 0;
+    sim->response_count++;
+}
+
+// The PITD answer: status, then the table's size and CRC32
+static void sim_respond_pit(UsbSim* sim) {
+    if (sim->response_count >= SIM_RESPONSES) return;
+
+    uint8_t* packet = sim->responses[(sim->response_head + sim->response_count) % SIM_RESPONSES];
+    memset(packet, 0, 16);
+    *(uint32_t*)(packet + 0) = sim->pit ? 0 : 1;
+    if (sim->pit) {
+        *(uint32_t*)(packet + 4) = sim->pit_size;
+        *(uint32_t*)(packet + 8) = crc32_update(0, sim->pit, sim->pit_size);
+        sim->pit_offset = 0;
+        sim->pit_remaining = sim->pit_size;
+        sim->stats.pit_downloads++;
+    }
+    sim->response_count++;
+}
+
+static void sim_command(UsbSim* sim, const uint8_t* data) {
+    // Names fill at most 12 bytes, the parameter sits in the last 4
+    char name[13];
+    memcpy(name, data, 12);
+    name[12] = '\0';
+
+    sim->stats.commands++;
+    if (strcmp(name, "Odin") == 0) {
+        sim->stats.sessions++;
+    } else if (strcmp(name, "PITR") == 0) {
+        sim->stats.pit_requests++;
+    } else if (strcmp(name, "PITD") == 0) {
+        sim_respond_pit(sim);
+    } else if (strcmp(name, "ENDC") == 0) {
+        sim->dump_remaining = 0;
+        sim->pit_remaining = 0;
+        sim->state = SIM_IDLE;
+    } else if (strcmp(name, "REBT") == 0) {
+        sim->stats.reboots++;
+        sim->state = SIM_IDLE;
+    } else {
+        // Anything else selects a partition for a raw stream
+        strncpy(sim->stats.partition, name, sizeof(sim->stats.partition) - 1);
+        sim->target = sim_partition(sim, name);
+        if (sim->target) sim->target->size = 0;
+        sim->raw_offset = 0;
+        sim->state = SIM_RAW;
+    }
+}
+
+static void sim_receive(UsbSim* sim, const uint8_t* data, uint32_t length) {
+    sim->stats.bytes_out += length;
+
+    switch (sim->state) {
+        case SIM_IDLE:
+            if (length == 16) {
+                sim_command(sim, data);
+            } else if (length == 1024 && *(const uint32_t*)data == 0x00000003) {
+                // Dump request: the partition goes back over bulk IN
+                char name[32];
+                strncpy(name, (const char*)(data + 16), sizeof(name) - 1);
+                name[sizeof(name) - 1] = '\0';
+                sim->dump = sim_partition(sim, name);
+                sim->dump_offset = *(const uint32_t*)(data + 8);
+                sim->dump_remaining = *(const uint32_t*)(data + 4);
+            } else if (length == 1024) {
+                strncpy(sim->stats.partition, (const char*)(data + 16),
+                        sizeof(sim->stats.partition) - 1);
+                sim->target = sim_partition(sim, sim->stats.partition);
+                sim->part_size = 0;
+                sim->file_checksum = 0;
+                sim->checksum_parts = *(const uint32_t*)(data + 12);
+                sim->delta = (*(const uint32_t*)(data + 276) & 1) != 0;
+                sim->file_size = *(const uint32_t*)(data + 4);
+                if (sim->delta) {
+                    sim->part_size = *(const uint32_t*)(data + 272);
+                } else if (sim->checksum_parts > 0) {
+                    // Resumed file: what is stored below the first part
+                    // counts, as if the device had read it back
+                    sim->part_size = *(const uint32_t*)(data + 272);
+                    uint64_t kept = (uint64_t)sim->checksum_parts * sim->part_size;
+                    if (sim->target && sim->target->size > kept) sim->target->size = kept;
+                    if (sim->target) {
+                        sim->file_checksum = crc32_update(0, sim->target->data,
+                                                          (uint32_t)sim->target->size);
+                    }
+                } else if (sim->target) {
+                    sim->target->size = 0;
+                }
+                sim->state = SIM_FILE;
+            }
+            break;
+
+        case SIM_RAW:
+            if (length == 16 && memcmp(data, "ENDC", 5) == 0) {
+                sim_command(sim, data);
+            } else {
+                sim_store(sim, sim->target, sim->raw_offset, data, length);
+                sim->raw_offset += length;
+                sim->stats.payload_bytes += length;
+            }
+            break;
+
+        case SIM_FILE: {
+            if (length != 16) break;
+            uint32_t magic = *(const uint32_t*)data;
+            if (magic == 0x00000001) {
+                sim->part_sequence = *(const uint32_t*)(data + 4);
+                sim->part_remaining = *(const uint32_t*)(data + 8);
+                // A part that arrives while an ACK is unread is pipelined
+                sim->part_rejected = sim->config.reject_pipelining &&
+                                     sim->response_count > 0;
+                sim->part_summed = !sim->part_rejected &&
+                                   sim->part_sequence == sim->checksum_parts;
+                // Every part but the last is as long as part 0
+                if (sim->part_sequence == 0) sim->part_size = sim->part_remaining;
+                sim->part_offset = (uint64_t)sim->part_sequence * sim->part_size;
+                sim->state = SIM_PART_DATA;
+            } else if (magic == 0x00000002) {
+                // After a delta the image is only whole in storage
+                if (sim->delta && sim->target) {
+                    uint64_t size = sim->target->size;
+                    if (size > sim->file_size) size = sim->file_size;
+                    sim->file_checksum = crc32_update(0, sim->target->data, (uint32_t)size);
+                    if (size < sim->file_size) sim->file_checksum = ~sim->file_checksum;
+                }
+                if (*(const uint32_t*)(data + 8) != sim->file_checksum) {
+                    sim->stats.checksum_mismatches++;
+                }
+                sim->stats.files++;
+                sim->state = SIM_IDLE;
+            } else if (memcmp(data, "ENDC", 5) == 0) {
+                sim_command(sim, data);
+            }
+            break;
+        }
+
+        case SIM_PART_DATA: {
+            uint32_t used = (length < sim->part_remaining) ? length : sim->part_remaining;
+            sim->part_remaining -= used;
+            if (!sim->part_rejected) {
+                sim_store(sim, sim->target, sim->part_offset, data, used);
+                sim->part_offset += used;
+                sim->stats.payload_bytes += used;
+            }
+            if (sim->part_summed) {
+                sim->file_checksum = crc32_update(sim->file_checksum, data, used);
+            }
+            if (sim->part_remaining > 0) break;
+
+            sim->state = SIM_FILE;
+            if (sim->part_summed) {
+                sim->checksum_parts++;
+            }
+            if (sim->part_rejected) {
+                sim->stats.rejected++;
+                sim_respond(sim, 1, sim->part_sequence);
+            } else if (!sim->ack_dropped && sim->config.drop_ack >= 0 &&
+                       sim->part_sequence == (uint32_t)sim->config.drop_ack) {
+                sim->ack_dropped = 1;
+            } else {
+                sim->stats.parts++;
+                sim_respond(sim, 0, sim->part_sequence);
+            }
+            break;
+        }
+    }
+}
+
+static void sim_process(UsbSim* sim, const uint8_t* data, uint32_t length) {
+    LWP_MutexLock(sim->state_lock);
+    sim_receive(sim, data, length);
+    LWP_MutexUnlock(sim->state_lock);
+
+    sim_charge(sim, length);
+}
+
+// fail_after: the link drops once, losing the file in progress and any
+// unread ACKs, as a cable hiccup would
+static int sim_link_fails(UsbSim* sim) {
+    if (sim->config.fail_after < 0 || sim->link_failed) return 0;
+
+    LWP_MutexLock(sim->state_lock);
+    int fail = (sim->stats.payload_bytes >= (uint64_t)sim->config.fail_after);
+    if (fail) {
+        sim->link_failed = 1;
+        sim->state = SIM_IDLE;
+        sim->response_count = 0;
+    }
+    LWP_MutexUnlock(sim->state_lock);
+    return fail;
+}
+
+// --- Bus Thread ---
+
+static void* sim_bus_thread(void* arg) {
+    UsbSim* sim = (UsbSim*)arg;
+
+    LWP_MutexLock(sim->queue_lock);
+    while (!sim->stop) {
+        if (sim->queue_count == 0) {
+            LWP_CondWait(sim->queue_cond, sim->queue_lock);
+            continue;
+        }
+
+        SimWrite write = sim->queue[sim->queue_head];
+        sim->queue_busy = 1;
+        LWP_MutexUnlock(sim->queue_lock);
+
+        s32 result = -1;
+        if (!sim_link_fails(sim)) {
+            sim_process(sim, write.data, write.length);
+            result = (s32)write.length;
+        }
+        if (write.callback) {
+            write.callback(result, write.arg);
+        }
+
+        LWP_MutexLock(sim->queue_lock);
+        sim->queue_head = (sim->queue_head + 1) % SIM_QUEUE_SIZE;
+        sim->queue_count--;
+        sim->queue_busy = 0;
+        LWP_CondBroadcast(sim->queue_cond);
+    }
+    LWP_MutexUnlock(sim->queue_lock);
+
+    return NULL;
+}
+
+// Wait for queued async writes so synchronous traffic stays in order
+static void sim_flush(UsbSim* sim) {
+    LWP_MutexLock(sim->queue_lock);
+    while (sim->queue_count > 0 || sim->queue_busy) {
+        LWP_CondWait(sim->queue_cond, sim->queue_lock);
+    }
+    LWP_MutexUnlock(sim->queue_lock);
+}
+
+// --- Transport ---
+
+static int sim_init(void* ctx) {
+    UsbSim* sim = (UsbSim*)ctx;
+    sim->stats.inits++;
+    return 0;
+}
+
+static int sim_open(void* ctx, int index) {
+    UsbSim* sim = (UsbSim*)ctx;
+    if (index != 0) return -1;
+    sim->open = 1;
+    sim->stats.opens++;
+    return 0;
+}
+
+// Download mode descriptors: one data interface with a bulk pair
+static int sim_describe(void* ctx, UsbDeviceInfo* info) {
+    UsbSim* sim = (UsbSim*)ctx;
+    if (!sim->open) return -1;
+    info->vid = 0x04E8;
+    info->pid = 0x685D;
+    info->configuration = 1;
+    info->interface = 1;
+    info->alternate = 0;
+    info->endpoint_out = 0x01;
+    info->endpoint_in = 0x81;
+    info->max_packet = 512;
+    return 0;
+}
+
+static int sim_probe(void* ctx) {
+    UsbSim* sim = (UsbSim*)ctx;
+    return sim->open ? 0 : -1;
+}
+
+static int sim_bulk_out(void* ctx, const uint8_t* data, uint32_t length) {
+    UsbSim* sim = (UsbSim*)ctx;
+    if (!sim->open) return -1;
+
+    sim_flush(sim);
+    if (sim_link_fails(sim)) return -1;
+    sim_process(sim, data, length);
+    return (int)length;
+}
+
+static int sim_bulk_out_async(void* ctx, const uint8_t* data, uint32_t length,
+                              UsbAsyncCallback callback, void* arg) {
+    UsbSim* sim = (UsbSim*)ctx;
+    if (!sim->open) return -1;
+
+    LWP_MutexLock(sim->queue_lock);
+    while (sim->queue_count >= SIM_QUEUE_SIZE) {
+        LWP_CondWait(sim->queue_cond, sim->queue_lock);
+    }
+    SimWrite* write = &sim->queue[(sim->queue_head + sim->queue_count) % SIM_QUEUE_SIZE];
+    write->data = data;
+    write->length = length;
+    write->callback = callback;
+    write->arg = arg;
+    sim->queue_count++;
+    LWP_CondBroadcast(sim->queue_cond);
+    LWP_MutexUnlock(sim->queue_lock);
+
+    return 0;
+}
+
+static int sim_bulk_in(void* ctx, uint8_t* data, uint32_t length) {
+    UsbSim* sim = (UsbSim*)ctx;
+    if (!sim->open) return -1;
+
+    sim_flush(sim);
+
+    LWP_MutexLock(sim->state_lock);
+    int result = -1; // Nothing to send: the real stack would time out
+    if (sim->dump_remaining > 0) {
+        uint32_t size = (length < sim->dump_remaining) ? length : (uint32_t)sim->dump_remaining;
+        SimPartition* p = sim->dump;
+        uint64_t stored = (p && sim->dump_offset < p->size) ? p->size - sim->dump_offset : 0;
+        uint32_t copy = (stored < size) ? (uint32_t)stored : size;
+        if (copy) memcpy(data, p->data + sim->dump_offset, copy);
+        memset(data + copy, 0, size - copy); // Never written: erased
+        sim->dump_offset += size;
+        sim->dump_remaining -= size;
+        sim->stats.bytes_in += size;
+        sim->stats.dumped_bytes += size;
+        result = (int)size;
+    } else if (sim->response_count > 0) {
+        uint32_t size = (length < 16) ? length : 16;
+        memcpy(data, sim->responses[sim->response_head], size);
+        sim->response_head = (sim->response_head + 1) % SIM_RESPONSES;
+        sim->response_count--;
+        sim->stats.bytes_in += size;
+        result = (int)size;
+    } else if (sim->pit_remaining > 0) {
+        uint32_t size = (length < sim->pit_remaining) ? length : sim->pit_remaining;
+        memcpy(data, sim->pit + sim->pit_offset, size);
+        sim->pit_offset += size;
+        sim->pit_remaining -= size;
+        sim->stats.bytes_in += size;
+        result = (int)size;
+    }
+    LWP_MutexUnlock(sim->state_lock);
+
+    sim_charge(sim, (result > 0) ? result : 0);
+    return result;
+}
+
+static int sim_control(void* ctx, uint8_t request_type, uint8_t request,
+                       uint16_t value, uint16_t index, uint8_t* data, uint16_t length) {
+    UsbSim* sim = (UsbSim*)ctx;
+    if (!sim->open) return -1;
+
+    sim_charge(sim, length);
+    return length;
+}
+
+static void sim_close(void* ctx) {
+    UsbSim* sim = (UsbSim*)ctx;
+    sim_flush(sim);
+    sim->open = 0;
+}
+
+// --- Public API ---
+
+UsbSim* usb_sim_create(const UsbSimConfig* config) {
+    UsbSim* sim = calloc(1, sizeof(UsbSim));
+    if (!sim) return NULL;
+
+    if (config) {
+        sim->config = *config;
+    } else {
+        usb_sim_default_config(&sim->config);
+    }
+
+    sim->transport.name = "simulated";
+    sim->transport.init = sim_init;
+    sim->transport.open = sim_open;
+    sim->transport.bulk_out = sim_bulk_out;
+    sim->transport.bulk_out_async = sim_bulk_out_async;
+    sim->transport.bulk_in = sim_bulk_in;
+    sim->transport.control = sim_control;
+    sim->transport.close = sim_close;
+    sim->transport.describe = sim_describe;
+    sim->transport.probe = sim_probe;
+    sim->transport.ctx = sim;
+
+    LWP_MutexInit(&sim->state_lock, false);
+    LWP_MutexInit(&sim->queue_lock, false);
+    LWP_CondInit(&sim->queue_cond);
+
+    if (LWP_CreateThread(&sim->thread, sim_bus_thread, sim, NULL,
+                         SIM_STACK_SIZE, SIM_PRIORITY) < 0) {
+        LWP_CondDestroy(sim->queue_cond);
+        LWP_MutexDestroy(sim->queue_lock);
+        LWP_MutexDestroy(sim->state_lock);
+        free(sim);
+        return NULL;
+    }
+
+    return sim;
+}
+
+void usb_sim_destroy(UsbSim* sim) {
+    if (!sim) return;
+
+    sim_flush(sim);
+
+    LWP_MutexLock(sim->queue_lock);
+    sim->stop = 1;
+    LWP_CondBroadcast(sim->queue_cond);
+    LWP_MutexUnlock(sim->queue_lock);
+    LWP_JoinThread(sim->thread, NULL);
+
+    LWP_CondDestroy(sim->queue_cond);
+    LWP_MutexDestroy(sim->queue_lock);
+    LWP_MutexDestroy(sim->state_lock);
+    for (int i = 0; i < SIM_PARTITIONS; i++) {
+        free(sim->partitions[i].data);
+    }
+    free(sim->pit);
+    free(sim);
+}
+
+int usb_sim_set_pit(UsbSim* sim, const uint8_t* data, uint32_t length) {
+    if (!sim) return -1;
+    uint8_t* pit = NULL;
+    if (data && length) {
+        pit = malloc(length);
+        if (!pit) return -1;
+        memcpy(pit, data, length);
+    }
+
+    LWP_MutexLock(sim->state_lock);
+    free(sim->pit);
+    sim->pit = pit;
+    sim->pit_size = pit ? length : 0;
+    sim->pit_remaining = 0;
+    LWP_MutexUnlock(sim->state_lock);
+    return 0;
+}
+
+void usb_sim_unplug(UsbSim* sim) {
+    if (!sim) return;
+    sim_flush(sim);
+    LWP_MutexLock(sim->state_lock);
+    sim->open = 0;
+    sim->state = SIM_IDLE;
+    sim->response_count = 0;
+    sim->pit_remaining = 0;
+    LWP_MutexUnlock(sim->state_lock);
+}
+
+const UsbTransport* usb_sim_transport(UsbSim* sim) {
+    return sim ? &sim->transport : NULL;
+}
+
+void usb_sim_get_stats(UsbSim* sim, UsbSimStats* stats) {
+    if (!sim || !stats) return;
+
+    sim_flush(sim);
+    LWP_MutexLock(sim->state_lock);
+    *stats = sim->stats;
+    LWP_MutexUnlock(sim->state_lock);
+}
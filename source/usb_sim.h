@@ -0,0 +1,56 @@
+// source/usb_sim.h
+#ifndef USB_SIM_H
+#define USB_SIM_H
+
+#include <stdint.h>
+#include "usb.h"
+
+// In-process Samsung download-mode device. Speaks the Odin handshake
+// (Odin/PITR/ENDC), hands out its PIT (PITD), takes raw partition streams and the file part
+// protocol, and ACKs parts. What is written is kept per partition, so a
+// readback (dump request) returns it. Bus timing is modelled from a per-transfer
+// latency and a bandwidth, so the flash path can be timed without a Wii
+// or a phone.
+
+typedef struct {
+    uint32_t latency_us;        // Turnaround per bulk transfer
+    uint32_t bandwidth;         // Bus bytes per second, 0 = unlimited
+    int echo_sequence;          // ACKs echo the part sequence (allows a window)
+    int reject_pipelining;      // NAK parts sent before the previous ACK was read
+    int32_t drop_ack;           // Swallow the ACK of this sequence once, -1 = never
+    int64_t corrupt_offset;     // Flip a bit of the byte stored here, -1 = never
+    int64_t fail_after;         // Drop the link once after this many payload bytes, -1 = never
+} UsbSimConfig;
+
+typedef struct {
+    uint32_t inits;             // Host stack setups
+    uint32_t opens;             // Device opens (enumerations)
+    uint32_t sessions;          // "Odin" handshakes
+    uint32_t pit_requests;
+    uint32_t pit_downloads;     // PITD answered with a table
+    uint32_t commands;
+    uint32_t files;             // Completed file protocol transfers
+    uint32_t parts;             // Parts ACKed
+    uint32_t rejected;          // Parts NAKed
+    uint32_t checksum_mismatches; // File ends whose CRC32 disagreed with the data
+    uint32_t reboots;
+    uint64_t bytes_out;         // Host to device, all traffic
+    uint64_t bytes_in;          // Device to host
+    uint64_t payload_bytes;     // Image bytes received
+    uint64_t dumped_bytes;      // Partition bytes read back
+    char partition[32];         // Last partition selected
+} UsbSimStats;
+
+typedef struct UsbSim UsbSim;
+
+void usb_sim_default_config(UsbSimConfig* config);
+UsbSim* usb_sim_create(const UsbSimConfig* config);
+void usb_sim_destroy(UsbSim* sim);
+const UsbTransport* usb_sim_transport(UsbSim* sim);
+void usb_sim_get_stats(UsbSim* sim, UsbSimStats* stats);
+// The PIT the device answers PITD with (copied); NULL for none
+int usb_sim_set_pit(UsbSim* sim, const uint8_t* data, uint32_t length);
+// The cable is pulled: transfers and probes fail until the device is opened again
+void usb_sim_unplug(UsbSim* sim);
+
+#endif
@@ -0,0 +1,172 @@
+// source/worker.c
+#include <gccore.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "worker.h"
+#include "flash.h"
+
+#define WORKER_STACK_SIZE (64 * 1024)  // Jobs keep paths and headers on the stack
+#define WORKER_PRIORITY   60           // Below the SD and USB threads it starts
+
+typedef struct {
+    WorkerJob job;
+    void* arg;
+} WorkerTask;
+
+static lwp_t worker_thread = LWP_THREAD_NULL;
+static mqbox_t job_queue = MQ_BOX_NULL;
+static mqbox_t message_queue = MQ_BOX_NULL;
+static WorkerTask worker_task;
+static int worker_running = 0;     // UI side: a job was started and its DONE not seen
+
+// Messages travel as pointers into a ring of slots. Besides the queued
+// ones, the UI may still be copying out a slot it has just taken off the
+// queue while the worker fills the next, so the queue holds two less than
+// the ring. That needs no help from the thread priorities.
+static WorkerMessage message_slots[WORKER_MESSAGES];
+static uint32_t message_next = 0;  // Worker side only
+
+// Progress snapshot: a sequence count that is odd while the job writes it.
+// The UI copies it out and retries when the count moved underneath it.
+static volatile uint32_t progress_sequence = 0;
+static WorkerProgress progress_snapshot;
+
+// --- Worker Thread ---
+
+static void worker_send(const WorkerMessage* message) {
+    WorkerMessage* slot = &message_slots[message_next];
+    message_next = (message_next + 1) % WORKER_MESSAGES;
+    *slot = *message;
+    // Blocks while the UI is behind, which holds the job back with it
+    MQ_Send(message_queue, (mqmsg_t)slot, MQ_MSG_BLOCK);
+}
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    while (1) {
+        mqmsg_t msg;
+        if (!MQ_Receive(job_queue, &msg, MQ_MSG_BLOCK)) break;
+        WorkerTask* task = (WorkerTask*)msg;
+        if (!task) break;
+
+        WorkerMessage done;
+        memset(&done, 0, sizeof(done));
+        done.type = WORKER_MSG_DONE;
+        done.result = task->job(task->arg);
+        worker_send(&done);
+    }
+    return NULL;
+}
+
+// --- Public API ---
+
+int worker_init(void) {
+    if (worker_thread != LWP_THREAD_NULL) return 0;
+
+    worker_running = 0;
+    message_next = 0;
+    progress_sequence = 0;
+    memset(&progress_snapshot, 0, sizeof(progress_snapshot));
+
+    if (MQ_Init(&job_queue, 1) < 0) return -1;
+    if (MQ_Init(&message_queue, WORKER_MESSAGES - 2) < 0) {
+        MQ_Close(job_queue);
+        job_queue = MQ_BOX_NULL;
+        return -1;
+    }
+    if (LWP_CreateThread(&worker_thread, worker_main, NULL, NULL,
+                         WORKER_STACK_SIZE, WORKER_PRIORITY) < 0) {
+        worker_thread = LWP_THREAD_NULL;
+        MQ_Close(message_queue);
+        MQ_Close(job_queue);
+        message_queue = job_queue = MQ_BOX_NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void worker_shutdown(void) {
+    if (worker_thread == LWP_THREAD_NULL) return;
+
+    // A job still running is cancelled and drained, so it is never left
+    // blocked on a full message queue
+    if (worker_running) worker_cancel();
+    WorkerMessage message;
+    while (worker_running) {
+        if (!worker_poll(&message)) usleep(1000);
+    }
+
+    MQ_Send(job_queue, (mqmsg_t)NULL, MQ_MSG_BLOCK);
+    LWP_JoinThread(worker_thread, NULL);
+    worker_thread = LWP_THREAD_NULL;
+    MQ_Close(message_queue);
+    MQ_Close(job_queue);
+    message_queue = job_queue = MQ_BOX_NULL;
+}
+
+int worker_start(WorkerJob job, void* arg) {
+    if (!job || worker_thread == LWP_THREAD_NULL || worker_running) return -1;
+
+    // An abort from the last job must not stop this one
+    flash_clear_abort();
+    worker_publish_progress(0.0f, "Starting");
+
+    worker_task.job = job;
+    worker_task.arg = arg;
+    worker_running = 1;
+    MQ_Send(job_queue, (mqmsg_t)&worker_task, MQ_MSG_BLOCK);
+    return 0;
+}
+
+int worker_is_busy(void) {
+    return worker_running;
+}
+
+void worker_cancel(void) {
+    flash_abort();
+}
+
+int worker_cancelled(void) {
+    return flash_abort_requested();
+}
+
+void worker_post(int type, int level, const char* text) {
+    WorkerMessage message;
+    message.type = type;
+    message.level = level;
+    message.result = 0;
+    snprintf(message.text, sizeof(message.text), "%s", text ? text : "");
+    worker_send(&message);
+}
+
+void worker_publish_progress(float progress, const char* status) {
+    progress_sequence++;
+    __sync_synchronize();
+    progress_snapshot.progress = progress;
+    snprintf(progress_snapshot.status, sizeof(progress_snapshot.status), "%s",
+             status ? status : "");
+    progress_snapshot.updates++;
+    __sync_synchronize();
+    progress_sequence++;
+}
+
+int worker_poll(WorkerMessage* message) {
+    if (message_queue == MQ_BOX_NULL) return 0;
+
+    mqmsg_t msg;
+    if (!MQ_Receive(message_queue, &msg, MQ_MSG_NOBLOCK)) return 0;
+    *message = *(WorkerMessage*)msg;
+    if (message->type == WORKER_MSG_DONE) worker_running = 0;
+    return 1;
+}
+
+void worker_get_progress(WorkerProgress* progress) {
+    uint32_t sequence;
+    do {
+        sequence = progress_sequence;
+        __sync_synchronize();
+        *progress = progress_snapshot;
+        __sync_synchronize();
+    } while ((sequence & 1) || sequence != progress_sequence);
+}
@@ -0,0 +1,55 @@
+// source/worker.h
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdint.h>
+
+// Flash worker. Long jobs (flashing, backups, verifies) run on their own
+// LWP thread so the main loop keeps polling WPAD and drawing. The job
+// talks to the UI through a message queue (log lines, notices, the result)
+// and publishes progress into a snapshot the UI reads every frame without
+// taking a lock. Cancelling raises the flash engine's abort token, which
+// the transfer loops check between chunks, so a job unwinds the normal
+// way: session closed, digest dropped, checkpoint kept.
+
+#define WORKER_MESSAGES 16
+
+#define WORKER_MSG_LOG    0     // A gui_log line
+#define WORKER_MSG_NOTICE 1     // A gui_show_message
+#define WORKER_MSG_DONE   2     // The job returned; result holds its value
+
+typedef struct {
+    int type;
+    int level;                  // MSG_INFO etc. for LOG and NOTICE
+    int result;
+    char text[256];
+} WorkerMessage;
+
+typedef struct {
+    float progress;
+    char status[64];
+    uint32_t updates;           // Publishes so far; changes when there is news
+} WorkerProgress;
+
+// Returns the value posted with WORKER_MSG_DONE
+typedef int (*WorkerJob)(void* arg);
+
+int worker_init(void);
+void worker_shutdown(void);
+
+// Run job on the worker. -1 when one is already running.
+int worker_start(WorkerJob job, void* arg);
+int worker_is_busy(void);
+void worker_cancel(void);
+int worker_cancelled(void);
+
+// From the job
+void worker_post(int type, int level, const char* text);
+// Single writer: only the job may call this
+void worker_publish_progress(float progress, const char* status);
+
+// From the UI. worker_poll returns 1 with a message, 0 when there is none.
+int worker_poll(WorkerMessage* message);
+void worker_get_progress(WorkerProgress* progress);
+
+#endif